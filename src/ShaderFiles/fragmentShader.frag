@@ -3,8 +3,10 @@
 in vec2 vTex;
 out vec4 FragColor;
 uniform sampler2D screen;
+uniform vec2 uvScale = vec2(1.0);  // Valid region of a pooled, bucket-sized texture
 
 void main()
 {
-    FragColor = texture(screen, vTex);
+    // Linear filtering stops half a texel short of the region's far edges
+    FragColor = texture(screen, min(vTex * uvScale, uvScale - 0.5 / vec2(textureSize(screen, 0))));
 }
\ No newline at end of file
@@ -10,8 +10,13 @@ Camera::Camera(int width, int height, glm::vec3 position)
     Position = position;
 }
 
-void Camera::ProcessInputs(GLFWwindow *window, int width, int height)
+bool Camera::ProcessInputs(GLFWwindow *window, int width, int height)
 {
+    glm::vec3 lastPosition = Position;
+    float lastYaw = yaw;
+    float lastPitch = pitch;
+    BufferType lastBuffer = activeBuffer;
+
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
         Position += speed * Orientation; // Forward
     if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
@@ -75,4 +80,6 @@ void Camera::ProcessInputs(GLFWwindow *window, int width, int height)
         glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
         firstClick = true;
     }
+
+    return Position != lastPosition || yaw != lastYaw || pitch != lastPitch || activeBuffer != lastBuffer;
 }
\ No newline at end of file
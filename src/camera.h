@@ -34,7 +34,7 @@ class Camera
 
         Camera(int width, int height, glm::vec3 Position);
         void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
-        void ProcessInputs(GLFWwindow *window, int width, int height);
+        bool ProcessInputs(GLFWwindow *window, int width, int height);   // True when the view changed
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,43 @@
+#include "dynamicResolution.h"
+#include <algorithm>
+#include <cmath>
+
+void DynamicResolution::Reset()
+{
+    smoothedMs = 0.0f;
+    framesSinceChange = 0;
+}
+
+float DynamicResolution::Update(float gpuMs, float currentScale)
+{
+    if (!enabled || gpuMs <= 0.0f)
+        return currentScale;
+
+    // Results this soon after a change may still come from the old resolution
+    if (++framesSinceChange <= settleFrames)
+        return currentScale;
+
+    // A single spike (driver hitch, texture reallocation) may at most double the average
+    if (smoothedMs > 0.0f)
+        gpuMs = std::min(gpuMs, 2.0f * smoothedMs);
+    smoothedMs = (smoothedMs <= 0.0f) ? gpuMs : smoothedMs + smoothing * (gpuMs - smoothedMs);
+
+    if (framesSinceChange < settleFrames + averageFrames)
+        return currentScale;
+
+    // Inside the band: hold, so noise doesn't cause a resize every frame
+    if (std::fabs(smoothedMs - targetMs) <= hysteresis * targetMs)
+        return currentScale;
+
+    float predicted = currentScale * std::sqrt(targetMs / smoothedMs);
+    float step = predicted - currentScale;
+    step = std::max(-maxStepDown, std::min(maxStepUp, step));
+
+    float scale = std::max(minScale, std::min(maxScale, currentScale + step));
+    if (scale != currentScale)
+    {
+        framesSinceChange = 0;
+        smoothedMs = 0.0f;
+    }
+    return scale;
+}
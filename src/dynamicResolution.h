@@ -0,0 +1,30 @@
+#ifndef DYNAMIC_RESOLUTION_CLASS_H
+#define DYNAMIC_RESOLUTION_CLASS_H
+
+// Render scale controller holding the GPU frame time at a budget. Marching
+// cost scales with pixel count, i.e. with scale², which gives the step
+// prediction. A hysteresis band around the target and a settle period after
+// each change (GPU timer results lag by a few frames) keep it from oscillating.
+class DynamicResolution
+{
+    public:
+        bool  enabled = false;
+        float targetMs = 8.3f;
+        float minScale = 0.5f;
+        float maxScale = 1.0f;
+        float hysteresis = 0.1f;        // Fraction of targetMs around it where the scale is held
+        float maxStepDown = 0.1f;       // Largest scale change per adjustment
+        float maxStepUp = 0.05f;        // Growing is slower than shrinking to avoid overshoot
+        int   settleFrames = 4;         // Frames to wait after a change before measuring again
+        int   averageFrames = 4;        // Samples averaged before the next decision
+        float smoothing = 0.25f;        // Weight of the newest sample in the moving average
+
+        float smoothedMs = 0.0f;
+        int   framesSinceChange = 0;
+
+        // Takes the latest GPU frame time, returns the render scale to use
+        float Update(float gpuMs, float currentScale);
+        void Reset();
+};
+
+#endif
@@ -0,0 +1,35 @@
+#include "frameInvalidation.h"
+
+unsigned FrameInvalidation::Changes(const FrameInputs& inputs) const
+{
+    if (!hasLast)
+        return INPUT_ALL;
+
+    unsigned changes = 0;
+    if (inputs.camPos != last.camPos || inputs.camRot != last.camRot)
+        changes |= INPUT_CAMERA;
+    if (inputs.scene != last.scene)
+        changes |= INPUT_SCENE;
+    if (inputs.debugView != last.debugView)
+        changes |= INPUT_DEBUG_VIEW;
+    if (inputs.renderRes != last.renderRes || inputs.displayRes != last.displayRes)
+        changes |= INPUT_RESOLUTION;
+    if (inputs.cascadeFormat != last.cascadeFormat || inputs.outputFormat != last.outputFormat
+        || inputs.temporalMode != last.temporalMode || inputs.lodScale != last.lodScale
+        || inputs.rayClipping != last.rayClipping || inputs.cascade1Octahedral != last.cascade1Octahedral)
+        changes |= INPUT_SETTINGS;
+    if (inputs.jitter != last.jitter)
+        changes |= INPUT_JITTER;
+    return changes;
+}
+
+void FrameInvalidation::Rendered(const FrameInputs& inputs)
+{
+    last = inputs;
+    hasLast = true;
+}
+
+void FrameInvalidation::Invalidate()
+{
+    hasLast = false;
+}
@@ -0,0 +1,54 @@
+#ifndef FRAME_INVALIDATION_CLASS_H
+#define FRAME_INVALIDATION_CLASS_H
+
+#include <glm/glm.hpp>
+#include "sceneParams.h"
+
+enum FrameInput
+{
+    INPUT_CAMERA     = 1 << 0,
+    INPUT_SCENE      = 1 << 1,
+    INPUT_DEBUG_VIEW = 1 << 2,
+    INPUT_RESOLUTION = 1 << 3,
+    INPUT_SETTINGS   = 1 << 4,  // Storage formats, upscaling mode, LOD, ray clipping, cascade1 mapping
+    INPUT_JITTER     = 1 << 5,
+    INPUT_ALL        = (1 << 6) - 1
+};
+
+// Inputs each pass reads; a pass whose inputs are all unchanged keeps last
+// frame's results. The debug view only selects what the main march and the
+// shading write.
+const unsigned CASCADE_INPUTS = INPUT_CAMERA | INPUT_SCENE | INPUT_RESOLUTION | INPUT_SETTINGS | INPUT_JITTER;
+const unsigned MARCH_INPUTS   = CASCADE_INPUTS | INPUT_DEBUG_VIEW;
+
+// Everything the rendered image depends on
+struct FrameInputs
+{
+    glm::vec3   camPos;
+    glm::vec3   camRot;
+    int         debugView;
+    SceneParams scene;
+    glm::ivec2  renderRes;
+    glm::ivec2  displayRes;
+    int         cascadeFormat;
+    int         outputFormat;
+    int         temporalMode;
+    float       lodScale;
+    int         rayClipping;
+    bool        cascade1Octahedral;
+    glm::vec2   jitter;
+};
+
+// Frame-level dirty tracking against the inputs of the last rendered frame
+class FrameInvalidation
+{
+    public:
+        FrameInputs last;
+        bool        hasLast = false;
+
+        unsigned Changes(const FrameInputs& inputs) const;  // FrameInput bits that differ
+        void Rendered(const FrameInputs& inputs);
+        void Invalidate();                                  // Next frame renders in full
+};
+
+#endif
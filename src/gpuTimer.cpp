@@ -0,0 +1,64 @@
+#include "gpuTimer.h"
+
+void GpuTimer::Init()
+{
+    glGenQueries(FRAMES_IN_FLIGHT * TIMER_COUNT, &queries[0][0]);
+}
+
+void GpuTimer::Destroy()
+{
+    glDeleteQueries(FRAMES_IN_FLIGHT * TIMER_COUNT, &queries[0][0]);
+}
+
+void GpuTimer::Begin(GpuTimerScope scope)
+{
+    int slot = frame % FRAMES_IN_FLIGHT;
+    glBeginQuery(GL_TIME_ELAPSED, queries[slot][scope]);
+    issued[slot][scope] = true;
+}
+
+void GpuTimer::End()
+{
+    glEndQuery(GL_TIME_ELAPSED);
+}
+
+void GpuTimer::EndFrame()
+{
+    frame++;
+
+    // The slot about to be reused is the oldest one, its queries have had
+    // FRAMES_IN_FLIGHT - 1 frames to finish
+    int slot = frame % FRAMES_IN_FLIGHT;
+    for (int scope = 0; scope < TIMER_COUNT; ++scope)
+    {
+        // Scopes skipped that frame (optional passes) no longer count
+        if (!issued[slot][scope])
+        {
+            lastMs[scope] = 0.0f;
+            continue;
+        }
+
+        GLint available = 0;
+        glGetQueryObjectiv(queries[slot][scope], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available)
+        {
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(queries[slot][scope], GL_QUERY_RESULT, &ns);
+            lastMs[scope] = ns * 1e-6f;
+        }
+        issued[slot][scope] = false;
+    }
+}
+
+float GpuTimer::GetMs(GpuTimerScope scope) const
+{
+    return lastMs[scope];
+}
+
+float GpuTimer::GetTotalMs() const
+{
+    float total = 0.0f;
+    for (int scope = 0; scope < TIMER_COUNT; ++scope)
+        total += lastMs[scope];
+    return total;
+}
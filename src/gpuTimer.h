@@ -0,0 +1,33 @@
+#ifndef GPU_TIMER_CLASS_H
+#define GPU_TIMER_CLASS_H
+
+#include <glad/glad.h>
+
+enum GpuTimerScope
+{
+    TIMER_CASCADES, TIMER_MAIN, TIMER_SHADE, TIMER_RESOLVE, TIMER_PRESENT, TIMER_COUNT
+};
+
+// Per-pass GPU time from GL_TIME_ELAPSED queries. Queries are kept in a ring a
+// few frames deep, so results are read back without stalling the pipeline and
+// lag the current frame by up to FRAMES_IN_FLIGHT frames.
+class GpuTimer
+{
+    public:
+        static const int FRAMES_IN_FLIGHT = 4;
+
+        GLuint queries[FRAMES_IN_FLIGHT][TIMER_COUNT];
+        bool   issued[FRAMES_IN_FLIGHT][TIMER_COUNT] = {};
+        float  lastMs[TIMER_COUNT] = {};
+        int    frame = 0;
+
+        void Init();
+        void Destroy();
+        void Begin(GpuTimerScope scope);
+        void End();
+        void EndFrame();                        // Collects finished results and advances the ring
+        float GetMs(GpuTimerScope scope) const; // Latest completed result
+        float GetTotalMs() const;
+};
+
+#endif
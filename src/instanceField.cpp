@@ -0,0 +1,127 @@
+#include "instanceField.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+static float InstanceBoundingRadius(const Instance& instance)
+{
+    switch ((int)instance.shape.w)
+    {
+        case INSTANCE_SPHERE: return instance.shape.x;
+        case INSTANCE_BOX:    return glm::length(glm::vec3(instance.shape));
+        default:              return instance.shape.x * 1.7320508f;   // fGDF polyhedra, the octahedron is the widest
+    }
+}
+
+void InstanceField::SetInstances(const std::vector<Instance>& field)
+{
+    instances = field;
+    boundsMin = glm::vec3(1e30f);
+    boundsMax = glm::vec3(-1e30f);
+    maxRadius = 0.0f;
+    for (Instance& instance : instances)
+    {
+        instance.position.w = InstanceBoundingRadius(instance);
+        boundsMin = glm::min(boundsMin, glm::vec3(instance.position) - instance.position.w);
+        boundsMax = glm::max(boundsMax, glm::vec3(instance.position) + instance.position.w);
+        maxRadius = std::max(maxRadius, instance.position.w);
+    }
+    if (instances.empty())
+        boundsMin = boundsMax = glm::vec3(0.0f);
+    cellSize = std::max(2.0f * maxRadius, 1e-3f);
+    hashSize = 1;
+    while (hashSize < 2 * instances.size())
+        hashSize *= 2;
+
+    if (!instanceBuffer)
+    {
+        glGenBuffers(1, &instanceBuffer);
+        glGenBuffers(1, &hashBuffer);
+    }
+    std::vector<Instance> words = instances;
+    if (words.empty())
+        words.push_back(Instance());    // Keeps the buffer bindable
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanceBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, words.size() * sizeof(Instance), words.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, hashBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (hashSize + words.size()) * sizeof(GLuint), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_BINDING, instanceBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_HASH_BINDING, hashBuffer);
+    hashDirty = true;
+}
+
+void InstanceField::Clear()
+{
+    instances.clear();
+    hashDirty = false;
+}
+
+void InstanceField::Scatter(int count, unsigned seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    const float extent = 40.0f;    // Half width of the slab in x and z
+
+    std::vector<Instance> field(count);
+    for (Instance& instance : field)
+    {
+        instance.position = glm::vec4((unit(rng) * 2.0f - 1.0f) * extent, -2.2f + unit(rng) * 0.8f,
+                                      (unit(rng) * 2.0f - 1.0f) * extent, 0.0f);
+
+        // Uniform random rotation (Shoemake)
+        float u = unit(rng), a = 6.2831853f * unit(rng), b = 6.2831853f * unit(rng);
+        float s = std::sqrt(1.0f - u), t = std::sqrt(u);
+        instance.rotation = glm::vec4(s * std::sin(a), s * std::cos(a), t * std::sin(b), t * std::cos(b));
+
+        int shape = std::min((int)(unit(rng) * INSTANCE_SHAPE_COUNT), INSTANCE_SHAPE_COUNT - 1);
+        glm::vec3 size = glm::vec3(0.03f) + glm::vec3(unit(rng), unit(rng), unit(rng)) * 0.05f;
+        instance.shape = glm::vec4(shape == INSTANCE_BOX ? size : glm::vec3(size.x), (float)shape);
+    }
+    SetInstances(field);
+}
+
+void InstanceField::RebuildHash(GLuint hashProgram)
+{
+    if (!hashDirty || instances.empty())
+        return;
+
+    GLuint empty = 0xFFFFFFFFu;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, hashBuffer);
+    glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0, hashSize * sizeof(GLuint), GL_RED_INTEGER, GL_UNSIGNED_INT, &empty);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    const GLuint groupSize = 8 * 4;     // local_size of computeShader.comp
+    glUseProgram(hashProgram);
+    Upload(hashProgram);
+    glDispatchCompute(((GLuint)instances.size() + groupSize - 1) / groupSize, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    hashDirty = false;
+}
+
+void InstanceField::Upload(GLuint program) const
+{
+    glUniform1ui(glGetUniformLocation(program, "u_instanceCount"), (GLuint)instances.size());
+    glUniform1ui(glGetUniformLocation(program, "u_instanceHashSize"), hashSize);
+    glUniform1f(glGetUniformLocation(program, "u_instanceCellSize"), cellSize);
+    glUniform1f(glGetUniformLocation(program, "u_instanceMaxRadius"), maxRadius);
+    glUniform3f(glGetUniformLocation(program, "u_instanceBoundsMin"), boundsMin.x, boundsMin.y, boundsMin.z);
+    glUniform3f(glGetUniformLocation(program, "u_instanceBoundsMax"), boundsMax.x, boundsMax.y, boundsMax.z);
+}
+
+void InstanceField::Destroy()
+{
+    glDeleteBuffers(1, &instanceBuffer);
+    glDeleteBuffers(1, &hashBuffer);
+    instanceBuffer = hashBuffer = 0;
+}
+
+std::string InstanceField::ShaderDefines()
+{
+    return std::string("#define INSTANCE_FIELD\n")
+         + "#define INSTANCE_SPHERE " + std::to_string(INSTANCE_SPHERE) + "\n"
+         + "#define INSTANCE_BOX " + std::to_string(INSTANCE_BOX) + "\n"
+         + "#define INSTANCE_OCTAHEDRON " + std::to_string(INSTANCE_OCTAHEDRON) + "\n"
+         + "#define INSTANCE_DODECAHEDRON " + std::to_string(INSTANCE_DODECAHEDRON) + "\n"
+         + "#define INSTANCE_NONE 0xFFFFFFFFu\n";
+}
@@ -0,0 +1,66 @@
+#ifndef INSTANCE_FIELD_CLASS_H
+#define INSTANCE_FIELD_CLASS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+const int    INSTANCE_FIELD_COUNT  = 100000;    // Instances of the demo field (Insert)
+const GLuint INSTANCE_BINDING      = 6;         // SSBO bindings, after the scene tile lists
+const GLuint INSTANCE_HASH_BINDING = 7;
+
+enum InstanceShape
+{
+    INSTANCE_SPHERE, INSTANCE_BOX, INSTANCE_OCTAHEDRON, INSTANCE_DODECAHEDRON, INSTANCE_ICOSAHEDRON,
+    INSTANCE_SHAPE_COUNT
+};
+
+// std430 layout of Instance in computeShader.comp
+struct Instance
+{
+    glm::vec4 position;     // xyz, w = bounding radius (filled in by SetInstances)
+    glm::vec4 rotation;     // Unit quaternion (xyz, w), local to world
+    glm::vec4 shape;        // Radius in x (box: half extents in xyz), w = InstanceShape
+};
+
+// Large fields of small primitives unioned with the scene, held in an SSBO
+// and bucketed by a uniform spatial hash the GPU rebuilds whenever the
+// instances change; new transforms are a buffer upload, never a shader build.
+// An instance goes into the cell of its centre and cells are at least twice
+// the largest bounding radius, so the 27 cells around a point hold every
+// instance that can be nearer than that neighbourhood's boundary.
+// The hash buffer holds a list head per bucket (~0u when empty) followed by
+// the next link of every instance, filled with atomic exchanges.
+class InstanceField
+{
+    public:
+        std::vector<Instance> instances;
+        glm::vec3 boundsMin = glm::vec3(0.0f), boundsMax = glm::vec3(0.0f);    // Of the bounding spheres
+        float     cellSize = 0.0f;
+        float     maxRadius = 0.0f;
+        GLuint    hashSize = 0;         // Buckets, a power of two
+
+        bool Empty() const { return instances.empty(); }
+
+        // Uploads the instances; the hash is rebuilt by the next RebuildHash
+        void SetInstances(const std::vector<Instance>& field);
+        void Clear();
+
+        // Demo layout: `count` random shapes scattered over a slab below the scene
+        void Scatter(int count, unsigned seed);
+
+        // Runs the INSTANCE_HASH_PASS program over the instances if they changed since the last rebuild
+        void RebuildHash(GLuint hashProgram);
+        void Upload(GLuint program) const;     // Cell and bounds uniforms
+        void Destroy();
+
+        // INSTANCE_FIELD and the shape IDs for the shader
+        static std::string ShaderDefines();
+
+    private:
+        bool   hashDirty = false;
+        GLuint instanceBuffer = 0, hashBuffer = 0;
+};
+
+#endif
@@ -8,12 +8,33 @@
 #include <cmath>
 #include <algorithm>
 #include <vector>
+#include <filesystem>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
 #include "camera.h"
 #include "camera.cpp"
+#include "gpuTimer.h"
+#include "gpuTimer.cpp"
+#include "renderTargetPool.h"
+#include "renderTargetPool.cpp"
+#include "dynamicResolution.h"
+#include "dynamicResolution.cpp"
+#include "sceneParams.h"
+#include "sceneParams.cpp"
+#include "sceneCompiler.h"
+#include "sceneCompiler.cpp"
+#include "sceneBytecode.h"
+#include "sceneBytecode.cpp"
+#include "sceneBvh.h"
+#include "sceneBvh.cpp"
+#include "instanceField.h"
+#include "instanceField.cpp"
+#include "sceneVolume.h"
+#include "sceneVolume.cpp"
+#include "frameInvalidation.h"
+#include "frameInvalidation.cpp"
 
 
 
@@ -26,6 +47,15 @@ const unsigned int INIT_HEIGHT = 900;
 int s_width = INIT_WIDTH;
 int s_height = INIT_HEIGHT;
 
+// Internal render resolution: window size scaled by renderScale. All compute
+// passes run at this size and the result is upscaled when presented.
+int r_width = INIT_WIDTH;
+int r_height = INIT_HEIGHT;
+
+float renderScale = 1.0f;
+const float MIN_RENDER_SCALE = 0.25f;
+const float MAX_RENDER_SCALE = 1.0f;
+
 int   disp_fps = 0;
 float disp_ms  = 0.0f;
 
@@ -34,6 +64,117 @@ int cascadeScale1 = 120;  // pixels per cell
 int cascadeScale2 = 60;   // pixels per cell
 int cascadeScale3 = 2;    // pixels per cell
 
+// Camera-centred cascade1 (F11): an octahedral map of cone depths around the
+// camera position it was marched at. It holds for any view orientation, so it
+// is only re-marched when the camera moves CASCADE1_MAP_SLACK away from there
+// or the scene, resolution or settings change.
+bool cascade1Octahedral = false;
+const int   CASCADE1_MAP_SIZE  = 32;    // Texels per side
+const float CASCADE1_MAP_SLACK = 0.05f; // World units
+FrameInvalidation cascade1Map;          // Inputs the map was marched for
+
+// Screen grid of cascade1 cells, also the tiles of the scene item lists
+glm::ivec2 ScreenTileRes(int width, int height)
+{
+    return glm::ivec2(std::max(1, width / cascadeScale1), std::max(1, height / cascadeScale1));
+}
+
+glm::ivec2 Cascade1Res(int width, int height)
+{
+    if (cascade1Octahedral)
+        return glm::ivec2(CASCADE1_MAP_SIZE);
+    return ScreenTileRes(width, height);
+}
+
+// Storage formats. Cascades only hold conservative depths and the output ends up
+// in an 8-bit swapchain, so neither needs 32-bit float storage by default.
+struct StorageFormat
+{
+    GLenum      internalFormat;
+    const char* glslQualifier;
+    int         bytesPerTexel;
+    const char* name;
+};
+
+const StorageFormat cascadeFormats[] = {
+    { GL_R32F, "r32f", 4, "R32F" },
+    { GL_R16F, "r16f", 2, "R16F" },
+};
+const StorageFormat outputFormats[] = {
+    { GL_RGBA32F,  "rgba32f",  16, "RGBA32F"  },
+    { GL_RGBA16F,  "rgba16f",  8,  "RGBA16F"  },
+    { GL_RGB10_A2, "rgb10_a2", 4,  "RGB10_A2" },
+    { GL_RGBA8,    "rgba8",    4,  "RGBA8"    },
+};
+const int CASCADE_FORMAT_COUNT = sizeof(cascadeFormats) / sizeof(cascadeFormats[0]);
+const int OUTPUT_FORMAT_COUNT  = sizeof(outputFormats) / sizeof(outputFormats[0]);
+
+int cascadeFormatIndex = 1;   // R16F
+int outputFormatIndex  = 3;   // RGBA8
+
+enum PresentMode
+{
+    PRESENT_QUAD, PRESENT_BLIT
+};
+const char* presentModeNames[] = { "quad", "blit" };
+
+PresentMode presentMode = PRESENT_BLIT;
+
+// Temporal upscaling: march at a fraction of the window's pixels with a
+// per-frame sub-pixel jitter and accumulate into a window-resolution history.
+// Checkerboard: march alternating halves of the render-resolution pixels and
+// reconstruct the other half from the previous frame.
+enum TemporalMode
+{
+    TEMPORAL_OFF, TEMPORAL_HALF, TEMPORAL_QUARTER, TEMPORAL_CHECKERBOARD, TEMPORAL_MODE_COUNT
+};
+const char* temporalModeNames[] = { "off", "half", "quarter", "checkerboard" };
+const float temporalModeScales[] = { 1.0f, 0.70710678f, 0.5f, 1.0f };    // Per axis, for half / quarter the pixels
+
+TemporalMode temporalMode = TEMPORAL_OFF;
+const int JITTER_PHASES = 8;
+glm::vec2 renderJitter(0.0f);   // Current frame's ray offset in render pixels
+int checkerParity = 0;          // Which half of the checkerboard is marched this frame
+
+// Progressive accumulation: with the camera still and time paused, the frame
+// is supersampled into the history until ACCUMULATION_SAMPLES, then nothing
+// but the present runs until something changes
+const int ACCUMULATION_SAMPLES = 64;
+bool accumulating = false;
+int  accumulatedFrames = 0;
+
+bool CheckerboardActive()
+{
+    return temporalMode == TEMPORAL_CHECKERBOARD && !accumulating;
+}
+
+// Screen-region invalidation: with only animated scene nodes changed, the
+// passes re-run over the tiles their old and new bounds project to
+const int TILE_SIZE = 16;
+
+struct PixelRect
+{
+    int x0, y0;     // Inclusive
+    int x1, y1;     // Exclusive
+};
+
+const float cameraFov = 60.0f;
+float guardBandScale = 1.0f;    // Rendered FOV relative to the window's, widened while reprojecting
+
+// Scene LOD: cone footprint multiplier used to pick node proxies (0 = always exact)
+float lodScale = 1.0f;
+// Ray clipping against scene bounds: 0 = off, 1 = bounding sphere, 2 = sphere + per-node boxes
+int rayClipping = 2;
+// Per-tile item lists after cascade1, follows whether the scene has a BVH
+bool sceneTileCulling = false;
+// Instance field unioned with the scene (Insert), a shader define while it has instances
+InstanceField instanceField;
+unsigned instanceSeed = 1;
+// Time-invariant subtree of the scene baked into a volume (End), rebaked when
+// the scene loads; a shader define of the compiled programs while it has one
+bool sceneBaking = false;
+SceneVolume sceneVolume;
+
 float vertices[] = {
     -1.0f, -1.0f,  0.0f, 0.0f,
     1.0f, -1.0f,  1.0f, 0.0f,
@@ -50,6 +191,16 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
     glViewport(0, 0, width, height);
 }
 
+// True only on the frame the key goes down
+bool KeyPressedOnce(GLFWwindow* window, int key)
+{
+    static bool wasDown[GLFW_KEY_LAST + 1] = {};
+    bool down = glfwGetKey(window, key) == GLFW_PRESS;
+    bool pressed = down && !wasDown[key];
+    wasDown[key] = down;
+    return pressed;
+}
+
 void getFrameRate(int* disp_fps, float* disp_ms)
 {
     static float framesPerSecond = 0.0f;
@@ -91,40 +242,221 @@ void Dispatch(bool isConePass) //Deprecated
     glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
 }
 
-void DispatchPass(int passType, GLuint computeProgram)
+// Runs a pass over its whole grid, or with `region` only over the cells /
+// pixels that can see that render-resolution rectangle
+void DispatchPass(int passType, GLuint computeProgram, const PixelRect* region = nullptr)
 {
     int dispatchX, dispatchY;
     int resX, resY;
     
     if (passType == 0) {
-        // Cascade1: coarse dispatch
-        resX = std::max(1, s_width / cascadeScale1);
-        resY = std::max(1, s_height / cascadeScale1);
+        // Cascade1: coarse dispatch, or the whole camera-centred map
+        resX = Cascade1Res(r_width, r_height).x;
+        resY = Cascade1Res(r_width, r_height).y;
     }
     else if (passType == 1) {
         // Cascade2: medium dispatch
-        resX = std::max(1, s_width / cascadeScale2);
-        resY = std::max(1, s_height / cascadeScale2);
+        resX = std::max(1, r_width / cascadeScale2);
+        resY = std::max(1, r_height / cascadeScale2);
     }
     else if (passType == 2) {
         // Cascade3: fine dispatch
-        resX = std::max(1, s_width / cascadeScale3);
-        resY = std::max(1, s_height / cascadeScale3);
+        resX = std::max(1, r_width / cascadeScale3);
+        resY = std::max(1, r_height / cascadeScale3);
+    }
+    else if (passType == 4) {
+        // Scene tile culling: one invocation per screen tile
+        resX = ScreenTileRes(r_width, r_height).x;
+        resY = ScreenTileRes(r_width, r_height).y;
     }
     else {
-        // Main raymarch: full resolution
-        resX = s_width;
-        resY = s_height;
+        // Main raymarch: full resolution, every other pixel per row in checkerboard mode
+        resX = CheckerboardActive() ? (r_width + 1) / 2 : r_width;
+        resY = r_height;
+    }
+
+    int offsetX = 0, offsetY = 0;
+    if (region && passType < 3)
+    {
+        // A cell's cone reaches past the cell, so one ring of neighbours is included
+        float cellW = float(r_width) / resX;
+        float cellH = float(r_height) / resY;
+        offsetX = std::max(0, (int)(region->x0 / cellW) - 1);
+        offsetY = std::max(0, (int)(region->y0 / cellH) - 1);
+        resX = std::min(resX, (int)((region->x1 - 1) / cellW) + 2) - offsetX;
+        resY = std::min(resY, (int)((region->y1 - 1) / cellH) + 2) - offsetY;
+    }
+    else if (region)
+    {
+        // Tiles are even-sized, so the checkerboard halving stays aligned
+        offsetX = region->x0;
+        offsetY = region->y0;
+        resX = CheckerboardActive() ? (region->x1 - region->x0 + 1) / 2 : region->x1 - region->x0;
+        resY = region->y1 - region->y0;
     }
     
     dispatchX = std::max(1, (int)ceil((float)resX / float(8)));
     dispatchY = std::max(1, (int)ceil((float)resY / float(4)));
+
+    // Whole work groups overhang the region, the main march drops what is past it
+    int endX = (passType == 3) ? (region ? region->x1 : r_width) : offsetX + resX;
+    int endY = offsetY + resY;
     
     glUniform1i(glGetUniformLocation(computeProgram, "u_passType"), passType);
+    glUniform2i(glGetUniformLocation(computeProgram, "u_passOffset"), offsetX, offsetY);
+    glUniform2i(glGetUniformLocation(computeProgram, "u_passEnd"), endX, endY);
     glDispatchCompute(dispatchX, dispatchY, 1);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | (passType == 4 ? GL_SHADER_STORAGE_BARRIER_BIT : 0));
+}
+
+// Cascade prepass. The camera-centred cascade1 map is kept as long as it holds
+// for these inputs, then only cascades 2 and 3 follow the view.
+void DispatchCascades(GLuint computeProgram, const FrameInputs& inputs, const PixelRect* region = nullptr)
+{
+    bool mapStale = (cascade1Map.Changes(inputs) & ~(INPUT_CAMERA | INPUT_DEBUG_VIEW | INPUT_JITTER)) != 0
+                 || glm::distance(inputs.camPos, cascade1Map.last.camPos) > CASCADE1_MAP_SLACK;
+    if (!cascade1Octahedral || mapStale)
+    {
+        // Pass 0: Cascade1 (coarse). The map covers every direction, a region can't narrow it down.
+        DispatchPass(0, computeProgram, cascade1Octahedral ? nullptr : region);
+        cascade1Map.Rendered(inputs);
+    }
+
+    // Item lists of every tile, they follow the view even when the map is kept
+    if (sceneTileCulling)
+        DispatchPass(4, computeProgram);
+
+    // Pass 1: Cascade2 (medium, refines cascade1 hits)
+    DispatchPass(1, computeProgram, region);
+
+    // Pass 2: Cascade3 (fine, refines cascade2 hits)
+    DispatchPass(2, computeProgram, region);
+}
+
+// Shades the hits queued by the main raymarch. The hit list header holds the
+// dispatch arguments, counted up by the march itself.
+void DispatchDeferredShade(GLuint shadeProgram, GLuint hitListBuffer)
+{
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+    glUseProgram(shadeProgram);
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, hitListBuffer);
+    glDispatchComputeIndirect(0);
     glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
 }
 
+// Every scene parameter as u_<name>, see SceneParams::Parameter
+void UploadSceneParams(GLuint program, const SceneParams& scene)
+{
+    for (const char* name : SCENE_PARAM_NAMES)
+    {
+        glm::vec3 value(0.0f);
+        scene.Parameter(name, value);
+        glUniform3f(glGetUniformLocation(program, ("u_" + std::string(name)).c_str()), value.x, value.y, value.z);
+    }
+}
+
+void SetFrameUniforms(GLuint program, const Camera& camera, const SceneParams& scene, float currentTime)
+{
+    glUniform1f(glGetUniformLocation(program, "u_time"),     currentTime);
+    UploadSceneParams(program, scene);
+    instanceField.Upload(program);
+    sceneVolume.Upload(program);
+    glUniform3f(glGetUniformLocation(program, "u_camPos"),   camera.Position.x, camera.Position.y, camera.Position.z);
+    glUniform3f(glGetUniformLocation(program, "u_camRot"),   glm::radians(camera.pitch), glm::radians(camera.yaw), 0.0f);
+    glUniform2i(glGetUniformLocation(program, "u_fullRes"),  r_width, r_height);
+    glUniform2i(glGetUniformLocation(program, "u_cascade1Res"), Cascade1Res(r_width, r_height).x, Cascade1Res(r_width, r_height).y);
+    glUniform1i(glGetUniformLocation(program, "u_cascade1Octahedral"), cascade1Octahedral ? 1 : 0);
+    glUniform1f(glGetUniformLocation(program, "u_cascade1Slack"), CASCADE1_MAP_SLACK);
+    glUniform2i(glGetUniformLocation(program, "u_cascade2Res"), std::max(1, r_width / cascadeScale2), std::max(1, r_height / cascadeScale2));
+    glUniform2i(glGetUniformLocation(program, "u_cascade3Res"), std::max(1, r_width / cascadeScale3), std::max(1, r_height / cascadeScale3));
+    glUniform1f(glGetUniformLocation(program, "u_fov"),      glm::radians(cameraFov) * guardBandScale);
+    glUniform1i(glGetUniformLocation(program, "u_buffer"),   camera.activeBuffer);
+    glUniform1f(glGetUniformLocation(program, "u_lodScale"), lodScale);
+    glUniform1i(glGetUniformLocation(program, "u_rayClipping"), rayClipping);
+    glUniform1i(glGetUniformLocation(program, "u_sceneTiles"), sceneTileCulling ? 1 : 0);
+    glUniform2i(glGetUniformLocation(program, "u_sceneTileRes"), ScreenTileRes(r_width, r_height).x, ScreenTileRes(r_width, r_height).y);
+    glUniform2f(glGetUniformLocation(program, "u_jitter"),   renderJitter.x, renderJitter.y);
+    glUniform1i(glGetUniformLocation(program, "u_checkerboard"),   CheckerboardActive() ? 1 : 0);
+    glUniform1i(glGetUniformLocation(program, "u_checkerParity"),  checkerParity);
+    glUniform1i(glGetUniformLocation(program, "u_accumulating"),   accumulating ? 1 : 0);
+    glUniform1i(glGetUniformLocation(program, "u_accumulatedFrames"), accumulatedFrames);
+}
+
+// A compiled scene only reads the parameters it names, the built-in one all of them
+FrameInputs GatherFrameInputs(const Camera& camera, const SceneParams& sceneParams, const SceneProgram& scene)
+{
+    FrameInputs inputs;
+    inputs.camPos        = camera.Position;
+    inputs.camRot        = glm::vec3(glm::radians(camera.pitch), glm::radians(camera.yaw), 0.0f);
+    inputs.debugView     = camera.activeBuffer;
+    inputs.scene         = scene.Empty() ? sceneParams : sceneParams.Only(scene.params);
+    inputs.renderRes     = glm::ivec2(r_width, r_height);
+    inputs.displayRes    = glm::ivec2(s_width, s_height);
+    inputs.cascadeFormat = cascadeFormatIndex;
+    inputs.outputFormat  = outputFormatIndex;
+    inputs.temporalMode  = temporalMode;
+    inputs.lodScale      = lodScale;
+    inputs.rayClipping   = rayClipping;
+    inputs.cascade1Octahedral = cascade1Octahedral;
+    inputs.jitter        = renderJitter;
+    return inputs;
+}
+
+// Render-resolution rectangle, snapped out to TILE_SIZE tiles, covering a world
+// box as seen by the camera (same projection as makeCameraRay). False when the
+// box reaches behind the camera; an off-screen box gives an empty rectangle.
+bool ProjectBoundsToTiles(const Camera& camera, const glm::vec3& bmin, const glm::vec3& bmax, PixelRect& rect)
+{
+    float pitch = glm::radians(camera.pitch);
+    float yaw = glm::radians(camera.yaw);
+    float cp = cos(pitch), sp = sin(pitch);
+    float cy = cos(yaw), sy = sin(yaw);
+    glm::mat3 rotX(1.0f, 0.0f, 0.0f,  0.0f, cp, -sp,  0.0f, sp, cp);
+    glm::mat3 rotY(cy, 0.0f, sy,  0.0f, 1.0f, 0.0f,  -sy, 0.0f, cy);
+    glm::mat3 toCamera = glm::transpose(rotY * rotX);
+
+    float fov = glm::radians(cameraFov);
+    float aspect = float(r_width) / float(r_height);
+    glm::vec2 pMin(1e30f), pMax(-1e30f);
+    for (int i = 0; i < 8; ++i)
+    {
+        glm::vec3 corner((i & 1) ? bmax.x : bmin.x, (i & 2) ? bmax.y : bmin.y, (i & 4) ? bmax.z : bmin.z);
+        glm::vec3 local = toCamera * (corner - camera.Position);
+        if (local.z <= 1e-3f)
+            return false;
+
+        glm::vec2 ndc = glm::vec2(local.x, local.y) / (local.z * fov);
+        ndc.x /= aspect;
+        glm::vec2 pixel = (ndc * 0.5f + 0.5f) * glm::vec2(r_width, r_height);
+        pMin = glm::min(pMin, pixel);
+        pMax = glm::max(pMax, pixel);
+    }
+
+    pMin = glm::clamp(pMin, glm::vec2(-1e6f), glm::vec2(1e6f));
+    pMax = glm::clamp(pMax, glm::vec2(-1e6f), glm::vec2(1e6f));
+
+    // One pixel of margin for the sample position within a pixel
+    rect.x0 = std::max(0, (int)floor(pMin.x) - 1) / TILE_SIZE * TILE_SIZE;
+    rect.y0 = std::max(0, (int)floor(pMin.y) - 1) / TILE_SIZE * TILE_SIZE;
+    rect.x1 = std::min(r_width,  ((int)ceil(pMax.x) + 1 + TILE_SIZE) / TILE_SIZE * TILE_SIZE);
+    rect.y1 = std::min(r_height, ((int)ceil(pMax.y) + 1 + TILE_SIZE) / TILE_SIZE * TILE_SIZE);
+    return true;
+}
+
+// Radical inverse of index in the given base, low-discrepancy jitter sequence
+float Halton(int index, int base)
+{
+    float result = 0.0f;
+    float f = 1.0f;
+    while (index > 0)
+    {
+        f /= base;
+        result += f * (index % base);
+        index /= base;
+    }
+    return result;
+}
+
 std::string LoadShaderFromPath(const std::string& filename) //Deprecated
 {
     // std::ifstream file;
@@ -177,6 +509,33 @@ std::string LoadShaderWithIncludes(const string& filename, int depth = 0)
     return result.str();
 }
 
+// Inserts preprocessor lines right after the #version directive, used to build
+// specialised programs from one shader source
+std::string InjectShaderDefines(const std::string& source, const std::string& defines)
+{
+    size_t versionEnd = source.find('\n', source.find("#version"));
+    if (versionEnd == std::string::npos)
+        return defines + source;
+    return source.substr(0, versionEnd + 1) + defines + source.substr(versionEnd + 1);
+}
+
+// Replaces the scene_source pragma with a compiled scene's GLSL
+std::string InjectSceneSource(const std::string& source, const std::string& sceneSource)
+{
+    const std::string marker = "#pragma scene_source";
+    size_t at = source.find(marker);
+    if (at == std::string::npos)
+        return source;
+    return source.substr(0, at) + sceneSource + source.substr(at + marker.size());
+}
+
+// GL_KHR_parallel_shader_compile, not part of our glad build
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+bool parallelShaderCompile = false;
+
 GLuint compileShader(GLenum type, const char* src)
 {
     GLuint shader = glCreateShader(type);
@@ -229,7 +588,1161 @@ GLuint linkShaderProgram(std::initializer_list<GLuint> shaders)
 
 
 
-int main()
+// All textures the compute passes render into, pooled and sized for the
+// current render resolution (the textures themselves may be larger)
+struct RenderTargets
+{
+    GLuint cascade1DepthTex = 0;
+    GLuint cascade2DepthTex = 0;
+    GLuint cascade3DepthTex = 0;
+    GLuint outputTex = 0;
+    GLuint gbufferTex = 0;
+    GLuint outputFbo = 0;       // outputTex as colour attachment, source of the present blit
+    GLuint hitListBuffer = 0;
+    size_t hitListCapacity = 0; // In pixels
+    GLuint tileListBuffer = 0;  // Scene item list per screen tile
+    size_t tileListCapacity = 0;    // In tiles
+    int    width = 0;           // Render resolution the targets were acquired for
+    int    height = 0;
+};
+
+// Colour + camera distance, ping-ponged between frames by the resolve. Window
+// resolution for temporal upscaling, render resolution for checkerboard.
+struct TemporalHistory
+{
+    GLuint tex[2] = {};
+    GLuint fbo[2] = {};
+    int    current = 0;         // Written this frame, the other one is read
+    int    width = 0;
+    int    height = 0;
+    bool   valid = false;
+    glm::vec3 prevCamPos;
+    glm::vec3 prevCamRot;
+};
+
+struct ComputePrograms
+{
+    GLuint march;   // Cascades + main raymarch
+    GLuint shade;   // Deferred shading
+    GLuint resolve; // Temporal upscale
+    GLuint reproject;   // Async reprojection: pack + present
+};
+
+// Hit list header reset each frame: indirect dispatch (x, y, z groups) + hit count
+const GLuint hitListReset[4] = { 0, 1, 1, 0 };
+
+void AcquireRenderTargets(RenderTargets& targets, RenderTargetPool& pool, int width, int height)
+{
+    GLenum cascadeFormat = cascadeFormats[cascadeFormatIndex].internalFormat;
+
+    // Cascade cone depth textures (coarse, medium, fine; cascadeScaleN pixels per cell)
+    glm::ivec2 cascade1Res = Cascade1Res(width, height);
+    targets.cascade1DepthTex = pool.Acquire(cascadeFormat, cascade1Res.x, cascade1Res.y);
+    targets.cascade2DepthTex = pool.Acquire(cascadeFormat, width / cascadeScale2, height / cascadeScale2);
+    targets.cascade3DepthTex = pool.Acquire(cascadeFormat, width / cascadeScale3, height / cascadeScale3);
+
+    // Output is sampled when upscaled by the quad present path
+    targets.outputTex = pool.Acquire(outputFormats[outputFormatIndex].internalFormat, width, height);
+    glBindTexture(GL_TEXTURE_2D, targets.outputTex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    // G-buffer written by the main raymarch: hit t, step count, min distance, material ID
+    targets.gbufferTex = pool.Acquire(GL_RGBA32F, width, height);
+
+    if (!targets.outputFbo)
+        glGenFramebuffers(1, &targets.outputFbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, targets.outputFbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, targets.outputTex, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cerr << "Output framebuffer incomplete (" << outputFormats[outputFormatIndex].name << ")" << std::endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // Hit list: header followed by one packed pixel per hit, grown by bucket like the textures
+    size_t pixels = size_t(RenderTargetPool::Bucket(width)) * RenderTargetPool::Bucket(height);
+    if (!targets.hitListBuffer)
+        glGenBuffers(1, &targets.hitListBuffer);
+    if (targets.hitListCapacity < pixels)
+    {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, targets.hitListBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(hitListReset) + sizeof(GLuint) * pixels, NULL, GL_DYNAMIC_COPY);
+        targets.hitListCapacity = pixels;
+    }
+
+    // Tile lists: a count and SCENE_TILE_CAPACITY item slots per tile
+    glm::ivec2 tileRes = ScreenTileRes(width, height);
+    size_t tiles = size_t(tileRes.x) * tileRes.y;
+    if (!targets.tileListBuffer)
+        glGenBuffers(1, &targets.tileListBuffer);
+    if (targets.tileListCapacity < tiles)
+    {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, targets.tileListBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * (SCENE_TILE_CAPACITY + 1) * tiles, NULL, GL_DYNAMIC_COPY);
+        targets.tileListCapacity = tiles;
+    }
+
+    targets.width = width;
+    targets.height = height;
+}
+
+// Hands the textures back to the pool, the FBO and buffers are kept
+void ReleaseRenderTargets(RenderTargets& targets, RenderTargetPool& pool)
+{
+    pool.Release(targets.cascade1DepthTex);
+    pool.Release(targets.cascade2DepthTex);
+    pool.Release(targets.cascade3DepthTex);
+    pool.Release(targets.outputTex);
+    pool.Release(targets.gbufferTex);
+    targets.width = 0;
+    targets.height = 0;
+}
+
+void DestroyRenderTargets(RenderTargets& targets, RenderTargetPool& pool)
+{
+    ReleaseRenderTargets(targets, pool);
+    glDeleteFramebuffers(1, &targets.outputFbo);
+    glDeleteBuffers(1, &targets.hitListBuffer);
+    glDeleteBuffers(1, &targets.tileListBuffer);
+    pool.Destroy();
+}
+
+void BindRenderTargets(const RenderTargets& targets)
+{
+    GLenum cascadeFormat = cascadeFormats[cascadeFormatIndex].internalFormat;
+    glBindImageTexture(0, targets.cascade1DepthTex, 0, GL_FALSE, 0, GL_READ_WRITE, cascadeFormat);
+    glBindImageTexture(1, targets.cascade2DepthTex, 0, GL_FALSE, 0, GL_READ_WRITE, cascadeFormat);
+    glBindImageTexture(2, targets.cascade3DepthTex, 0, GL_FALSE, 0, GL_READ_WRITE, cascadeFormat);
+    glBindImageTexture(3, targets.outputTex,        0, GL_FALSE, 0, GL_READ_WRITE, outputFormats[outputFormatIndex].internalFormat);
+    glBindImageTexture(4, targets.gbufferTex,       0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, targets.hitListBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SCENE_TILE_BINDING, targets.tileListBuffer);
+}
+
+void AcquireTemporalHistory(TemporalHistory& history, RenderTargetPool& pool, int width, int height)
+{
+    for (int i = 0; i < 2; ++i)
+    {
+        // Sampled bilinearly at reprojected positions
+        history.tex[i] = pool.Acquire(GL_RGBA16F, width, height);
+        glBindTexture(GL_TEXTURE_2D, history.tex[i]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        if (!history.fbo[i])
+            glGenFramebuffers(1, &history.fbo[i]);
+        glBindFramebuffer(GL_FRAMEBUFFER, history.fbo[i]);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, history.tex[i], 0);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    history.width = width;
+    history.height = height;
+    history.valid = false;
+}
+
+void ReleaseTemporalHistory(TemporalHistory& history, RenderTargetPool& pool)
+{
+    for (int i = 0; i < 2; ++i)
+    {
+        if (history.tex[i])
+            pool.Release(history.tex[i]);
+        history.tex[i] = 0;
+    }
+    history.width = 0;
+    history.height = 0;
+    history.valid = false;
+}
+
+void DestroyTemporalHistory(TemporalHistory& history, RenderTargetPool& pool)
+{
+    ReleaseTemporalHistory(history, pool);
+    glDeleteFramebuffers(2, history.fbo);
+}
+
+// In the background nothing waits on the driver: with parallel shader
+// compilation it builds on its own threads while frames render, see
+// ComputeProgramsCompleted. Without it the first status query blocks instead.
+GLuint BuildComputeProgram(const std::string& source, bool background)
+{
+    if (!background)
+        return linkShaderProgram({ compileShader(GL_COMPUTE_SHADER, source.c_str()) });
+
+    const char* src = source.c_str();
+    GLuint shader = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(shader, 1, &src, NULL);
+    glCompileShader(shader);
+    GLuint program = glCreateProgram();
+    glAttachShader(program, shader);
+    glDeleteShader(shader);
+    glLinkProgram(program);
+    return program;
+}
+
+// Image format qualifiers are compile-time, so both programs are rebuilt when
+// the storage formats change. An empty scene keeps the built-in sdfScene,
+// interpreted programs run whatever scene is in the bytecode buffers.
+ComputePrograms BuildComputePrograms(const std::string& shaderSource, const SceneProgram& scene, bool interpreted, bool background = false)
+{
+    std::string defines = std::string("#define CASCADE_FORMAT ") + cascadeFormats[cascadeFormatIndex].glslQualifier + "\n"
+                        + "#define OUTPUT_FORMAT " + outputFormats[outputFormatIndex].glslQualifier + "\n";
+    if (cascadeFormats[cascadeFormatIndex].bytesPerTexel == 2)
+        defines += "#define CASCADE_HALF\n";
+
+    std::string source = shaderSource;
+    defines += SceneCompiler::ShaderDefines() + SceneBvh::ShaderDefines();
+    if (!instanceField.Empty())
+        defines += InstanceField::ShaderDefines();
+    if (interpreted)
+    {
+        defines += SceneBytecode::ShaderDefines();
+    }
+    else if (!scene.Empty())
+    {
+        defines += "#define SCENE_COMPILED\n";
+        if (scene.HasGradient())
+            defines += "#define SCENE_GRADIENT\n";
+        if (!scene.items.empty())
+            defines += "#define SCENE_BVH\n";
+        if (!sceneVolume.Empty())
+            defines += SceneVolume::ShaderDefines();
+        source = InjectSceneSource(shaderSource, scene.EmitGLSL());
+    }
+
+    ComputePrograms programs;
+    std::string marchSource = InjectShaderDefines(source, defines);
+    programs.march = BuildComputeProgram(marchSource, background);
+
+    // Same source, built with only the deferred shading entry point so its
+    // register allocation isn't dictated by the marching loops
+    std::string shadeSource = InjectShaderDefines(source, defines + "#define DEFERRED_SHADE_PASS\n");
+    programs.shade = BuildComputeProgram(shadeSource, background);
+
+    std::string resolveSource = InjectShaderDefines(source, defines + "#define TEMPORAL_RESOLVE_PASS\n");
+    programs.resolve = BuildComputeProgram(resolveSource, background);
+
+    std::string reprojectSource = InjectShaderDefines(source, defines + "#define REPROJECT_PASS\n");
+    programs.reproject = BuildComputeProgram(reprojectSource, background);
+    return programs;
+}
+
+// Whether a background build finished, never blocks
+bool ComputeProgramsCompleted(const ComputePrograms& programs)
+{
+    if (!parallelShaderCompile)
+        return true;
+    for (GLuint program : { programs.march, programs.shade, programs.resolve, programs.reproject })
+    {
+        GLint completed = GL_FALSE;
+        glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &completed);
+        if (completed != GL_TRUE)
+            return false;
+    }
+    return true;
+}
+
+// Link results of a background build, logs the failures
+bool ComputeProgramsLinked(const ComputePrograms& programs)
+{
+    bool linked = true;
+    for (GLuint program : { programs.march, programs.shade, programs.resolve, programs.reproject })
+    {
+        GLint status = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &status);
+        if (status == GL_TRUE)
+            continue;
+
+        GLuint shader = 0;
+        GLsizei shaderCount = 0;
+        glGetAttachedShaders(program, 1, &shaderCount, &shader);
+        GLint logLen = 0;
+        if (shaderCount)
+            glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &logLen);
+        if (logLen > 1) {
+            std::string log(logLen, '\0');
+            glGetShaderInfoLog(shader, logLen, NULL, &log[0]);
+            std::cerr << "Shader compile log (type=" << GL_COMPUTE_SHADER << "):\n" << log << std::endl;
+        }
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &logLen);
+        if (logLen > 1) {
+            std::string log(logLen, '\0');
+            glGetProgramInfoLog(program, logLen, NULL, &log[0]);
+            std::cerr << "Program link log:\n" << log << std::endl;
+        }
+        std::cerr << "Program link FAILED" << std::endl;
+        linked = false;
+    }
+    return linked;
+}
+
+// Compiles a scene file and uploads its bytecode and BVH, on errors `scene`
+// keeps the last one that compiled (or stays empty, which selects the built-in
+// sdfScene). `bytecode` is left empty when the interpreter can't run the scene.
+bool LoadScene(const std::string& filename, SceneProgram& scene, SceneBytecode& bytecode, SceneBvh& bvh, const SceneParams& sceneParams)
+{
+    SceneCompiler compiler;
+    SceneProgram compiled;
+    if (!compiler.CompileFile(filename, compiled))
+    {
+        cerr << "ERROR: Scene " << compiler.error << endl;
+        return false;
+    }
+    std::cout << "Scene " << compiled.name << ": " << compiled.code.size() << " instructions ("
+              << compiled.folded << " folded, " << compiled.shared << " shared)\n";
+    scene = compiled;
+
+    if (bytecode.Assemble(scene))
+        bytecode.Upload();
+    else
+        cerr << "ERROR: Scene " << scene.name << " can't be interpreted, " << bytecode.error << endl;
+
+    bvh.Build(scene, bytecode, sceneParams);
+    if (!bvh.Empty())
+        std::cout << "Scene " << scene.name << ": " << scene.items.size() << " items, BVH of " << bvh.nodes.size()
+                  << " nodes, depth " << bvh.depth << "\n";
+    return true;
+}
+
+// Bakes the scene's time-invariant subtree into the volume, or loads it from
+// the brick file sceneBaker wrote for it; the compiled programs built after
+// this read it
+void BakeSceneVolume(SceneVolume& volume, const std::string& shaderSource, const SceneProgram& scene,
+                     const std::string& brickFile)
+{
+    volume.Clear();
+    if (!sceneBaking || scene.baked < 0)
+        return;
+
+    double start = glfwGetTime();
+    if (volume.Load(brickFile, scene))
+    {
+        std::cout << "Scene " << scene.name << ": loaded " << volume.bricks.x << "x" << volume.bricks.y << "x" << volume.bricks.z
+                  << " bricks, " << volume.stored << " stored, " << volume.distant << " far, from " << brickFile << " in "
+                  << (int)((glfwGetTime() - start) * 1000.0) << " ms\n";
+        return;
+    }
+
+    std::string source = InjectSceneSource(shaderSource, scene.EmitGLSL());
+    GLuint bakeProgram = BuildComputeProgram(InjectShaderDefines(source, std::string("#define SCENE_COMPILED\n")
+                                             + SceneVolume::ShaderDefines() + "#define SCENE_VOLUME_BAKE_PASS\n"), false);
+    if (!bakeProgram)
+        return;
+    start = glfwGetTime();
+    volume.Bake(bakeProgram, scene);
+    glDeleteProgram(bakeProgram);
+    std::cout << "Scene " << scene.name << ": baked " << volume.bricks.x << "x" << volume.bricks.y << "x" << volume.bricks.z
+              << " bricks, " << volume.stored << " stored, " << volume.distant << " far, in "
+              << (int)((glfwGetTime() - start) * 1000.0) << " ms\n";
+}
+
+void DestroyComputePrograms(ComputePrograms& programs)
+{
+    glDeleteProgram(programs.march);
+    glDeleteProgram(programs.shade);
+    glDeleteProgram(programs.resolve);
+    glDeleteProgram(programs.reproject);
+}
+
+// Blends (temporal, idle accumulation) or completes (checkerboard) this frame's
+// output into the history, then makes the camera the reprojection source of
+// the next frame
+void DispatchTemporalResolve(GLuint resolveProgram, TemporalHistory& history, const Camera& camera)
+{
+    glm::vec3 camRot(glm::radians(camera.pitch), glm::radians(camera.yaw), 0.0f);
+
+    glUseProgram(resolveProgram);
+    glUniform2i(glGetUniformLocation(resolveProgram, "u_displayRes"),   history.width, history.height);
+    glUniform3f(glGetUniformLocation(resolveProgram, "u_prevCamPos"),   history.prevCamPos.x, history.prevCamPos.y, history.prevCamPos.z);
+    glUniform3f(glGetUniformLocation(resolveProgram, "u_prevCamRot"),   history.prevCamRot.x, history.prevCamRot.y, history.prevCamRot.z);
+    glUniform1i(glGetUniformLocation(resolveProgram, "u_historyValid"), history.valid ? 1 : 0);
+    glUniform1i(glGetUniformLocation(resolveProgram, "u_history"),      0);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, history.tex[1 - history.current]);
+    glBindImageTexture(5, history.tex[history.current], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+
+    glDispatchCompute(std::max(1, (history.width + 7) / 8), std::max(1, (history.height + 3) / 4), 1);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    history.prevCamPos = camera.Position;
+    history.prevCamRot = camRot;
+    history.valid = true;
+}
+
+// Copies a pooled texture (its FBO for the blit path) to the window, upscaling
+// when the two sizes differ
+void Present(GLuint srcFbo, GLuint srcTex, int srcWidth, int srcHeight, GLuint quadProgram, GLuint quadVAO)
+{
+    glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    if (presentMode == PRESENT_BLIT)
+    {
+        // Straight copy from the FBO-attached output, no shader or sampler involved
+        GLenum filter = (srcWidth == s_width && srcHeight == s_height) ? GL_NEAREST : GL_LINEAR;
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, srcFbo);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, srcWidth, srcHeight, 0, 0, s_width, s_height, GL_COLOR_BUFFER_BIT, filter);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        return;
+    }
+
+    // Pooled textures are bucket-sized, only the top-left srcWidth x srcHeight is valid
+    glUseProgram(quadProgram);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, srcTex);
+    glUniform1i(glGetUniformLocation(quadProgram, "screen"), 0);
+    glUniform2f(glGetUniformLocation(quadProgram, "uvScale"),
+                float(srcWidth) / RenderTargetPool::Bucket(srcWidth), float(srcHeight) / RenderTargetPool::Bucket(srcHeight));
+
+    glBindVertexArray(quadVAO);
+    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+}
+
+// Tail of every frame, whichever path through the main loop rendered it
+void FinishFrame(GLFWwindow* window, GpuTimer& timer)
+{
+    timer.EndFrame();
+    glfwSwapBuffers(window);
+    glfwPollEvents();
+}
+
+// ─────────────────────────── Async reprojection ───────────────────────── //
+// F8: the expensive passes run as a render job sliced over display frames,
+// for the camera and scene of the frame it started on. Every display frame
+// warps the last finished job to the latest camera, so mouse-look responds at
+// display rate however long the fractal takes to render.
+const float ASYNC_GUARD_BAND      = 1.25f;  // Job FOV and resolution relative to the window's
+const int   ASYNC_MAIN_SLICES     = 4;      // Row bands of the main raymarch
+const int   ASYNC_STAGE_COUNT     = ASYNC_MAIN_SLICES + 2;  // Cascades, bands, shade + pack
+const float ASYNC_FRAME_BUDGET_MS = 8.3f;   // GPU time per display frame the slicing aims for
+
+struct AsyncReprojection
+{
+    bool   enabled = false;
+    int    frame = 0;           // Display frames presented
+
+    // Render job in flight, stages run in order over one or more frames
+    bool   jobActive = false;
+    int    stage = 0;
+    int    stagesPerFrame = ASYNC_STAGE_COUNT;
+    Camera jobCamera = Camera(1, 1, glm::vec3(0.0f));
+    SceneParams jobScene;
+    FrameInputs jobInputs;
+    float  jobTime = 0.0f;
+    int    jobFrame = 0;
+    double jobStart = 0.0;
+
+    // Last finished job: colour + hit distance, guard band included
+    GLuint sourceTex = 0;
+    int    sourceWidth = 0;
+    int    sourceHeight = 0;
+    bool   sourceValid = false;
+    glm::vec3 sourceCamPos;
+    glm::vec3 sourceCamRot;
+    int    sourceFrame = 0;     // When its camera was sampled
+    double sourceStart = 0.0;
+    int    finishedFrame = 0;
+
+    // How far presentation runs ahead of rendering: age of the shown job's
+    // camera while a newer job is in flight, zero once it caught up
+    int    framesAhead = 0;
+    float  msAhead = 0.0f;
+
+    // Window-resolution reprojection target
+    GLuint displayTex = 0;
+    GLuint displayFbo = 0;
+    int    displayWidth = 0;
+    int    displayHeight = 0;
+};
+
+void ReleaseAsyncReprojection(AsyncReprojection& async, RenderTargetPool& pool)
+{
+    if (async.sourceTex)
+        pool.Release(async.sourceTex);
+    if (async.displayTex)
+        pool.Release(async.displayTex);
+    async.sourceTex = async.displayTex = 0;
+    async.sourceWidth = async.sourceHeight = 0;
+    async.displayWidth = async.displayHeight = 0;
+    async.sourceValid = false;
+    async.jobActive = false;
+}
+
+void DestroyAsyncReprojection(AsyncReprojection& async, RenderTargetPool& pool)
+{
+    ReleaseAsyncReprojection(async, pool);
+    glDeleteFramebuffers(1, &async.displayFbo);
+}
+
+// Snapshots what the job renders. The slicing is adapted once per job, the
+// timer results lag a few frames behind.
+void StartRenderJob(AsyncReprojection& async, const Camera& camera, const SceneParams& scene, float sceneTime,
+                    const FrameInputs& inputs, const GpuTimer& timer)
+{
+    float gpuMs = timer.GetTotalMs();
+    if (gpuMs > ASYNC_FRAME_BUDGET_MS && async.stagesPerFrame > 1)
+        async.stagesPerFrame--;
+    else if (gpuMs < 0.5f * ASYNC_FRAME_BUDGET_MS && async.stagesPerFrame < ASYNC_STAGE_COUNT)
+        async.stagesPerFrame++;
+
+    // After idle frames the source was still current when this job's inputs changed
+    if (async.frame > async.finishedFrame + 1)
+    {
+        async.sourceFrame = async.frame;
+        async.sourceStart = glfwGetTime();
+    }
+
+    async.jobActive = true;
+    async.stage = 0;
+    async.jobCamera = camera;
+    async.jobScene = scene;
+    async.jobInputs = inputs;
+    async.jobTime = sceneTime;
+    async.jobFrame = async.frame;
+    async.jobStart = glfwGetTime();
+}
+
+// Colour + hit distance of the finished job into the reprojection source, so
+// the next job can reuse the render targets
+void PackRenderJob(GLuint reprojectProgram, AsyncReprojection& async, RenderTargetPool& pool)
+{
+    if (async.sourceWidth != r_width || async.sourceHeight != r_height)
+    {
+        if (async.sourceTex)
+            pool.Release(async.sourceTex);
+        // Sampled bilinearly at reprojected positions
+        async.sourceTex = pool.Acquire(GL_RGBA16F, r_width, r_height);
+        glBindTexture(GL_TEXTURE_2D, async.sourceTex);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        async.sourceWidth = r_width;
+        async.sourceHeight = r_height;
+    }
+
+    glUseProgram(reprojectProgram);
+    glUniform2i(glGetUniformLocation(reprojectProgram, "u_sourceRes"),  r_width, r_height);
+    glUniform1i(glGetUniformLocation(reprojectProgram, "u_passType"),   0);
+    glUniform2i(glGetUniformLocation(reprojectProgram, "u_passOffset"), 0, 0);
+    glBindImageTexture(5, async.sourceTex, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+
+    glDispatchCompute(std::max(1, (r_width + 7) / 8), std::max(1, (r_height + 3) / 4), 1);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    async.sourceCamPos = async.jobCamera.Position;
+    async.sourceCamRot = glm::vec3(glm::radians(async.jobCamera.pitch), glm::radians(async.jobCamera.yaw), 0.0f);
+    async.sourceFrame = async.jobFrame;
+    async.sourceStart = async.jobStart;
+    async.finishedFrame = async.frame;
+    async.sourceValid = true;
+}
+
+// Runs this frame's share of the job's stages. Consecutive main raymarch bands
+// go out as one dispatch, the hit list fills up until the shading stage.
+void AdvanceRenderJob(AsyncReprojection& async, const RenderTargets& targets, RenderTargetPool& pool,
+                      const ComputePrograms& programs, GpuTimer& timer)
+{
+    // Until a first job has finished there is nothing to present, render it whole
+    int first = async.stage;
+    int last = std::min(ASYNC_STAGE_COUNT, first + (async.sourceValid ? async.stagesPerFrame : ASYNC_STAGE_COUNT)) - 1;
+
+    glUseProgram(programs.shade);
+    SetFrameUniforms(programs.shade, async.jobCamera, async.jobScene, async.jobTime);
+    glUseProgram(programs.march);
+    SetFrameUniforms(programs.march, async.jobCamera, async.jobScene, async.jobTime);
+
+    BindRenderTargets(targets);
+
+    if (first == 0)
+    {
+        timer.Begin(TIMER_CASCADES);
+        DispatchCascades(programs.march, async.jobInputs);
+        timer.End();
+    }
+
+    int firstBand = std::max(first, 1) - 1;
+    int lastBand = std::min(last, ASYNC_MAIN_SLICES) - 1;
+    if (firstBand <= lastBand)
+    {
+        PixelRect rows = { 0, r_height * firstBand / ASYNC_MAIN_SLICES, r_width, r_height * (lastBand + 1) / ASYNC_MAIN_SLICES };
+
+        timer.Begin(TIMER_MAIN);
+        if (firstBand == 0)
+        {
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, targets.hitListBuffer);
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(hitListReset), hitListReset);
+        }
+        DispatchPass(3, programs.march, &rows);
+        timer.End();
+    }
+
+    if (last == ASYNC_STAGE_COUNT - 1)
+    {
+        timer.Begin(TIMER_SHADE);
+        DispatchDeferredShade(programs.shade, targets.hitListBuffer);
+        timer.End();
+
+        timer.Begin(TIMER_RESOLVE);
+        PackRenderJob(programs.reproject, async, pool);
+        timer.End();
+
+        async.jobActive = false;
+    }
+    async.stage = last + 1;
+}
+
+// Warps the last finished job to the latest camera into the window-resolution
+// target, then presents it
+void PresentReprojected(GLuint reprojectProgram, AsyncReprojection& async, const Camera& camera, RenderTargetPool& pool,
+                        GLuint quadProgram, GLuint quadVAO)
+{
+    if (async.displayWidth != s_width || async.displayHeight != s_height)
+    {
+        if (async.displayTex)
+            pool.Release(async.displayTex);
+        async.displayTex = pool.Acquire(GL_RGBA8, s_width, s_height);
+        glBindTexture(GL_TEXTURE_2D, async.displayTex);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        if (!async.displayFbo)
+            glGenFramebuffers(1, &async.displayFbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, async.displayFbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, async.displayTex, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        async.displayWidth = s_width;
+        async.displayHeight = s_height;
+    }
+
+    glUseProgram(reprojectProgram);
+    glUniform1i(glGetUniformLocation(reprojectProgram, "u_passType"),   1);
+    glUniform2i(glGetUniformLocation(reprojectProgram, "u_passOffset"), 0, 0);
+    glUniform2i(glGetUniformLocation(reprojectProgram, "u_displayRes"), s_width, s_height);
+    glUniform2i(glGetUniformLocation(reprojectProgram, "u_sourceRes"),  async.sourceWidth, async.sourceHeight);
+    glUniform1f(glGetUniformLocation(reprojectProgram, "u_guardBand"),  ASYNC_GUARD_BAND);
+    glUniform1f(glGetUniformLocation(reprojectProgram, "u_fov"),        glm::radians(cameraFov));
+    glUniform3f(glGetUniformLocation(reprojectProgram, "u_camPos"),     camera.Position.x, camera.Position.y, camera.Position.z);
+    glUniform3f(glGetUniformLocation(reprojectProgram, "u_camRot"),     glm::radians(camera.pitch), glm::radians(camera.yaw), 0.0f);
+    glUniform3f(glGetUniformLocation(reprojectProgram, "u_prevCamPos"), async.sourceCamPos.x, async.sourceCamPos.y, async.sourceCamPos.z);
+    glUniform3f(glGetUniformLocation(reprojectProgram, "u_prevCamRot"), async.sourceCamRot.x, async.sourceCamRot.y, async.sourceCamRot.z);
+    glUniform1i(glGetUniformLocation(reprojectProgram, "u_history"),    0);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, async.sourceTex);
+    glBindImageTexture(6, async.displayTex, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+
+    glDispatchCompute(std::max(1, (s_width + 7) / 8), std::max(1, (s_height + 3) / 4), 1);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    Present(async.displayFbo, async.displayTex, s_width, s_height, quadProgram, quadVAO);
+}
+
+// ─────────────────────────── Frame generation ─────────────────────────── //
+// F10: while the view changes, each real frame is rendered over a pair of
+// display frames. The first presents the previous real frame extrapolated half
+// a frame along its motion vectors, the second presents the real one. Both
+// carry part of the raymarch, split by rows so their GPU times match, which
+// doubles the presented rate for the cost of one extrapolation pass.
+const float FRAMEGEN_SPLIT_STEP = 0.02f;    // Row split adjustment per pair
+const float FRAMEGEN_MIN_SPLIT  = 0.1f;
+const float FRAMEGEN_MAX_SPLIT  = 0.9f;
+
+struct FrameGeneration
+{
+    bool   enabled = false;
+    int    phase = 0;           // 0 = extrapolated frame + first rows, 1 = remaining rows + real frame
+    float  split = 0.5f;        // Fraction of the rows marched in phase 0
+    int    splitRow = 0;
+    float  phaseMs[2] = {};     // Latest GPU time of either phase
+    int    timerPhase[GpuTimer::FRAMES_IN_FLIGHT] = {};  // Phase + 1 of each timer frame, 0 for other frames
+
+    // Real frame in progress, rendered for the camera of its phase 0 frame
+    Camera jobCamera = Camera(1, 1, glm::vec3(0.0f));
+    SceneParams jobScene;
+    float  jobTime = 0.0f;
+    FrameInputs jobInputs;
+
+    // Camera of the last real frame, its motion vectors lead away from it
+    glm::vec3 prevCamPos;
+    glm::vec3 prevCamRot;
+    bool   lastFrameValid = false;  // Last real frame's output + motion still in the targets
+
+    GLuint motionTex = 0;       // RG16F, render resolution
+    GLuint targetTex = 0;       // Extrapolated frame
+    GLuint targetFbo = 0;
+    int    width = 0;
+    int    height = 0;
+};
+
+void AcquireFrameGeneration(FrameGeneration& fg, RenderTargetPool& pool, int width, int height)
+{
+    fg.motionTex = pool.Acquire(GL_RG16F, width, height);
+
+    fg.targetTex = pool.Acquire(GL_RGBA8, width, height);
+    glBindTexture(GL_TEXTURE_2D, fg.targetTex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    if (!fg.targetFbo)
+        glGenFramebuffers(1, &fg.targetFbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fg.targetFbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, fg.targetTex, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    fg.width = width;
+    fg.height = height;
+    fg.phase = 0;
+    fg.lastFrameValid = false;
+}
+
+void ReleaseFrameGeneration(FrameGeneration& fg, RenderTargetPool& pool)
+{
+    if (fg.motionTex)
+        pool.Release(fg.motionTex);
+    if (fg.targetTex)
+        pool.Release(fg.targetTex);
+    fg.motionTex = fg.targetTex = 0;
+    fg.width = fg.height = 0;
+    fg.phase = 0;
+    fg.lastFrameValid = false;
+}
+
+void DestroyFrameGeneration(FrameGeneration& fg, RenderTargetPool& pool)
+{
+    ReleaseFrameGeneration(fg, pool);
+    glDeleteFramebuffers(1, &fg.targetFbo);
+}
+
+// Main raymarch over rows [rowBegin, rowEnd) of the real frame in progress,
+// writing motion vectors. The hit list is reset with the first rows.
+void DispatchFrameGenRows(FrameGeneration& fg, const RenderTargets& targets, const ComputePrograms& programs,
+                          GpuTimer& timer, int rowBegin, int rowEnd)
+{
+    glm::vec3 camRot(glm::radians(fg.jobCamera.pitch), glm::radians(fg.jobCamera.yaw), 0.0f);
+    glm::vec3 prevCamPos = fg.lastFrameValid ? fg.prevCamPos : fg.jobCamera.Position;
+    glm::vec3 prevCamRot = fg.lastFrameValid ? fg.prevCamRot : camRot;
+
+    glUseProgram(programs.shade);
+    SetFrameUniforms(programs.shade, fg.jobCamera, fg.jobScene, fg.jobTime);
+    glUseProgram(programs.march);
+    SetFrameUniforms(programs.march, fg.jobCamera, fg.jobScene, fg.jobTime);
+    glUniform1i(glGetUniformLocation(programs.march, "u_motionVectors"), 1);
+    glUniform3f(glGetUniformLocation(programs.march, "u_prevCamPos"), prevCamPos.x, prevCamPos.y, prevCamPos.z);
+    glUniform3f(glGetUniformLocation(programs.march, "u_prevCamRot"), prevCamRot.x, prevCamRot.y, prevCamRot.z);
+
+    BindRenderTargets(targets);
+    glBindImageTexture(7, fg.motionTex, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG16F);
+
+    if (rowBegin == 0)
+    {
+        timer.Begin(TIMER_CASCADES);
+        DispatchCascades(programs.march, fg.jobInputs);
+        timer.End();
+    }
+
+    timer.Begin(TIMER_MAIN);
+    if (rowBegin == 0)
+    {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, targets.hitListBuffer);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(hitListReset), hitListReset);
+    }
+    PixelRect rows = { 0, rowBegin, r_width, rowEnd };
+    DispatchPass(3, programs.march, &rows);
+    timer.End();
+
+    glUniform1i(glGetUniformLocation(programs.march, "u_motionVectors"), 0);
+}
+
+// Last real frame's output moved half a frame further along its motion
+void DispatchExtrapolation(GLuint reprojectProgram, const FrameGeneration& fg, const RenderTargets& targets)
+{
+    glUseProgram(reprojectProgram);
+    glUniform1i(glGetUniformLocation(reprojectProgram, "u_passType"),       2);
+    glUniform2i(glGetUniformLocation(reprojectProgram, "u_passOffset"),     0, 0);
+    glUniform2i(glGetUniformLocation(reprojectProgram, "u_fullRes"),        fg.width, fg.height);
+    glUniform1f(glGetUniformLocation(reprojectProgram, "u_extrapolation"),  0.5f);
+    glUniform1i(glGetUniformLocation(reprojectProgram, "u_history"),        0);
+    glUniform1i(glGetUniformLocation(reprojectProgram, "u_motionHistory"),  1);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, targets.outputTex);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, fg.motionTex);
+    glActiveTexture(GL_TEXTURE0);
+    glBindImageTexture(6, fg.targetTex, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+
+    glDispatchCompute(std::max(1, (fg.width + 7) / 8), std::max(1, (fg.height + 3) / 4), 1);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+// Frame pacing: once both phases of a pair have a GPU time, rows move from
+// the slower phase to the faster one. Timer results lag FRAMES_IN_FLIGHT - 1
+// frames, so each is matched to the phase it was recorded in.
+void BalanceFrameGeneration(FrameGeneration& fg, const GpuTimer& timer)
+{
+    int phase = fg.timerPhase[timer.frame % GpuTimer::FRAMES_IN_FLIGHT] - 1;
+    if (phase < 0)
+        return;
+
+    fg.phaseMs[phase] = timer.GetTotalMs();
+    if (phase == 1)
+    {
+        fg.split += (fg.phaseMs[0] > fg.phaseMs[1]) ? -FRAMEGEN_SPLIT_STEP : FRAMEGEN_SPLIT_STEP;
+        fg.split = glm::clamp(fg.split, FRAMEGEN_MIN_SPLIT, FRAMEGEN_MAX_SPLIT);
+    }
+}
+
+// ─────────────────────────── Format benchmark ─────────────────────────── //
+// Cycles through every cascade format x output format x present path, keeping
+// each for a warm-up plus a measured window, and reports GPU pass times, frame
+// time and estimated memory traffic. Keep the camera still while it runs.
+const int BENCH_WARMUP_FRAMES  = 30;
+const int BENCH_MEASURE_FRAMES = 120;
+
+struct FormatBenchmark
+{
+    bool   active = false;
+    int    combo = 0;
+    int    frame = 0;
+    double gpuMs[TIMER_COUNT];
+    double gpuTotalMs;
+    double frameMs;
+
+    // Configuration to restore once finished
+    int         savedCascadeFormat;
+    int         savedOutputFormat;
+    PresentMode savedPresentMode;
+
+    std::ofstream out;
+};
+
+int BenchComboCount()
+{
+    return CASCADE_FORMAT_COUNT * OUTPUT_FORMAT_COUNT * 2;
+}
+
+void ApplyBenchCombo(int combo)
+{
+    cascadeFormatIndex = combo % CASCADE_FORMAT_COUNT;
+    outputFormatIndex  = (combo / CASCADE_FORMAT_COUNT) % OUTPUT_FORMAT_COUNT;
+    presentMode        = (PresentMode)(combo / (CASCADE_FORMAT_COUNT * OUTPUT_FORMAT_COUNT));
+}
+
+// Resident size of the render targets in bytes
+double RenderTargetBytes(int width, int height)
+{
+    double cascadeBpp = cascadeFormats[cascadeFormatIndex].bytesPerTexel;
+    glm::ivec2 cascade1Res = Cascade1Res(width, height);
+    double cascadeTexels = double(cascade1Res.x) * cascade1Res.y
+                         + double(width / cascadeScale2) * (height / cascadeScale2)
+                         + double(width / cascadeScale3) * (height / cascadeScale3);
+    return cascadeTexels * cascadeBpp
+         + double(width) * height * (outputFormats[outputFormatIndex].bytesPerTexel + 16);
+}
+
+// Lower bound on per-frame traffic: each cascade written once and read by the
+// next stage, the output written once and read once when presented (plus the
+// shader-side sample for the quad path), and the swapchain written once
+double EstimateFrameTrafficBytes(int width, int height)
+{
+    double cascadeBpp = cascadeFormats[cascadeFormatIndex].bytesPerTexel;
+    double outputBpp = outputFormats[outputFormatIndex].bytesPerTexel;
+    glm::ivec2 cascade1Res = Cascade1Res(width, height);
+    double cascadeTexels = double(cascade1Res.x) * cascade1Res.y
+                         + double(width / cascadeScale2) * (height / cascadeScale2)
+                         + double(width / cascadeScale3) * (height / cascadeScale3);
+    double pixels = double(width) * height;
+    return cascadeTexels * cascadeBpp * 2.0 + pixels * outputBpp * 2.0 + pixels * 4.0;
+}
+
+void StartFormatBenchmark(FormatBenchmark& bench, const std::string& path)
+{
+    bench.savedCascadeFormat = cascadeFormatIndex;
+    bench.savedOutputFormat  = outputFormatIndex;
+    bench.savedPresentMode   = presentMode;
+
+    bench.out.open(path.c_str());
+    bench.out << "Format benchmark " << r_width << "x" << r_height << " (window " << s_width << "x" << s_height << ")\n";
+    bench.out << "cascade  output    present  targetMB  trafficMB/frame  cascadesMs  mainMs  shadeMs  presentMs  gpuMs  frameMs\n";
+
+    bench.active = true;
+    bench.combo = 0;
+    bench.frame = 0;
+    ApplyBenchCombo(0);
+    std::cout << "\nFormat benchmark started (" << BenchComboCount() << " combinations)" << std::endl;
+}
+
+// Returns true when the formats changed and targets/programs must be rebuilt
+bool UpdateFormatBenchmark(FormatBenchmark& bench, const GpuTimer& timer, float frameMs)
+{
+    if (!bench.active)
+        return false;
+
+    if (bench.frame == BENCH_WARMUP_FRAMES)
+    {
+        for (int scope = 0; scope < TIMER_COUNT; ++scope)
+            bench.gpuMs[scope] = 0.0;
+        bench.gpuTotalMs = 0.0;
+        bench.frameMs = 0.0;
+    }
+    if (bench.frame >= BENCH_WARMUP_FRAMES)
+    {
+        for (int scope = 0; scope < TIMER_COUNT; ++scope)
+            bench.gpuMs[scope] += timer.GetMs((GpuTimerScope)scope);
+        bench.gpuTotalMs += timer.GetTotalMs();
+        bench.frameMs += frameMs;
+    }
+
+    if (++bench.frame < BENCH_WARMUP_FRAMES + BENCH_MEASURE_FRAMES)
+        return false;
+
+    char row[256];
+    double n = BENCH_MEASURE_FRAMES;
+    snprintf(row, sizeof(row), "%-8s %-9s %-8s %8.1f  %15.1f  %10.3f  %6.3f  %7.3f  %9.3f  %5.3f  %7.3f",
+             cascadeFormats[cascadeFormatIndex].name, outputFormats[outputFormatIndex].name, presentModeNames[presentMode],
+             RenderTargetBytes(r_width, r_height) / (1024.0 * 1024.0),
+             EstimateFrameTrafficBytes(r_width, r_height) / (1024.0 * 1024.0),
+             bench.gpuMs[TIMER_CASCADES] / n, bench.gpuMs[TIMER_MAIN] / n, bench.gpuMs[TIMER_SHADE] / n,
+             bench.gpuMs[TIMER_PRESENT] / n, bench.gpuTotalMs / n, bench.frameMs / n);
+    bench.out << row << "\n";
+    std::cout << "\n" << row << std::endl;
+
+    bench.frame = 0;
+    if (++bench.combo < BenchComboCount())
+    {
+        ApplyBenchCombo(bench.combo);
+    }
+    else
+    {
+        cascadeFormatIndex = bench.savedCascadeFormat;
+        outputFormatIndex  = bench.savedOutputFormat;
+        presentMode        = bench.savedPresentMode;
+        bench.out.close();
+        bench.active = false;
+        std::cout << "Format benchmark finished" << std::endl;
+    }
+    return true;
+}
+
+
+
+// ─────────────────────────── Scene backends ───────────────────────────── //
+// The compiled programs inline the scene and take the driver a while to
+// build. The interpreted ones run the scene bytecode and only depend on the
+// storage formats, so an edit switches to them and costs a buffer upload.
+// Once edits settle the compiled programs are rebuilt in the background and
+// swapped in when the driver is done with them.
+const double SCENE_SETTLE_SECONDS = 1.0;
+
+struct SceneBackends
+{
+    ComputePrograms compiled = {};      // Zero while out of date
+    ComputePrograms interpreted = {};   // Zero when they failed to build
+    bool            interpretedLinked = false;
+
+    ComputePrograms pending = {};       // Background build of `compiled`
+    bool            pendingActive = false;
+    int             compiledVersion = -1;   // Scene version the last compiled build was started for
+    int             version = 0;            // Scene edits so far
+    double          lastEdit = 0.0;
+};
+
+// Interpreted programs, checked on first use since they build in the background
+bool InterpreterReady(SceneBackends& backends)
+{
+    if (!backends.interpretedLinked)
+    {
+        backends.interpretedLinked = true;
+        if (!ComputeProgramsLinked(backends.interpreted))
+        {
+            DestroyComputePrograms(backends.interpreted);
+            backends.interpreted = {};
+        }
+    }
+    return backends.interpreted.march != 0;
+}
+
+void BuildSceneBackends(SceneBackends& backends, const std::string& shaderSource, const SceneProgram& scene)
+{
+    backends.compiled = BuildComputePrograms(shaderSource, scene, false);
+    backends.interpreted = BuildComputePrograms(shaderSource, scene, true, true);
+    backends.interpretedLinked = false;
+    backends.compiledVersion = backends.version;
+}
+
+void DestroySceneBackends(SceneBackends& backends)
+{
+    DestroyComputePrograms(backends.compiled);
+    DestroyComputePrograms(backends.interpreted);
+    if (backends.pendingActive)
+        DestroyComputePrograms(backends.pending);
+}
+
+// Storage formats changed: everything is rebuilt, a pending compile restarts
+void RebuildSceneBackends(SceneBackends& backends, const std::string& shaderSource, const SceneProgram& scene)
+{
+    bool upToDate = backends.compiled.march != 0;
+    DestroySceneBackends(backends);
+    backends.pendingActive = false;
+
+    backends.interpreted = BuildComputePrograms(shaderSource, scene, true, true);
+    backends.interpretedLinked = false;
+    backends.compiled = {};
+    if (upToDate)
+        backends.compiled = BuildComputePrograms(shaderSource, scene, false);
+    else
+        backends.compiledVersion = -1;
+}
+
+// A scene edit (LoadScene already uploaded the bytecode): the compiled
+// programs are out of date, the interpreter takes over if it can run the scene
+void SceneEdited(SceneBackends& backends, const std::string& shaderSource, const SceneProgram& scene, const SceneBytecode& bytecode)
+{
+    ++backends.version;
+    backends.lastEdit = glfwGetTime();
+    DestroyComputePrograms(backends.compiled);
+    backends.compiled = {};
+    if (backends.pendingActive)
+        DestroyComputePrograms(backends.pending);
+    backends.pendingActive = false;
+    if (bytecode.Empty() || !InterpreterReady(backends))
+    {
+        backends.compiled = BuildComputePrograms(shaderSource, scene, false);
+        backends.compiledVersion = backends.version;
+    }
+}
+
+// Starts the compiled build once edits settled and swaps it in when it's
+// done; a failed build isn't retried before the next edit. True when the
+// programs changed.
+bool UpdateSceneBackends(SceneBackends& backends, const std::string& shaderSource, const SceneProgram& scene)
+{
+    if (!backends.compiled.march && !backends.pendingActive && backends.compiledVersion != backends.version
+        && glfwGetTime() - backends.lastEdit > SCENE_SETTLE_SECONDS)
+    {
+        backends.pending = BuildComputePrograms(shaderSource, scene, false, true);
+        backends.pendingActive = true;
+        backends.compiledVersion = backends.version;
+    }
+    if (!backends.pendingActive || !ComputeProgramsCompleted(backends.pending))
+        return false;
+
+    backends.pendingActive = false;
+    if (!ComputeProgramsLinked(backends.pending))
+    {
+        DestroyComputePrograms(backends.pending);
+        return false;
+    }
+    backends.compiled = backends.pending;
+    std::cout << "\nScene " << scene.name << " compiled, leaving the interpreter" << std::endl;
+    return true;
+}
+
+// Compiled when up to date, else the interpreter
+const ComputePrograms& ActiveScenePrograms(const SceneBackends& backends)
+{
+    return backends.compiled.march ? backends.compiled : backends.interpreted;
+}
+
+// ───────────────────────── Scene backend benchmark ────────────────────── //
+// Renders the current scene and view with the compiled and then the
+// interpreted programs, a warm-up plus a measured window each, and reports
+// the interpreter's overhead per pass. Keep the camera still while it runs.
+struct SceneBenchmark
+{
+    bool   active = false;
+    int    backend = 0;         // 0 compiled, 1 interpreted
+    int    frame = 0;
+    double gpuMs[2][TIMER_COUNT];
+    double gpuTotalMs[2];
+    std::string path;
+};
+
+bool StartSceneBenchmark(SceneBenchmark& bench, SceneBackends& backends, const std::string& shaderSource,
+                         const SceneProgram& scene, const SceneBytecode& bytecode, const std::string& path)
+{
+    if (bytecode.Empty() || !InterpreterReady(backends))
+    {
+        cerr << "ERROR: Scene benchmark needs a scene the interpreter can run" << endl;
+        return false;
+    }
+    if (!backends.compiled.march)
+    {
+        if (backends.pendingActive)
+            DestroyComputePrograms(backends.pending);
+        backends.pendingActive = false;
+        backends.compiled = BuildComputePrograms(shaderSource, scene, false);
+        backends.compiledVersion = backends.version;
+    }
+
+    bench.active = true;
+    bench.backend = 0;
+    bench.frame = 0;
+    bench.path = path;
+    std::cout << "\nScene benchmark started (" << bytecode.code.size() << " instructions, "
+              << bytecode.registersUsed << " registers)" << std::endl;
+    return true;
+}
+
+// Programs to render this frame with
+const ComputePrograms& UpdateSceneBenchmark(SceneBenchmark& bench, const SceneBackends& backends, const GpuTimer& timer,
+                                            const SceneProgram& scene)
+{
+    if (!bench.active)
+        return ActiveScenePrograms(backends);
+
+    if (bench.frame == BENCH_WARMUP_FRAMES)
+    {
+        for (int scope = 0; scope < TIMER_COUNT; ++scope)
+            bench.gpuMs[bench.backend][scope] = 0.0;
+        bench.gpuTotalMs[bench.backend] = 0.0;
+    }
+    if (bench.frame >= BENCH_WARMUP_FRAMES)
+    {
+        for (int scope = 0; scope < TIMER_COUNT; ++scope)
+            bench.gpuMs[bench.backend][scope] += timer.GetMs((GpuTimerScope)scope);
+        bench.gpuTotalMs[bench.backend] += timer.GetTotalMs();
+    }
+
+    if (++bench.frame == BENCH_WARMUP_FRAMES + BENCH_MEASURE_FRAMES)
+    {
+        bench.frame = 0;
+        if (++bench.backend == 2)
+        {
+            std::ofstream out(bench.path.c_str());
+            out << "Scene benchmark " << scene.name << " " << r_width << "x" << r_height << "\n";
+            out << "backend      cascadesMs  mainMs  shadeMs  gpuMs\n";
+            std::cout << "\n";
+
+            char row[256];
+            double n = BENCH_MEASURE_FRAMES;
+            static const char* backendNames[] = { "compiled", "interpreted" };
+            for (int backend = 0; backend < 2; ++backend)
+            {
+                snprintf(row, sizeof(row), "%-11s  %10.3f  %6.3f  %7.3f  %5.3f", backendNames[backend],
+                         bench.gpuMs[backend][TIMER_CASCADES] / n, bench.gpuMs[backend][TIMER_MAIN] / n,
+                         bench.gpuMs[backend][TIMER_SHADE] / n, bench.gpuTotalMs[backend] / n);
+                out << row << "\n";
+                std::cout << row << std::endl;
+            }
+            // Interpreted / compiled time, the cost of editing without rebuilds
+            snprintf(row, sizeof(row), "%-11s  %9.2fx  %5.2fx  %6.2fx  %4.2fx", "overhead",
+                     bench.gpuMs[1][TIMER_CASCADES] / std::max(bench.gpuMs[0][TIMER_CASCADES], 1e-6),
+                     bench.gpuMs[1][TIMER_MAIN] / std::max(bench.gpuMs[0][TIMER_MAIN], 1e-6),
+                     bench.gpuMs[1][TIMER_SHADE] / std::max(bench.gpuMs[0][TIMER_SHADE], 1e-6),
+                     bench.gpuTotalMs[1] / std::max(bench.gpuTotalMs[0], 1e-6));
+            out << row << "\n";
+            std::cout << row << std::endl;
+
+            bench.active = false;
+            std::cout << "Scene benchmark finished" << std::endl;
+            return ActiveScenePrograms(backends);
+        }
+    }
+    return bench.backend == 0 ? backends.compiled : backends.interpreted;
+}
+
+// cutable [scene], the scene file defaults to Scenes/julia.scene
+int main(int argc, char** argv)
 {
     glfwInit();
 
@@ -255,6 +1768,16 @@ int main()
         return -1;
     }
 
+    // Lets scene programs build in the background, see BuildComputeProgram
+    parallelShaderCompile = glfwExtensionSupported("GL_KHR_parallel_shader_compile") == GLFW_TRUE;
+    if (parallelShaderCompile)
+    {
+        PFNGLMAXSHADERCOMPILERTHREADSKHRPROC glMaxShaderCompilerThreadsKHR =
+            (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+        if (glMaxShaderCompilerThreadsKHR)
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFFu);     // As many as the driver likes
+    }
+
     Camera camera(s_width, s_height, glm::vec3(0.0f, 0.0f, -5.0f));
 
     char exePath[1024];
@@ -267,14 +1790,25 @@ int main()
     std::string vertexShaderSourceStr = LoadShaderWithIncludes(exeDir + "/src/ShaderFiles/vertexShader.vert");
     std::string fragmentShaderSourceStr = LoadShaderWithIncludes(exeDir + "/src/ShaderFiles/fragmentShader.frag");
 
-    const char* computeShaderSource = computeShaderSourceStr.c_str();
     const char* vertexShaderSource = vertexShaderSourceStr.c_str();
     const char* fragmentShaderSource = fragmentShaderSourceStr.c_str();
 
-    
-
-    GLuint computeShader = compileShader(GL_COMPUTE_SHADER, computeShaderSource);
-    GLuint computeProgram = linkShaderProgram({ computeShader });
+    // The scene file is watched, edits run interpreted until the compiled
+    // programs catch up
+    std::string sceneFile = argc > 1 ? std::string(argv[1]) : exeDir + "/src/Scenes/julia.scene";
+    std::string brickFile = std::filesystem::path(sceneFile).replace_extension(".sdfb").string();
+    std::error_code sceneFileError;
+    std::filesystem::file_time_type sceneFileTime = std::filesystem::last_write_time(sceneFile, sceneFileError);
+    SceneProgram scene;
+    SceneBytecode sceneBytecode;
+    SceneBvh sceneBvh;
+    LoadScene(sceneFile, scene, sceneBytecode, sceneBvh, SceneParams());
+    BakeSceneVolume(sceneVolume, computeShaderSourceStr, scene, brickFile);
+
+    SceneBackends sceneBackends;
+    BuildSceneBackends(sceneBackends, computeShaderSourceStr, scene);
+    GLuint instanceHashProgram = 0;     // Built with the first instance field
+    ComputePrograms computePrograms = ActiveScenePrograms(sceneBackends);
 
     GLuint screenVertexShader = compileShader(GL_VERTEX_SHADER, vertexShaderSource);
     GLuint screenFragmentShader = compileShader(GL_FRAGMENT_SHADER, fragmentShaderSource);
@@ -304,107 +1838,469 @@ int main()
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
 
-    // Cascade1 cone depth texture (coarse, cascadeScale1 pixels per cell)
-    GLuint cascade1DepthTex;
-    glGenTextures(1, &cascade1DepthTex);
-    glBindTexture(GL_TEXTURE_2D, cascade1DepthTex);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, std::max(1, s_width / cascadeScale1), std::max(1, s_height / cascadeScale1), 0, GL_RED, GL_FLOAT, NULL);
-    glBindImageTexture(0, cascade1DepthTex, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
-
-    // Cascade2 cone depth texture (medium, cascadeScale2 pixels per cell)
-    GLuint cascade2DepthTex;
-    glGenTextures(1, &cascade2DepthTex);
-    glBindTexture(GL_TEXTURE_2D, cascade2DepthTex);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, std::max(1, s_width / cascadeScale2), std::max(1, s_height / cascadeScale2), 0, GL_RED, GL_FLOAT, NULL);
-    glBindImageTexture(1, cascade2DepthTex, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
-
-    // Cascade3 cone depth texture (fine, cascadeScale3 pixels per cell)
-    GLuint cascade3DepthTex;
-    glGenTextures(1, &cascade3DepthTex);
-    glBindTexture(GL_TEXTURE_2D, cascade3DepthTex);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, std::max(1, s_width / cascadeScale3), std::max(1, s_height / cascadeScale3), 0, GL_RED, GL_FLOAT, NULL);
-    glBindImageTexture(2, cascade3DepthTex, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
-
-    GLuint outputTex;
-    glGenTextures(1, &outputTex);
-    glBindTexture(GL_TEXTURE_2D, outputTex);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, s_width, s_height, 0, GL_RGBA, GL_FLOAT, NULL);
-    glBindImageTexture(3, outputTex, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+    RenderTargetPool targetPool;
+    RenderTargets targets;
+    TemporalHistory history;
+    AsyncReprojection asyncRep;
+    FrameGeneration frameGen;
+    int frameIndex = 0;
+    float sceneTime = 0.0f;     // u_time, frozen while paused
+    bool timePaused = false;
+    SceneParams sceneParams;
+    FrameInvalidation invalidation;
+
+    GpuTimer gpuTimer;
+    gpuTimer.Init();
+
+    FormatBenchmark formatBench;
+    SceneBenchmark sceneBench;
+
+    // F7 toggles; scales the main passes to hold targetMs of GPU time
+    DynamicResolution dynamicRes;
+    dynamicRes.targetMs = 8.3f;
+    dynamicRes.minScale = MIN_RENDER_SCALE;
+    dynamicRes.maxScale = MAX_RENDER_SCALE;
 
 
 
     while(!glfwWindowShouldClose(window))
     {
         static float startTime = glfwGetTime();
-        float currentTime = glfwGetTime() - startTime;
+        static float lastFrameTime = startTime;
+        float frameMs = (glfwGetTime() - lastFrameTime) * 1000.0f;
+        lastFrameTime = glfwGetTime();
         
         getFrameRate(&disp_fps, &disp_ms);
-        glfwGetWindowSize(window, &s_width, &s_height);
-        glfwSetWindowTitle(window, ("ConeMarching Prepass test - fps: " + std::to_string(disp_fps) + " | ms: "+ std::to_string(disp_ms)).c_str());
+        glfwGetFramebufferSize(window, &s_width, &s_height);
+        glfwSetWindowTitle(window, ("ConeMarching Prepass test - fps: " + std::to_string(disp_fps) + " | ms: "+ std::to_string(disp_ms)
+                                    + " | gpu ms: " + std::to_string(gpuTimer.GetTotalMs())
+                                    + " | scale: " + std::to_string(renderScale) + (dynamicRes.enabled ? " (dynamic)" : "")
+                                    + " | temporal: " + temporalModeNames[temporalMode]
+                                    + (accumulating ? " | samples: " + std::to_string(accumulatedFrames) : "")
+                                    + (asyncRep.enabled ? " | async ahead: " + std::to_string(asyncRep.framesAhead) + " frames, "
+                                                        + std::to_string(asyncRep.msAhead) + " ms" : "")
+                                    + (frameGen.enabled ? " | framegen split: " + std::to_string(frameGen.split) : "")
+                                    + (cascade1Octahedral ? " | cascade1: camera map" : "")
+                                    + (instanceField.Empty() ? "" : " | instances: " + std::to_string(instanceField.instances.size()))
+                                    + (sceneVolume.Empty() ? "" : " | baked bricks: " + std::to_string(sceneVolume.stored))).c_str());
         cout<<"FPS: " << disp_fps << " | MS: " << disp_ms << "\r";
 
         camera.ProcessInputs(window, s_width, s_height);
 
-        glUseProgram(computeProgram);
-        glUniform1f(glGetUniformLocation(computeProgram, "u_time"),     currentTime);
-        glUniform3f(glGetUniformLocation(computeProgram, "u_camPos"),   camera.Position.x, camera.Position.y, camera.Position.z);
-        glUniform3f(glGetUniformLocation(computeProgram, "u_camRot"),   glm::radians(camera.pitch), glm::radians(camera.yaw), 0.0f);
-        glUniform2i(glGetUniformLocation(computeProgram, "u_fullRes"),  s_width, s_height);
-        glUniform2i(glGetUniformLocation(computeProgram, "u_cascade1Res"), std::max(1, s_width / cascadeScale1), std::max(1, s_height / cascadeScale1));
-        glUniform2i(glGetUniformLocation(computeProgram, "u_cascade2Res"), std::max(1, s_width / cascadeScale2), std::max(1, s_height / cascadeScale2));
-        glUniform2i(glGetUniformLocation(computeProgram, "u_cascade3Res"), std::max(1, s_width / cascadeScale3), std::max(1, s_height / cascadeScale3));
-        glUniform1f(glGetUniformLocation(computeProgram, "u_fov"),      glm::radians(60.0f));
-        glUniform1i(glGetUniformLocation(computeProgram, "u_buffer"),   camera.activeBuffer);
-
-        // ──────────────────────────── Cascading Cone Prepass ──────────────────────────── //
-        // Pass 0: Cascade1 (coarse)
-        glBindImageTexture(0, cascade1DepthTex, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
-        glBindImageTexture(1, cascade2DepthTex, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
-        glBindImageTexture(2, cascade3DepthTex, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
-        glBindImageTexture(3, outputTex,        0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
-        DispatchPass(0, computeProgram);
-
-        // Pass 1: Cascade2 (medium, refines cascade1 hits)
-        DispatchPass(1, computeProgram);
-
-        // Pass 2: Cascade3 (fine, refines cascade2 hits)
-        DispatchPass(2, computeProgram);
-
-        // Pass 3: Main raymarch (uses cascade3 depth)
-        glBindImageTexture(3, outputTex, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
-        DispatchPass(3, computeProgram);
+        // Space: pause scene time
+        if (KeyPressedOnce(window, GLFW_KEY_SPACE))
+            timePaused = !timePaused;
+        if (!timePaused)
+            sceneTime += frameMs * 0.001f;
+        sceneParams.Evaluate(sceneTime);
+
+        // F9: benchmark all storage format / present path combinations
+        bool formatsChanged = false;
+        if (KeyPressedOnce(window, GLFW_KEY_F9) && !formatBench.active && !sceneBench.active)
+        {
+            StartFormatBenchmark(formatBench, exeDir + "/bench_output.txt");
+            formatsChanged = true;
+        }
+        formatsChanged |= UpdateFormatBenchmark(formatBench, gpuTimer, frameMs);
+
+        // F12: compiled vs interpreted scene
+        if (KeyPressedOnce(window, GLFW_KEY_F12) && !sceneBench.active && !formatBench.active)
+            StartSceneBenchmark(sceneBench, sceneBackends, computeShaderSourceStr, scene, sceneBytecode, exeDir + "/scene_bench_output.txt");
+
+        bool sceneChanged = false;
+        std::filesystem::file_time_type sceneWriteTime = std::filesystem::last_write_time(sceneFile, sceneFileError);
+        if (!sceneFileError && sceneWriteTime != sceneFileTime)
+        {
+            sceneFileTime = sceneWriteTime;
+            sceneChanged = LoadScene(sceneFile, scene, sceneBytecode, sceneBvh, sceneParams);
+            if (sceneChanged)
+            {
+                BakeSceneVolume(sceneVolume, computeShaderSourceStr, scene, brickFile);
+                SceneEdited(sceneBackends, computeShaderSourceStr, scene, sceneBytecode);
+            }
+        }
+        sceneBvh.Refit(scene, sceneParams);     // Items following the animated parameters
+
+        // Insert: instance field on / off, which rebuilds the programs. Home:
+        // scatter it anew, only the hash is rebuilt.
+        bool instancesToggled = false;
+        if (KeyPressedOnce(window, GLFW_KEY_INSERT))
+        {
+            if (instanceField.Empty())
+                instanceField.Scatter(INSTANCE_FIELD_COUNT, instanceSeed);
+            else
+                instanceField.Clear();
+            instancesToggled = true;
+        }
+        if (KeyPressedOnce(window, GLFW_KEY_HOME) && !instanceField.Empty())
+        {
+            instanceField.Scatter(INSTANCE_FIELD_COUNT, ++instanceSeed);
+            sceneChanged = true;
+        }
+        sceneChanged |= instancesToggled;
+
+        // End: baked scene volume on / off, which rebuilds the programs too
+        bool bakingToggled = false;
+        if (KeyPressedOnce(window, GLFW_KEY_END))
+        {
+            sceneBaking = !sceneBaking;
+            BakeSceneVolume(sceneVolume, computeShaderSourceStr, scene, brickFile);
+            bakingToggled = true;
+        }
+        sceneChanged |= bakingToggled;
+
+        if (formatsChanged || instancesToggled || bakingToggled)
+            RebuildSceneBackends(sceneBackends, computeShaderSourceStr, scene);
+        sceneChanged |= UpdateSceneBackends(sceneBackends, computeShaderSourceStr, scene);  // Normals may differ
+        computePrograms = UpdateSceneBenchmark(sceneBench, sceneBackends, gpuTimer, scene);
+        if (!instanceHashProgram && !instanceField.Empty())
+            instanceHashProgram = BuildComputeProgram(InjectShaderDefines(computeShaderSourceStr,
+                                                      SceneCompiler::ShaderDefines() + InstanceField::ShaderDefines() + "#define INSTANCE_HASH_PASS\n"), false);
+        instanceField.RebuildHash(instanceHashProgram);
+        sceneTileCulling = !scene.items.empty();
+        if (sceneChanged)
+        {
+            invalidation.Invalidate();
+            cascade1Map.Invalidate();
+            history.valid = false;
+            asyncRep.jobActive = false;
+            frameGen.lastFrameValid = false;
+        }
 
-        // ─────────────────────────────── Render to screen ────────────────────────────── //
-        glUseProgram(shaderProgram);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, outputTex);
-        glUniform1i(glGetUniformLocation(shaderProgram, "screen"), 0);
+        // Page Up / Page Down: render scale, F7: dynamic resolution
+        if (KeyPressedOnce(window, GLFW_KEY_PAGE_UP))
+            renderScale = std::min(MAX_RENDER_SCALE, renderScale + 0.125f);
+        if (KeyPressedOnce(window, GLFW_KEY_PAGE_DOWN))
+            renderScale = std::max(MIN_RENDER_SCALE, renderScale - 0.125f);
+        if (KeyPressedOnce(window, GLFW_KEY_F7))
+        {
+            dynamicRes.enabled = !dynamicRes.enabled;
+            dynamicRes.Reset();
+        }
+        // F6: temporal upscaling off / half / quarter resolution / checkerboard
+        if (KeyPressedOnce(window, GLFW_KEY_F6))
+        {
+            temporalMode = (TemporalMode)((temporalMode + 1) % TEMPORAL_MODE_COUNT);
+            renderScale = temporalModeScales[temporalMode];
+            dynamicRes.Reset();
+            history.valid = false;
+            asyncRep.enabled = false;
+            frameGen.enabled = false;
+        }
+        // F8: async reprojection, replaces temporal upscaling and accumulation
+        if (KeyPressedOnce(window, GLFW_KEY_F8))
+        {
+            asyncRep.enabled = !asyncRep.enabled;
+            if (asyncRep.enabled)
+            {
+                frameGen.enabled = false;
+                temporalMode = TEMPORAL_OFF;
+                accumulating = false;
+                accumulatedFrames = 0;
+                renderJitter = glm::vec2(0.0f);
+                if (history.width)
+                    ReleaseTemporalHistory(history, targetPool);
+            }
+        }
+        // F11: camera-centred cascade1 map, the cascade1 target changes size
+        if (KeyPressedOnce(window, GLFW_KEY_F11))
+        {
+            cascade1Octahedral = !cascade1Octahedral;
+            ReleaseRenderTargets(targets, targetPool);
+            asyncRep.jobActive = false;
+            frameGen.phase = 0;
+            frameGen.lastFrameValid = false;
+        }
+        // F10: frame generation, replaces temporal upscaling and accumulation too
+        if (KeyPressedOnce(window, GLFW_KEY_F10))
+        {
+            frameGen.enabled = !frameGen.enabled;
+            if (frameGen.enabled)
+            {
+                asyncRep.enabled = false;
+                temporalMode = TEMPORAL_OFF;
+                renderJitter = glm::vec2(0.0f);
+                if (history.width)
+                    ReleaseTemporalHistory(history, targetPool);
+            }
+        }
+        if (!frameGen.enabled && frameGen.width)
+            ReleaseFrameGeneration(frameGen, targetPool);
+        if (!asyncRep.enabled && (asyncRep.sourceTex || asyncRep.displayTex))
+            ReleaseAsyncReprojection(asyncRep, targetPool);
+        guardBandScale = asyncRep.enabled ? ASYNC_GUARD_BAND : 1.0f;
+
+        r_width  = std::max(1, (int)(s_width * renderScale * guardBandScale + 0.5f));
+        r_height = std::max(1, (int)(s_height * renderScale * guardBandScale + 0.5f));
+
+        frameGen.timerPhase[gpuTimer.frame % GpuTimer::FRAMES_IN_FLIGHT] = 0;
+
+        // Async reprojection: a new job starts once the last one finished and
+        // something changed since it started. Presentation doesn't wait for it.
+        if (asyncRep.enabled)
+        {
+            if (formatsChanged)
+            {
+                asyncRep.jobActive = false;
+                invalidation.Invalidate();
+            }
+            if (!asyncRep.jobActive)
+            {
+                FrameInputs inputs = GatherFrameInputs(camera, sceneParams, scene);
+                if (formatsChanged || invalidation.Changes(inputs) != 0)
+                {
+                    if (formatsChanged || r_width != targets.width || r_height != targets.height)
+                    {
+                        ReleaseRenderTargets(targets, targetPool);
+                        if (formatsChanged)
+                            targetPool.Trim();
+                        AcquireRenderTargets(targets, targetPool, r_width, r_height);
+                    }
+                    StartRenderJob(asyncRep, camera, sceneParams, sceneTime, inputs, gpuTimer);
+                    invalidation.Rendered(inputs);
+                }
+            }
+
+            // Sizes are the job's until it finishes
+            r_width = targets.width;
+            r_height = targets.height;
+            if (asyncRep.jobActive)
+                AdvanceRenderJob(asyncRep, targets, targetPool, computePrograms, gpuTimer);
+            asyncRep.framesAhead = asyncRep.jobActive ? asyncRep.frame - asyncRep.sourceFrame : 0;
+            asyncRep.msAhead = asyncRep.jobActive ? float(glfwGetTime() - asyncRep.sourceStart) * 1000.0f : 0.0f;
+
+            gpuTimer.Begin(TIMER_PRESENT);
+            PresentReprojected(computePrograms.reproject, asyncRep, camera, targetPool, shaderProgram, VAO);
+            gpuTimer.End();
+            asyncRep.frame++;
+
+            FinishFrame(window, gpuTimer);
+            continue;
+        }
+
+        // Idle: nothing that affects the image changed since the last rendered
+        // frame (the jitter is ours to pick). The benchmarks time every pass.
+        if (formatBench.active || sceneBench.active)
+            invalidation.Invalidate();
+        bool idle = (invalidation.Changes(GatherFrameInputs(camera, sceneParams, scene)) & ~INPUT_JITTER) == 0;
+        if (!idle && accumulating)
+            history.valid = false;  // Holds weight sums, not distances
+        if (!idle)
+            accumulatedFrames = 0;
+
+        // The benchmarks need a fixed resolution to compare, and idle
+        // frames cost next to nothing so they would scale up for no reason.
+        // A frame generation pair keeps its resolution.
+        if (!formatBench.active && !sceneBench.active && !idle && frameGen.phase == 0)
+            renderScale = dynamicRes.Update(gpuTimer.GetTotalMs(), renderScale);
+
+        r_width  = std::max(1, (int)(s_width * renderScale + 0.5f));
+        r_height = std::max(1, (int)(s_height * renderScale + 0.5f));
+
+        accumulating = idle && r_width == targets.width && r_height == targets.height;
+        if (!accumulating)
+            accumulatedFrames = 0;
+        bool converged = accumulatedFrames >= ACCUMULATION_SAMPLES;
+
+        // Reacquire on any size or format change; same-bucket sizes get their textures back
+        if (formatsChanged || r_width != targets.width || r_height != targets.height)
+        {
+            ReleaseRenderTargets(targets, targetPool);
+            if (formatsChanged)
+                targetPool.Trim();
+            AcquireRenderTargets(targets, targetPool, r_width, r_height);
+        }
+
+        // Frame generation takes over while the view changes, a pair always
+        // completes once started. Extrapolation needs the previous real frame
+        // still in the targets, otherwise the frame is rendered whole.
+        if (frameGen.enabled && (formatsChanged || r_width != frameGen.width || r_height != frameGen.height))
+        {
+            ReleaseFrameGeneration(frameGen, targetPool);
+            AcquireFrameGeneration(frameGen, targetPool, r_width, r_height);
+        }
+        if (frameGen.enabled && temporalMode == TEMPORAL_OFF && (!idle || frameGen.phase == 1))
+        {
+            accumulating = false;
+            accumulatedFrames = 0;
+            renderJitter = glm::vec2(0.0f);
+
+            if (frameGen.phase == 0)
+            {
+                frameGen.jobCamera = camera;
+                frameGen.jobScene = sceneParams;
+                frameGen.jobTime = sceneTime;
+                frameGen.jobInputs = GatherFrameInputs(camera, sceneParams, scene);
+            }
+
+            if (frameGen.phase == 0 && frameGen.lastFrameValid)
+            {
+                // Extrapolate before the rows below overwrite the output and motion
+                gpuTimer.Begin(TIMER_RESOLVE);
+                DispatchExtrapolation(computePrograms.reproject, frameGen, targets);
+                gpuTimer.End();
+
+                frameGen.splitRow = glm::clamp((int)(r_height * frameGen.split), 1, r_height);
+                DispatchFrameGenRows(frameGen, targets, computePrograms, gpuTimer, 0, frameGen.splitRow);
+
+                gpuTimer.Begin(TIMER_PRESENT);
+                Present(frameGen.targetFbo, frameGen.targetTex, r_width, r_height, shaderProgram, VAO);
+                gpuTimer.End();
+
+                frameGen.timerPhase[gpuTimer.frame % GpuTimer::FRAMES_IN_FLIGHT] = 1;
+                frameGen.phase = 1;
+            }
+            else
+            {
+                int rowBegin = (frameGen.phase == 1) ? frameGen.splitRow : 0;
+                if (rowBegin < r_height)
+                    DispatchFrameGenRows(frameGen, targets, computePrograms, gpuTimer, rowBegin, r_height);
+
+                gpuTimer.Begin(TIMER_SHADE);
+                DispatchDeferredShade(computePrograms.shade, targets.hitListBuffer);
+                gpuTimer.End();
+
+                gpuTimer.Begin(TIMER_PRESENT);
+                Present(targets.outputFbo, targets.outputTex, r_width, r_height, shaderProgram, VAO);
+                gpuTimer.End();
+
+                if (frameGen.phase == 1)
+                    frameGen.timerPhase[gpuTimer.frame % GpuTimer::FRAMES_IN_FLIGHT] = 2;
+                frameGen.phase = 0;
+                frameGen.prevCamPos = frameGen.jobCamera.Position;
+                frameGen.prevCamRot = glm::vec3(glm::radians(frameGen.jobCamera.pitch), glm::radians(frameGen.jobCamera.yaw), 0.0f);
+                frameGen.lastFrameValid = true;
+                invalidation.Rendered(frameGen.jobInputs);
+            }
+
+            FinishFrame(window, gpuTimer);
+            BalanceFrameGeneration(frameGen, gpuTimer);
+            continue;
+        }
+        // Anything else rendered or presented leaves no motion to extrapolate along
+        frameGen.lastFrameValid = false;
+
+        bool useHistory = temporalMode != TEMPORAL_OFF || accumulating;
+        if (useHistory)
+        {
+            bool checkerboard = CheckerboardActive();
+            int historyWidth  = checkerboard ? r_width : s_width;
+            int historyHeight = checkerboard ? r_height : s_height;
+            if (historyWidth != history.width || historyHeight != history.height)
+            {
+                ReleaseTemporalHistory(history, targetPool);
+                AcquireTemporalHistory(history, targetPool, historyWidth, historyHeight);
+            }
+            int phase = (accumulating ? accumulatedFrames % ACCUMULATION_SAMPLES : frameIndex % JITTER_PHASES) + 1;
+            renderJitter = checkerboard ? glm::vec2(0.0f) : glm::vec2(Halton(phase, 2) - 0.5f, Halton(phase, 3) - 0.5f);
+            checkerParity = frameIndex & 1;
+        }
+        else
+        {
+            if (history.width)
+                ReleaseTemporalHistory(history, targetPool);
+            renderJitter = glm::vec2(0.0f);
+        }
+        frameIndex++;
+
+        // Passes whose inputs didn't change keep last frame's results. While
+        // accumulating every sample is rendered; once converged the history
+        // is final and only presented.
+        FrameInputs inputs = GatherFrameInputs(camera, sceneParams, scene);
+        unsigned changes = invalidation.Changes(inputs);
+        bool runCascades = !converged && (accumulating || (changes & CASCADE_INPUTS));
+        bool runMarch    = !converged && (accumulating || (changes & MARCH_INPUTS));
+
+        // Only animated nodes changed and the camera is still: re-render just
+        // the tiles the changed nodes' old and new bounds cover, everything
+        // else keeps last frame's output, G-buffer and cascades. The built-in
+        // sdfScene has no bounds of its nodes and redraws whole.
+        PixelRect changedTiles;
+        const PixelRect* region = nullptr;
+        if (runMarch && !accumulating && changes == INPUT_SCENE && !scene.Empty())
+        {
+            glm::vec3 bmin, bmax;
+            bool visible = scene.ChangedRegion(invalidation.last.scene, inputs.scene, rayClipping == 2, bmin, bmax);
+            if (visible && ProjectBoundsToTiles(camera, bmin, bmax, changedTiles))
+            {
+                visible = changedTiles.x0 < changedTiles.x1 && changedTiles.y0 < changedTiles.y1;
+                region = &changedTiles;
+            }
+            if (!visible)
+            {
+                runCascades = runMarch = false;
+                invalidation.Rendered(inputs);
+            }
+        }
 
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+        if (runMarch)
+        {
+            glUseProgram(computePrograms.resolve);
+            SetFrameUniforms(computePrograms.resolve, camera, sceneParams, sceneTime);
+            glUseProgram(computePrograms.shade);
+            SetFrameUniforms(computePrograms.shade, camera, sceneParams, sceneTime);
+            glUseProgram(computePrograms.march);
+            SetFrameUniforms(computePrograms.march, camera, sceneParams, sceneTime);
+
+            BindRenderTargets(targets);
+
+            // ──────────────────────────── Cascading Cone Prepass ──────────────────────────── //
+            if (runCascades)
+            {
+                gpuTimer.Begin(TIMER_CASCADES);
+                DispatchCascades(computePrograms.march, inputs, region);
+                gpuTimer.End();
+            }
+
+            // Pass 3: Main raymarch (uses cascade3 depth), fills the G-buffer and hit list
+            gpuTimer.Begin(TIMER_MAIN);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, targets.hitListBuffer);
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(hitListReset), hitListReset);
+            DispatchPass(3, computePrograms.march, region);
+            gpuTimer.End();
+
+            // Deferred shading of the queued hits
+            gpuTimer.Begin(TIMER_SHADE);
+            DispatchDeferredShade(computePrograms.shade, targets.hitListBuffer);
+            gpuTimer.End();
+
+            // Temporal upscale / checkerboard reconstruction / idle accumulation into the history
+            if (useHistory)
+            {
+                gpuTimer.Begin(TIMER_RESOLVE);
+                history.current = 1 - history.current;
+                DispatchTemporalResolve(computePrograms.resolve, history, camera);
+                gpuTimer.End();
+                if (accumulating)
+                    accumulatedFrames++;
+            }
+
+            invalidation.Rendered(inputs);
+        }
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();    
+        // ─────────────────────────────── Render to screen ────────────────────────────── //
+        gpuTimer.Begin(TIMER_PRESENT);
+        if (useHistory)
+            Present(history.fbo[history.current], history.tex[history.current], history.width, history.height, shaderProgram, VAO);
+        else
+            Present(targets.outputFbo, targets.outputTex, r_width, r_height, shaderProgram, VAO);
+        gpuTimer.End();
+
+        FinishFrame(window, gpuTimer);
     }
 
+    gpuTimer.Destroy();
+    DestroyAsyncReprojection(asyncRep, targetPool);
+    DestroyFrameGeneration(frameGen, targetPool);
+    DestroyTemporalHistory(history, targetPool);
+    DestroyRenderTargets(targets, targetPool);
+    DestroySceneBackends(sceneBackends);
+    sceneBytecode.Destroy();
+    sceneBvh.Destroy();
+    instanceField.Destroy();
+    sceneVolume.Destroy();
+    glDeleteProgram(instanceHashProgram);
     glDeleteProgram(shaderProgram);
-    glDeleteProgram(computeProgram);
     glfwDestroyWindow(window);
     glfwTerminate();
     return 0;
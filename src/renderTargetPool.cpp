@@ -0,0 +1,115 @@
+#include "renderTargetPool.h"
+#include <algorithm>
+
+int RenderTargetPool::Bucket(int size)
+{
+    size = std::max(1, size);
+    return ((size + BUCKET_SIZE - 1) / BUCKET_SIZE) * BUCKET_SIZE;
+}
+
+GLuint RenderTargetPool::Acquire(GLenum format, int width, int height)
+{
+    int bucketW = Bucket(width);
+    int bucketH = Bucket(height);
+
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        Entry& e = entries[i];
+        if (!e.inUse && e.format == format && e.width == bucketW && e.height == bucketH)
+        {
+            e.inUse = true;
+            return e.tex;
+        }
+    }
+
+    Entry e;
+    e.format = format;
+    e.width = bucketW;
+    e.height = bucketH;
+    e.inUse = true;
+    e.released = 0;
+
+    glGenTextures(1, &e.tex);
+    glBindTexture(GL_TEXTURE_2D, e.tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexStorage2D(GL_TEXTURE_2D, 1, format, bucketW, bucketH);
+
+    entries.push_back(e);
+    Evict();
+    return e.tex;
+}
+
+void RenderTargetPool::Release(GLuint tex)
+{
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        if (entries[i].tex == tex)
+        {
+            entries[i].inUse = false;
+            entries[i].released = ++releaseCount;
+            return;
+        }
+    }
+}
+
+void RenderTargetPool::Trim()
+{
+    for (size_t i = 0; i < entries.size(); )
+    {
+        if (!entries[i].inUse)
+        {
+            glDeleteTextures(1, &entries[i].tex);
+            entries.erase(entries.begin() + i);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+}
+
+void RenderTargetPool::Destroy()
+{
+    for (size_t i = 0; i < entries.size(); ++i)
+        glDeleteTextures(1, &entries[i].tex);
+    entries.clear();
+}
+
+// Only grows when a request missed every released texture, which is when
+// the working set moved on (a new size bucket) and older ones can go
+void RenderTargetPool::Evict()
+{
+    size_t inUse = AllocatedBytes(true);
+    while (AllocatedBytes(false) > inUse)
+    {
+        size_t oldest = entries.size();
+        for (size_t i = 0; i < entries.size(); ++i)
+            if (!entries[i].inUse && (oldest == entries.size() || entries[i].released < entries[oldest].released))
+                oldest = i;
+        glDeleteTextures(1, &entries[oldest].tex);
+        entries.erase(entries.begin() + oldest);
+    }
+}
+
+size_t RenderTargetPool::AllocatedBytes(bool inUse) const
+{
+    size_t bytes = 0;
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        if (entries[i].inUse != inUse)
+            continue;
+        size_t bpp = 4;
+        switch (entries[i].format)
+        {
+            case GL_R16F:    bpp = 2;  break;
+            case GL_RGBA16F: bpp = 8;  break;
+            case GL_RGBA32F: bpp = 16; break;
+            default:         bpp = 4;  break;
+        }
+        bytes += bpp * entries[i].width * entries[i].height;
+    }
+    return bytes;
+}
@@ -0,0 +1,43 @@
+#ifndef RENDER_TARGET_POOL_CLASS_H
+#define RENDER_TARGET_POOL_CLASS_H
+
+#include <glad/glad.h>
+#include <vector>
+
+// Storage textures recycled by format and size bucket. Requests are rounded
+// up to BUCKET_SIZE pixels per axis, so resolution changes within a bucket
+// (render scale steps, small window changes) reuse the same allocation.
+// Callers render into the top-left width x height region of what they get.
+// Released textures stay for reuse until they take more memory than those
+// in use, then the least recently released go first.
+class RenderTargetPool
+{
+    public:
+        static const int BUCKET_SIZE = 64;
+
+        struct Entry
+        {
+            GLuint tex;
+            GLenum format;
+            int    width;       // Allocated (bucketed) size
+            int    height;
+            bool   inUse;
+            unsigned released;  // Release() order, for eviction
+        };
+
+        std::vector<Entry> entries;
+        unsigned releaseCount = 0;
+
+        GLuint Acquire(GLenum format, int width, int height);
+        void Release(GLuint tex);
+        void Trim();            // Frees every texture not currently in use
+        void Destroy();
+
+        static int Bucket(int size);
+        size_t AllocatedBytes(bool inUse) const;   // Of the textures in use or released
+
+    private:
+        void Evict();
+};
+
+#endif
@@ -0,0 +1,426 @@
+// Offline baker: evaluates the time-invariant subtree of a scene file
+// (SceneProgram::baked) on a sparse brick grid on every CPU core and writes
+// it as a brick file (see sceneBrickFile.h), which the renderer loads in
+// place of baking the scene's volume on the GPU.
+//
+//   sceneBaker <scene> [output] [--cell size] [--threads n] [--full]
+//
+// The output defaults to the scene file with an .sdfb extension, where the
+// renderer looks for it. The grid covers the baked subtree's bounds, with
+// SCENE_VOLUME_CELLS cells along their widest side unless --cell fixes the
+// size; bricks sit on multiples of their size from the world origin. When
+// the output already holds a bake of the same grid, only the bricks near
+// nodes that changed since are evaluated again, the others are copied
+// (--full bakes everything). Either way the file only depends on the scene
+// and options. Edits that move the bounds change the default grid, --cell
+// keeps it for incremental bakes.
+//
+// Only what the renderer bakes is baked, not the whole scene: scenes split
+// into BVH items (bvh.scene) and those without a costly enough time-invariant
+// subtree (grid.scene) are refused, the renderer marches them exactly.
+// Neither does the file hold the surface: bricks within SCENE_VOLUME_BAND
+// cells of it stay NEAR and are evaluated exactly, past the far band they
+// only keep a bound, so samples are stored for the band in between.
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <set>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <filesystem>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include "sceneParams.h"
+#include "sceneParams.cpp"
+#include "sceneCompiler.h"
+#include "sceneCompiler.cpp"
+#include "sceneBrickFile.h"
+
+const float SCENE_BAKER_DIAGONAL = 1.7320508f;  // In brick sides, how far samples saturate past the far band
+
+const int SCENE_BAKER_SIDE    = SCENE_VOLUME_BRICK + 1;
+const int SCENE_BAKER_SAMPLES = SCENE_BAKER_SIDE * SCENE_BAKER_SIDE * SCENE_BAKER_SIDE;
+
+struct BakerOptions
+{
+    std::string scene, output;
+    float       cellSize = 0.0f;        // 0 = SCENE_VOLUME_CELLS along the bounds' widest side
+    int         threads = 0;            // 0 = every core
+    bool        full = false;
+};
+
+struct BakedBrick
+{
+    uint32_t              slot = SCENE_VOLUME_NEAR;     // SCENE_VOLUME_NEAR, SCENE_VOLUME_FAR or 0 with samples
+    float                 bound = 0.0f;
+    std::vector<uint16_t> samples;      // Half floats, empty unless the slot is 0
+};
+
+// An earlier bake, read whole
+struct BrickFile
+{
+    std::vector<char> data;
+
+    const SceneBrickFileHeader& Header() const { return *(const SceneBrickFileHeader*)data.data(); }
+    const SceneBrickFileNode* Nodes() const { return (const SceneBrickFileNode*)(data.data() + Header().nodeOffset); }
+    const SceneVolumeBrick* Table() const { return (const SceneVolumeBrick*)(data.data() + Header().tableOffset); }
+    const uint16_t* Atlas() const { return (const uint16_t*)(data.data() + Header().atlasOffset); }
+};
+
+static bool ParseBakerOptions(int argc, char** argv, BakerOptions& options)
+{
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        auto number = [&](float& value)
+        {
+            if (i + 1 >= argc)
+                return false;
+            char* end = nullptr;
+            value = std::strtof(argv[++i], &end);
+            return *end == '\0';
+        };
+        bool ok = true;
+        if (arg == "--cell")
+            ok = number(options.cellSize) && options.cellSize > 0.0f;
+        else if (arg == "--threads")
+        {
+            float threads = 0.0f;
+            ok = number(threads) && threads >= 1.0f;
+            options.threads = (int)threads;
+        }
+        else if (arg == "--full")
+            options.full = true;
+        else if (arg.compare(0, 2, "--") == 0)
+            ok = false;
+        else
+            positional.push_back(arg);
+        if (!ok)
+        {
+            std::cerr << "Bad option " << arg << std::endl;
+            return false;
+        }
+    }
+    if (positional.empty() || positional.size() > 2)
+        return false;
+    options.scene = positional[0];
+    options.output = positional.size() > 1 ? positional[1] : std::filesystem::path(options.scene).replace_extension(".sdfb").string();
+    return true;
+}
+
+static bool ReadBrickFile(const std::string& filename, BrickFile& file)
+{
+    std::ifstream in(filename.c_str(), std::ios::binary);
+    if (!in.is_open())
+        return false;
+    file.data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    if (file.data.size() < sizeof(SceneBrickFileHeader))
+        return false;
+
+    const SceneBrickFileHeader& header = file.Header();
+    uint64_t tableBytes = (uint64_t)header.bricks[0] * header.bricks[1] * header.bricks[2] * sizeof(SceneVolumeBrick);
+    uint64_t atlasBytes = (uint64_t)header.atlasBricks[0] * header.atlasBricks[1] * header.atlasBricks[2] * SCENE_BAKER_SAMPLES * sizeof(uint16_t);
+    return std::memcmp(header.magic, SCENE_BRICK_FILE_MAGIC, sizeof(header.magic)) == 0
+        && header.version == SCENE_BRICK_FILE_VERSION && header.fileSize == file.data.size()
+        && header.nodeOffset + header.nodeCount * sizeof(SceneBrickFileNode) <= header.tableOffset
+        && header.tableOffset + tableBytes <= header.atlasOffset && header.atlasOffset + atlasBytes <= header.fileSize;
+}
+
+// Hashes of every bounded node of the baked subtree, the only part the
+// volume holds
+static std::vector<SceneBrickFileNode> BakerNodes(const SceneProgram& program)
+{
+    const std::vector<SceneInstr>& code = program.code;
+    std::vector<bool> inside = SceneSubtree(program, program.baked);
+    std::vector<bool> isNode(code.size(), false);
+    for (const SceneNodeBounds& node : program.nodes)
+        isNode[node.root] = true;
+    std::vector<uint64_t> hashes(code.size()), shapes(code.size());
+    for (size_t i = 0; i < code.size(); ++i)
+        hashes[i] = SceneInstrHash(code[i], hashes);
+
+    std::vector<SceneBrickFileNode> nodes;
+    for (const SceneNodeBounds& node : program.nodes)
+    {
+        if (!inside[node.root])
+            continue;
+        for (int i = 0; i <= node.root; ++i)
+            shapes[i] = i != node.root && isNode[i] ? 0 : SceneInstrHash(code[i], shapes);
+
+        SceneOp op = code[node.root].op;
+        SceneBrickFileNode entry = {};
+        entry.hash = hashes[node.root];
+        entry.shape = shapes[node.root];
+        entry.flags = op == SOP_UNION || op == SOP_INTERSECTION || op == SOP_DIFFERENCE ? SCENE_BRICK_NODE_SHARP : 0;
+        for (int k = 0; k < 3; ++k)
+        {
+            entry.boundsMin[k] = node.boundsMin[k];
+            entry.boundsMax[k] = node.boundsMax[k];
+        }
+        nodes.push_back(entry);
+    }
+    return nodes;
+}
+
+// Boxes of the nodes of `a` that changed from `b`. A sharp combinator whose
+// change is all in nodes below it leaves the rest of its box as it was.
+static void BakerChangedBoxes(const std::vector<SceneBrickFileNode>& a, const std::vector<SceneBrickFileNode>& b,
+                              std::vector<glm::vec3>& boxes)
+{
+    std::set<uint64_t> hashesA, hashesB, changedShapesB;
+    for (const SceneBrickFileNode& node : a)
+        hashesA.insert(node.hash);
+    for (const SceneBrickFileNode& node : b)
+        hashesB.insert(node.hash);
+    for (const SceneBrickFileNode& node : b)
+        if (!hashesA.count(node.hash))
+            changedShapesB.insert(node.shape);
+
+    for (const SceneBrickFileNode& node : a)
+    {
+        if (hashesB.count(node.hash) || ((node.flags & SCENE_BRICK_NODE_SHARP) && changedShapesB.count(node.shape)))
+            continue;
+        boxes.push_back(glm::vec3(node.boundsMin[0], node.boundsMin[1], node.boundsMin[2]));
+        boxes.push_back(glm::vec3(node.boundsMax[0], node.boundsMax[1], node.boundsMax[2]));
+    }
+}
+
+// One brick, sorted the way SceneVolume::Bake sorts them. Samples saturate
+// at `reach`, a brick diagonal past where a brick is far even from its
+// nearest sample, so saturation never decides whether one is far: the sort
+// matches that of the exact samples. Saturated samples stay Lipschitz lower
+// bounds, and geometry farther than `reach` from a brick can't change what
+// is written for it, which incremental bakes rely on.
+static void BakeBrick(const SceneProgram& program, const glm::ivec3& firstCell, float cellSize, float error, float reach,
+                      BakedBrick& brick)
+{
+    float lo = 1e30f, hi = -1e30f;
+    bool finite = true;
+    std::vector<float> values(SCENE_BAKER_SAMPLES);
+    for (int k = 0, s = 0; k < SCENE_BAKER_SIDE; ++k)
+        for (int j = 0; j < SCENE_BAKER_SIDE; ++j)
+            for (int i = 0; i < SCENE_BAKER_SIDE; ++i, ++s)
+            {
+                glm::vec3 p = glm::vec3(firstCell + glm::ivec3(i, j, k)) * cellSize;
+                float distance = program.EvaluateBaked(p).x;
+                finite = finite && std::isfinite(distance);
+                values[s] = std::min(distance, reach);
+                lo = std::min(lo, values[s]);
+                hi = std::max(hi, values[s]);
+            }
+
+    brick.bound = lo - program.bakedLipschitz * cellSize * SCENE_VOLUME_NEAREST;
+    brick.samples.clear();
+    if (!finite || !(hi - error >= SCENE_VOLUME_BAND * cellSize))
+        brick.slot = SCENE_VOLUME_NEAR;
+    else if (brick.bound >= SCENE_VOLUME_FAR_BAND * SCENE_VOLUME_BRICK * cellSize)
+        brick.slot = SCENE_VOLUME_FAR;
+    else
+    {
+        brick.slot = 0;
+        brick.samples.resize(SCENE_BAKER_SAMPLES);
+        for (int s = 0; s < SCENE_BAKER_SAMPLES; ++s)
+            brick.samples[s] = glm::packHalf1x16(values[s]);
+    }
+}
+
+static uint64_t BakerAlign(uint64_t offset)
+{
+    return (offset + SCENE_BRICK_FILE_ALIGNMENT - 1) / SCENE_BRICK_FILE_ALIGNMENT * SCENE_BRICK_FILE_ALIGNMENT;
+}
+
+int main(int argc, char** argv)
+{
+    BakerOptions options;
+    if (!ParseBakerOptions(argc, argv, options))
+    {
+        std::cerr << "Usage: sceneBaker <scene> [output] [--cell size] [--threads n] [--full]" << std::endl;
+        return 1;
+    }
+
+    // Compiled as the renderer compiles it, so both pick the same subtree
+    SceneCompiler compiler;
+    SceneProgram program;
+    if (!compiler.CompileFile(options.scene, program))
+    {
+        std::cerr << "Scene compile FAILED: " << compiler.error << std::endl;
+        return 1;
+    }
+    if (program.baked < 0)
+    {
+        std::cerr << "Scene " << program.name << (program.items.empty() ? " has no time-invariant subtree to bake"
+                                                  : " is split into BVH items, which are never baked") << std::endl;
+        return 1;
+    }
+
+    BrickFile previous;
+    bool incremental = !options.full && ReadBrickFile(options.output, previous)
+                    && previous.Header().brickSize == (uint32_t)SCENE_VOLUME_BRICK;
+
+    glm::vec3 boundsMin = program.bakedMin, boundsMax = program.bakedMax;
+    if (options.cellSize == 0.0f)
+        options.cellSize = SceneVMax(boundsMax - boundsMin) / SCENE_VOLUME_CELLS;
+
+    // Bricks are aligned to the world origin, so they stay put when the bounds move
+    float cellSize = options.cellSize;
+    float error = program.bakedLipschitz * cellSize * SCENE_VOLUME_ERROR;
+    float reach = (SCENE_VOLUME_FAR_BAND + SCENE_BAKER_DIAGONAL) * SCENE_VOLUME_BRICK * cellSize
+                + program.bakedLipschitz * cellSize * SCENE_VOLUME_NEAREST;
+    float brickSide = cellSize * SCENE_VOLUME_BRICK;
+    glm::ivec3 origin = glm::ivec3(glm::floor(boundsMin / brickSide));
+    glm::ivec3 bricks = glm::max(glm::ivec3(glm::ceil(boundsMax / brickSide)) - origin, glm::ivec3(1));
+    size_t brickCount = (size_t)bricks.x * bricks.y * bricks.z;
+
+    // The earlier bake only helps on the same grid
+    std::vector<SceneBrickFileNode> nodes = BakerNodes(program);
+    incremental = incremental && previous.Header().cellSize == cellSize && previous.Header().error == error
+               && previous.Header().reach == reach;
+    std::vector<glm::vec3> changed;
+    if (incremental)
+    {
+        std::vector<SceneBrickFileNode> previousNodes(previous.Nodes(), previous.Nodes() + previous.Header().nodeCount);
+        BakerChangedBoxes(nodes, previousNodes, changed);
+        BakerChangedBoxes(previousNodes, nodes, changed);
+    }
+
+    // Bricks of the earlier bake stay when no changed box is within reach of them
+    auto previousBrick = [&](const glm::ivec3& brick) -> int64_t
+    {
+        if (!incremental)
+            return -1;
+        const SceneBrickFileHeader& header = previous.Header();
+        glm::ivec3 local = origin + brick - glm::ivec3(header.origin[0], header.origin[1], header.origin[2]);
+        if (glm::any(glm::lessThan(local, glm::ivec3(0)))
+            || glm::any(glm::greaterThanEqual(local, glm::ivec3(header.bricks[0], header.bricks[1], header.bricks[2]))))
+            return -1;
+        glm::vec3 lo = glm::vec3(origin + brick) * brickSide - reach, hi = lo + brickSide + 2.0f * reach;
+        for (size_t i = 0; i < changed.size(); i += 2)
+            if (glm::all(glm::lessThanEqual(lo, changed[i + 1])) && glm::all(glm::lessThanEqual(changed[i], hi)))
+                return -1;
+        return ((int64_t)local.z * header.bricks[1] + local.y) * header.bricks[0] + local.x;
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    int threadCount = options.threads > 0 ? options.threads : (int)std::max(1u, std::thread::hardware_concurrency());
+    std::vector<BakedBrick> baked(brickCount);
+    std::atomic<size_t> nextBrick(0), reused(0);
+    auto worker = [&]()
+    {
+        for (size_t b = nextBrick++; b < brickCount; b = nextBrick++)
+        {
+            glm::ivec3 brick((int)(b % bricks.x), (int)(b / bricks.x % bricks.y), (int)(b / bricks.x / bricks.y));
+            int64_t old = previousBrick(brick);
+            if (old < 0)
+            {
+                BakeBrick(program, (origin + brick) * SCENE_VOLUME_BRICK, cellSize, error, reach, baked[b]);
+                continue;
+            }
+
+            const SceneVolumeBrick& entry = previous.Table()[old];
+            baked[b].bound = entry.bound;
+            baked[b].slot = entry.slot == SCENE_VOLUME_NEAR || entry.slot == SCENE_VOLUME_FAR ? entry.slot : 0;
+            if (baked[b].slot == 0)
+            {
+                const SceneBrickFileHeader& header = previous.Header();
+                glm::ivec3 texels = glm::ivec3(header.atlasBricks[0], header.atlasBricks[1], header.atlasBricks[2]) * SCENE_BAKER_SIDE;
+                glm::ivec3 slot(entry.slot & 0xFF, (entry.slot >> 8) & 0xFF, entry.slot >> 16);
+                glm::ivec3 first = slot * SCENE_BAKER_SIDE;
+                baked[b].samples.resize(SCENE_BAKER_SAMPLES);
+                for (int k = 0, s = 0; k < SCENE_BAKER_SIDE; ++k)
+                    for (int j = 0; j < SCENE_BAKER_SIDE; ++j)
+                        for (int i = 0; i < SCENE_BAKER_SIDE; ++i, ++s)
+                            baked[b].samples[s] = previous.Atlas()[((size_t)(first.z + k) * texels.y + first.y + j) * texels.x + first.x + i];
+            }
+            ++reused;
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadCount; ++t)
+        threads.emplace_back(worker);
+    for (std::thread& thread : threads)
+        thread.join();
+
+    // Slots in brick order, the same as SceneVolume::Bake
+    std::vector<SceneVolumeBrick> table(brickCount);
+    uint32_t stored = 0, distant = 0;
+    for (size_t b = 0; b < brickCount; ++b)
+    {
+        table[b].bound = baked[b].bound;
+        table[b].slot = baked[b].slot;
+        if (baked[b].slot == SCENE_VOLUME_FAR)
+            ++distant;
+        else if (baked[b].slot == 0)
+        {
+            table[b].slot = (stored % 16) | (stored / 16 % 16) << 8 | (stored / 256) << 16;
+            ++stored;
+        }
+    }
+    if (stored >= 256u * 0xFFFF)
+    {
+        std::cerr << "Scene " << program.name << ": " << stored << " bricks with samples, more than the atlas addresses" << std::endl;
+        return 1;
+    }
+
+    uint32_t slotCount = std::max(stored, 1u);
+    glm::ivec3 atlasBricks((int)std::min(slotCount, 16u), (int)std::min((slotCount + 15) / 16, 16u), (int)((slotCount + 255) / 256));
+    glm::ivec3 texels = atlasBricks * SCENE_BAKER_SIDE;
+
+    SceneBrickFileHeader header = {};
+    std::memcpy(header.magic, SCENE_BRICK_FILE_MAGIC, sizeof(header.magic));
+    header.version = SCENE_BRICK_FILE_VERSION;
+    header.brickSize = SCENE_VOLUME_BRICK;
+    header.scene = program.BakedHash();
+    header.cellSize = cellSize;
+    header.error = error;
+    header.reach = reach;
+    for (int k = 0; k < 3; ++k)
+    {
+        header.origin[k] = origin[k];
+        header.bricks[k] = bricks[k];
+        header.atlasBricks[k] = atlasBricks[k];
+    }
+    header.stored = stored;
+    header.distant = distant;
+    header.nodeCount = (uint32_t)nodes.size();
+    header.nodeOffset = BakerAlign(sizeof(header));
+    header.tableOffset = BakerAlign(header.nodeOffset + nodes.size() * sizeof(SceneBrickFileNode));
+    header.atlasOffset = BakerAlign(header.tableOffset + table.size() * sizeof(SceneVolumeBrick));
+    header.fileSize = header.atlasOffset + (uint64_t)texels.x * texels.y * texels.z * sizeof(uint16_t);
+
+    std::vector<char> data(header.fileSize, 0);
+    std::memcpy(data.data(), &header, sizeof(header));
+    if (!nodes.empty())
+        std::memcpy(data.data() + header.nodeOffset, nodes.data(), nodes.size() * sizeof(SceneBrickFileNode));
+    std::memcpy(data.data() + header.tableOffset, table.data(), table.size() * sizeof(SceneVolumeBrick));
+    uint16_t* atlas = (uint16_t*)(data.data() + header.atlasOffset);
+    for (size_t b = 0; b < brickCount; ++b)
+    {
+        if (baked[b].slot != 0)
+            continue;
+        glm::ivec3 first = glm::ivec3(table[b].slot & 0xFF, (table[b].slot >> 8) & 0xFF, table[b].slot >> 16) * SCENE_BAKER_SIDE;
+        for (int k = 0, s = 0; k < SCENE_BAKER_SIDE; ++k)
+            for (int j = 0; j < SCENE_BAKER_SIDE; ++j)
+                for (int i = 0; i < SCENE_BAKER_SIDE; ++i, ++s)
+                    atlas[((size_t)(first.z + k) * texels.y + first.y + j) * texels.x + first.x + i] = baked[b].samples[s];
+    }
+
+    std::ofstream out(options.output.c_str(), std::ios::binary | std::ios::trunc);
+    if (!out.write(data.data(), (std::streamsize)data.size()))
+    {
+        std::cerr << "Could not write " << options.output << std::endl;
+        return 1;
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Scene " << program.name << ": " << bricks.x << "x" << bricks.y << "x" << bricks.z << " bricks, "
+              << stored << " stored, " << distant << " far, " << reused << " reused, in " << (int)ms << " ms on "
+              << threadCount << " threads" << std::endl;
+    return 0;
+}
@@ -0,0 +1,63 @@
+#ifndef SCENE_BRICK_FILE_H
+#define SCENE_BRICK_FILE_H
+
+#include <cstdint>
+#include "sceneVolume.h"
+
+// Brick file written by sceneBaker: a SceneVolume of a scene's baked subtree
+// (SceneProgram::baked), evaluated on the CPU on a grid of bricks aligned to
+// the world origin. SceneVolume::Load maps it and uploads its sections as
+// they are, instead of baking on the GPU. Every section is an array starting
+// on a page boundary:
+//   nodes   SceneBrickFileNode[nodeCount], what the next bake compares against
+//   table   SceneVolumeBrick per grid brick, x fastest, as in SceneVolume:
+//           an atlas slot, SCENE_VOLUME_NEAR or SCENE_VOLUME_FAR
+//   atlas   half float texels of a GL_R16F 3D texture of atlasBricks bricks
+//           of SCENE_VOLUME_BRICK + 1 samples per side, slots packed like
+//           SceneVolume's
+// Samples saturate at `reach`, a brick diagonal past the far band, which
+// keeps them lower bounds of the distance, leaves the sort of bricks as the
+// exact samples give it and lets geometry farther than that leave a brick
+// alone.
+// Little endian, and a new version whenever any of it changes.
+const char     SCENE_BRICK_FILE_MAGIC[8]   = { 'S', 'D', 'F', 'B', 'R', 'I', 'C', 'K' };
+const uint32_t SCENE_BRICK_FILE_VERSION    = 2;
+const uint64_t SCENE_BRICK_FILE_ALIGNMENT  = 4096;
+
+// Node flags
+const uint32_t SCENE_BRICK_NODE_SHARP = 1;   // Sharp union, intersection or difference, its children bound any change to it
+
+struct SceneBrickFileHeader
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t brickSize;         // SCENE_VOLUME_BRICK at bake time
+    uint64_t scene;             // SceneProgram::BakedHash of what was baked
+    float    cellSize;
+    float    error;             // SceneVolume::error, of a trilinear lookup
+    float    reach;             // World-space distance samples saturate at
+    int32_t  origin[3];         // First brick of the grid, in bricks from the world origin
+    int32_t  bricks[3];
+    int32_t  atlasBricks[3];
+    uint32_t stored;            // Bricks with samples
+    uint32_t distant;           // SCENE_VOLUME_FAR bricks
+    uint32_t nodeCount;
+    uint32_t reserved;
+    uint64_t nodeOffset, tableOffset, atlasOffset, fileSize;    // In bytes from the start of the file
+};
+
+// A bounded node of the baked subtree (SceneProgram::nodes). `hash` covers
+// its whole subtree, `shape` the same with the nodes below it left out.
+struct SceneBrickFileNode
+{
+    uint64_t hash, shape;
+    uint32_t flags;
+    uint32_t reserved;
+    float    boundsMin[3], boundsMax[3];
+};
+
+static_assert(sizeof(SceneBrickFileHeader) == 120, "SceneBrickFileHeader layout");
+static_assert(sizeof(SceneBrickFileNode) == 48, "SceneBrickFileNode layout");
+static_assert(sizeof(SceneVolumeBrick) == 8, "SceneVolumeBrick layout");
+
+#endif
@@ -0,0 +1,230 @@
+#include "sceneBvh.h"
+#include <algorithm>
+#include <cstring>
+
+static glm::uvec4 SceneBvhWord(const glm::vec3& bounds, GLuint value)
+{
+    glm::uvec4 word(value);
+    std::memcpy(&word, &bounds, sizeof(bounds));
+    return word;
+}
+
+static float SceneBvhArea(const glm::vec3& bmin, const glm::vec3& bmax)
+{
+    glm::vec3 e = glm::max(bmax - bmin, glm::vec3(0.0f));
+    return e.x * e.y + e.y * e.z + e.z * e.x;
+}
+
+void SceneBvh::AnimatedBounds(const SceneProgram& program, const SceneParams& sceneParams)
+{
+    for (size_t i = 0; i < program.items.size(); ++i)
+        if (program.items[i].animated)
+            program.ItemBounds((int)i, sceneParams, itemMin[i], itemMax[i]);
+    fitParams = sceneParams;
+}
+
+// Binned SAH over the item centroids of slots [begin, end)
+int SceneBvh::BuildNode(int begin, int end, int level)
+{
+    int index = (int)nodes.size();
+    nodes.push_back(Node());
+    depth = std::max(depth, level + 1);
+
+    glm::vec3 bmin(1e30f), bmax(-1e30f), cmin(1e30f), cmax(-1e30f);
+    for (int i = begin; i < end; ++i)
+    {
+        int item = slots[i];
+        bmin = glm::min(bmin, itemMin[item]);
+        bmax = glm::max(bmax, itemMax[item]);
+        glm::vec3 centroid = (itemMin[item] + itemMax[item]) * 0.5f;
+        cmin = glm::min(cmin, centroid);
+        cmax = glm::max(cmax, centroid);
+    }
+    nodes[index].min = bmin;
+    nodes[index].max = bmax;
+
+    int count = end - begin;
+    bool leaf = count <= SCENE_BVH_LEAF_ITEMS || level + 1 >= SCENE_BVH_MAX_DEPTH;
+    int bestAxis = -1, bestSplit = 0;
+    float bestCost = SceneBvhArea(bmin, bmax) * count;     // Cost of a leaf, relative
+    for (int axis = 0; axis < 3 && !leaf; ++axis)
+    {
+        float extent = cmax[axis] - cmin[axis];
+        if (extent <= 0.0f)
+            continue;
+
+        int binCount[SCENE_BVH_BINS] = {};
+        glm::vec3 binMin[SCENE_BVH_BINS], binMax[SCENE_BVH_BINS];
+        std::fill(binMin, binMin + SCENE_BVH_BINS, glm::vec3(1e30f));
+        std::fill(binMax, binMax + SCENE_BVH_BINS, glm::vec3(-1e30f));
+        for (int i = begin; i < end; ++i)
+        {
+            int item = slots[i];
+            float centroid = (itemMin[item][axis] + itemMax[item][axis]) * 0.5f;
+            int bin = std::min(SCENE_BVH_BINS - 1, (int)((centroid - cmin[axis]) / extent * SCENE_BVH_BINS));
+            binCount[bin]++;
+            binMin[bin] = glm::min(binMin[bin], itemMin[item]);
+            binMax[bin] = glm::max(binMax[bin], itemMax[item]);
+        }
+
+        // Sweep from the right for the suffix costs, then from the left
+        float rightCost[SCENE_BVH_BINS];
+        glm::vec3 lo(1e30f), hi(-1e30f);
+        int n = 0;
+        for (int bin = SCENE_BVH_BINS - 1; bin > 0; --bin)
+        {
+            lo = glm::min(lo, binMin[bin]);
+            hi = glm::max(hi, binMax[bin]);
+            n += binCount[bin];
+            rightCost[bin] = n ? SceneBvhArea(lo, hi) * n : 0.0f;
+        }
+        lo = glm::vec3(1e30f);
+        hi = glm::vec3(-1e30f);
+        n = 0;
+        for (int bin = 0; bin < SCENE_BVH_BINS - 1; ++bin)
+        {
+            lo = glm::min(lo, binMin[bin]);
+            hi = glm::max(hi, binMax[bin]);
+            n += binCount[bin];
+            if (n == 0 || n == count)
+                continue;
+            float cost = SceneBvhArea(lo, hi) * n + rightCost[bin + 1];
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = bin + 1;
+            }
+        }
+    }
+
+    int middle = begin;
+    if (!leaf && bestAxis >= 0)
+    {
+        float extent = cmax[bestAxis] - cmin[bestAxis];
+        middle = (int)(std::partition(slots.begin() + begin, slots.begin() + end, [&](int item) {
+            float centroid = (itemMin[item][bestAxis] + itemMax[item][bestAxis]) * 0.5f;
+            return std::min(SCENE_BVH_BINS - 1, (int)((centroid - cmin[bestAxis]) / extent * SCENE_BVH_BINS)) < bestSplit;
+        }) - slots.begin());
+    }
+    else if (!leaf && count > SCENE_BVH_MAX_LEAF)
+    {
+        // No split pays off (or the centroids coincide), halve it anyway
+        middle = begin + count / 2;
+    }
+    if (middle == begin || middle == end)
+    {
+        nodes[index].offset = (GLuint)begin;
+        nodes[index].count = (GLuint)count;
+        return index;
+    }
+
+    BuildNode(begin, middle, level + 1);
+    nodes[index].offset = (GLuint)nodes.size();
+    nodes[index].count = 0;
+    BuildNode(middle, end, level + 1);
+    return index;
+}
+
+void SceneBvh::Build(const SceneProgram& program, const SceneBytecode& bytecode, const SceneParams& sceneParams)
+{
+    nodes.clear();
+    slots.clear();
+    depth = 0;
+    itemMin.clear();
+    itemMax.clear();
+    for (const SceneItem& item : program.items)
+    {
+        itemMin.push_back(item.boundsMin);
+        itemMax.push_back(item.boundsMax);
+        slots.push_back((int)slots.size());
+    }
+    AnimatedBounds(program, sceneParams);
+    if (!slots.empty())
+        BuildNode(0, (int)slots.size(), 0);
+
+    if (!nodeBuffer)
+    {
+        glGenBuffers(1, &nodeBuffer);
+        glGenBuffers(1, &itemBuffer);
+    }
+    std::vector<glm::uvec4> itemSlots;
+    for (int item : slots)
+    {
+        glm::uvec3 range = (size_t)item < bytecode.itemRanges.size() ? bytecode.itemRanges[item] : glm::uvec3(0u);
+        itemSlots.push_back(glm::uvec4((GLuint)item, range));
+    }
+    if (itemSlots.empty())
+        itemSlots.push_back(glm::uvec4(0u));     // Keeps the buffer bindable
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, itemBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, itemSlots.size() * sizeof(glm::uvec4), itemSlots.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SCENE_BVH_ITEM_BINDING, itemBuffer);
+    UploadNodes();
+}
+
+void SceneBvh::Refit(const SceneProgram& program, const SceneParams& sceneParams)
+{
+    if (nodes.empty() || sceneParams == fitParams)
+        return;
+    bool animated = false;
+    for (const SceneItem& item : program.items)
+        animated |= item.animated;
+    if (!animated)
+        return;
+
+    AnimatedBounds(program, sceneParams);
+
+    // Children come after their parents
+    for (size_t i = nodes.size(); i-- > 0;)
+    {
+        Node& node = nodes[i];
+        if (node.count)
+        {
+            node.min = glm::vec3(1e30f);
+            node.max = glm::vec3(-1e30f);
+            for (GLuint k = node.offset; k < node.offset + node.count; ++k)
+            {
+                node.min = glm::min(node.min, itemMin[slots[k]]);
+                node.max = glm::max(node.max, itemMax[slots[k]]);
+            }
+        }
+        else
+        {
+            node.min = glm::min(nodes[i + 1].min, nodes[node.offset].min);
+            node.max = glm::max(nodes[i + 1].max, nodes[node.offset].max);
+        }
+    }
+    UploadNodes();
+}
+
+void SceneBvh::UploadNodes()
+{
+    // Counts as floats would be denormals, which GPUs may flush
+    std::vector<glm::uvec4> words;
+    for (const Node& node : nodes)
+    {
+        words.push_back(SceneBvhWord(node.min, node.offset));
+        words.push_back(SceneBvhWord(node.max, node.count));
+    }
+    if (words.empty())
+        words.resize(2, glm::uvec4(0u));
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, nodeBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, words.size() * sizeof(glm::uvec4), words.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SCENE_BVH_NODE_BINDING, nodeBuffer);
+}
+
+void SceneBvh::Destroy()
+{
+    glDeleteBuffers(1, &nodeBuffer);
+    glDeleteBuffers(1, &itemBuffer);
+    nodeBuffer = itemBuffer = 0;
+}
+
+std::string SceneBvh::ShaderDefines()
+{
+    return "#define SCENE_BVH_STACK " + std::to_string(SCENE_BVH_MAX_DEPTH) + "\n"
+         + "#define SCENE_TILE_CAPACITY " + std::to_string(SCENE_TILE_CAPACITY) + "u\n"
+         + "#define SCENE_NO_TILE 0xFFFFFFFFu\n";
+}
@@ -0,0 +1,72 @@
+#ifndef SCENE_BVH_CLASS_H
+#define SCENE_BVH_CLASS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+#include "sceneCompiler.h"
+#include "sceneBytecode.h"
+#include "sceneParams.h"
+
+const int SCENE_BVH_MAX_DEPTH  = 24;    // Also the size of the shader's traversal stack
+const int SCENE_BVH_LEAF_ITEMS = 2;     // Ranges this small always become leaves
+const int SCENE_BVH_MAX_LEAF   = 16;    // Larger ones are split even when the SAH says otherwise
+const int SCENE_BVH_BINS       = 12;    // SAH split candidates per axis
+
+const GLuint SCENE_BVH_NODE_BINDING = 3;    // SSBO bindings, after the scene bytecode
+const GLuint SCENE_BVH_ITEM_BINDING = 4;
+
+// Per screen tile item lists, filled on the GPU from the BVH after cascade1
+// (see runSceneTileCull). A tile holding more items falls back to the BVH.
+const int    SCENE_TILE_CAPACITY = 128;
+const GLuint SCENE_TILE_BINDING  = 5;
+
+// Bounding volume hierarchy over the items of a large scene (see SceneItem),
+// built on the CPU with a binned SAH. sdfScene walks it with a short stack and
+// only evaluates items in nodes closer than the best distance found so far;
+// the result stays a lower bound of the true distance since everything it
+// skips is farther than that. Nodes are stored depth first, a left child
+// right after its parent, two uvec4 each:
+//   min.xyz (float bits), right child (inner node) or first item slot (leaf)
+//   max.xyz (float bits), item count, 0 for inner nodes
+// Item slots are uvec4 (item, bytecode begin, end, constant window), the
+// compiled programs only read the item.
+class SceneBvh
+{
+    public:
+        struct Node
+        {
+            glm::vec3 min, max;
+            GLuint    offset;
+            GLuint    count;
+        };
+
+        std::vector<Node> nodes;
+        std::vector<int>  slots;        // Item of every leaf slot
+        int               depth = 0;
+
+        bool Empty() const { return nodes.empty(); }
+
+        // Empty for scenes without items; the buffers are created regardless
+        void Build(const SceneProgram& program, const SceneBytecode& bytecode, const SceneParams& sceneParams);
+
+        // Re-evaluates the bounds of animated items once the parameters changed
+        // and refits the nodes above them, the topology stays
+        void Refit(const SceneProgram& program, const SceneParams& sceneParams);
+        void Destroy();
+
+        // SCENE_BVH_STACK and the tile list layout for the shader
+        static std::string ShaderDefines();
+
+    private:
+        std::vector<glm::vec3> itemMin, itemMax;
+        SceneParams            fitParams;
+        GLuint nodeBuffer = 0, itemBuffer = 0;
+
+        void AnimatedBounds(const SceneProgram& program, const SceneParams& sceneParams);
+        int  BuildNode(int begin, int end, int level);
+        void UploadNodes();
+};
+
+#endif
@@ -0,0 +1,237 @@
+#include "sceneBytecode.h"
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <sstream>
+#include <glm/gtc/packing.hpp>
+
+const GLuint SCENE_NO_LOD = 0xFFFFFFFFu;
+
+// GLSL names of SceneOp, the interpreter switches on them
+static const char* sceneOpNames[] =
+{
+    "SOP_POSITION", "SOP_FOOTPRINT", "SOP_CONST", "SOP_PARAM",
+    "SOP_ADD", "SOP_SUB", "SOP_MUL", "SOP_DIV", "SOP_NEG", "SOP_SIN", "SOP_COS",
+    "SOP_TRANSLATE", "SOP_ROTATE", "SOP_MOD1", "SOP_MOD2", "SOP_MOD3", "SOP_MOD_POLAR", "SOP_MOD_GRID2", "SOP_MIRROR",
+    "SOP_SPHERE", "SOP_BOX", "SOP_BOX_CHEAP", "SOP_PLANE", "SOP_CYLINDER", "SOP_CAPSULE", "SOP_TORUS", "SOP_CONE",
+    "SOP_OCTAHEDRON", "SOP_DODECAHEDRON", "SOP_ICOSAHEDRON", "SOP_JULIA",
+    "SOP_UNION", "SOP_INTERSECTION", "SOP_DIFFERENCE",
+    "SOP_UNION_ROUND", "SOP_INTERSECTION_ROUND", "SOP_DIFFERENCE_ROUND",
+    "SOP_UNION_CHAMFER", "SOP_INTERSECTION_CHAMFER", "SOP_DIFFERENCE_CHAMFER",
+    "SOP_UNION_STAIRS", "SOP_INTERSECTION_STAIRS", "SOP_DIFFERENCE_STAIRS",
+    "SOP_UNION_SOFT",
+    "SOP_SCALE_DIST", "SOP_OFFSET_DIST"
+};
+static_assert(sizeof(sceneOpNames) / sizeof(sceneOpNames[0]) == SOP_COUNT, "sceneOpNames out of sync with SceneOp");
+
+static GLuint FloatBits(float value)
+{
+    GLuint bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+// Half float no smaller than a SceneInstr::stretch, so the ranges the bounds
+// are taken over only grow
+static GLuint StretchBits(float stretch)
+{
+    stretch = std::min(stretch, 65504.0f);
+    GLuint bits = glm::packHalf1x16(stretch);
+    if (glm::unpackHalf1x16((glm::uint16)bits) < stretch)
+        bits++;
+    return bits;
+}
+
+static bool SceneOpUsesAxes(SceneOp op)
+{
+    return op == SOP_ROTATE || op == SOP_MOD1 || op == SOP_MOD2 || op == SOP_MOD_POLAR || op == SOP_MOD_GRID2 || op == SOP_MIRROR;
+}
+
+bool SceneBytecode::Assemble(const SceneProgram& program)
+{
+    code.clear();
+    constants.clear();
+    itemRanges.clear();
+    registersUsed = 2 + SCENE_PARAM_COUNT;
+    error.clear();
+
+    const int count = (int)program.code.size();
+    std::vector<int> lastUse(count, -1);
+    for (int i = 0; i < count; ++i)
+        for (int k = 0; k < 4; ++k)
+            if (program.code[i].args[k] >= 0)
+                lastUse[program.code[i].args[k]] = i;
+
+    std::map<std::vector<float>, int> constantSlots;
+    size_t constantWindow = 0;
+    bool constantsFit = true;
+    auto Constant = [&](const glm::vec4& value) -> int
+    {
+        std::vector<float> key = { value.x, value.y, value.z, value.w };
+        auto found = constantSlots.find(key);
+        if (found != constantSlots.end())
+            return found->second;
+        constants.push_back(value);
+        constantsFit &= constants.size() - constantWindow <= (size_t)SCENE_MAX_CONSTANTS;
+        return constantSlots[key] = SCENE_REGISTERS + (int)(constants.size() - 1 - constantWindow);
+    };
+
+    // Operand slot of every value; leaves never occupy an allocated register
+    std::vector<int> slot(count, 0);
+    std::vector<bool> freeRegister(SCENE_REGISTERS, false);
+    for (int r = 2 + SCENE_PARAM_COUNT; r < SCENE_REGISTERS; ++r)
+        freeRegister[r] = true;
+
+    for (int i = 0; i < count; ++i)
+    {
+        const SceneInstr& in = program.code[i];
+        switch (in.op)
+        {
+            case SOP_POSITION:  slot[i] = 0; continue;
+            case SOP_FOOTPRINT: slot[i] = 1; continue;
+            case SOP_CONST:
+                slot[i] = Constant(in.type == SVT_FLOAT ? glm::vec4(in.imm[0]) : glm::vec4(in.imm[0], in.imm[1], in.imm[2], 0.0f));
+                continue;
+            case SOP_PARAM:
+            {
+                const std::string& name = program.params[(int)in.imm[0]];
+                for (int k = 0; k < SCENE_PARAM_COUNT; ++k)
+                    if (name == SCENE_PARAM_NAMES[k])
+                        slot[i] = 2 + k;
+                continue;
+            }
+            default: break;
+        }
+
+        glm::uvec4 word(in.op, 0u, 0u, SCENE_NO_LOD);
+        if (SceneOpUsesAxes(in.op))
+            word.x |= (GLuint)in.imm[0] << 16 | (GLuint)in.imm[1] << 24;
+        if (in.type == SVT_DIST)
+            word.x |= StretchBits(in.stretch) << 16;
+        if (in.type == SVT_DIST && in.op >= SOP_SPHERE && in.op <= SOP_JULIA)
+        {
+            word.z = FloatBits(in.imm[0]);
+            if (in.imm[5] > 0.0f)
+            {
+                // Proxy and detail size have to be adjacent, so they bypass the sharing
+                word.w = (GLuint)constants.size();
+                constants.push_back(glm::vec4(in.imm[1], in.imm[2], in.imm[3], in.imm[4]));
+                constants.push_back(glm::vec4(in.imm[5]));
+            }
+        }
+        for (int k = 0; k < 4; ++k)
+            if (in.args[k] >= 0)
+                word.y |= (GLuint)slot[in.args[k]] << (8 * k);
+
+        // Operands dying here free their register before the result takes
+        // one; the interpreter reads every operand before it writes
+        for (int k = 0; k < 4; ++k)
+        {
+            int arg = in.args[k];
+            if (arg >= 0 && lastUse[arg] == i && slot[arg] >= 2 + SCENE_PARAM_COUNT && slot[arg] < SCENE_REGISTERS)
+                freeRegister[slot[arg]] = true;
+        }
+        int destination = -1;
+        for (int r = 2 + SCENE_PARAM_COUNT; r < SCENE_REGISTERS && destination < 0; ++r)
+            if (freeRegister[r])
+                destination = r;
+        if (destination < 0)
+        {
+            error = "needs more than " + std::to_string(SCENE_REGISTERS) + " registers";
+            code.clear();
+            return false;
+        }
+        freeRegister[destination] = false;
+        registersUsed = std::max(registersUsed, destination + 1);
+        slot[i] = destination;
+        word.x |= (GLuint)destination << 8;
+        code.push_back(word);
+
+        // An item's result is read by the BVH traversal right after its range
+        if (itemRanges.size() < program.items.size() && program.items[itemRanges.size()].root == i)
+        {
+            GLuint begin = itemRanges.empty() ? 0u : itemRanges.back().y;
+            itemRanges.push_back(glm::uvec3(begin, (GLuint)code.size(), (GLuint)constantWindow));
+            freeRegister[destination] = true;
+            constantWindow = constants.size();
+            constantSlots.clear();
+        }
+    }
+
+    if (!constantsFit)
+    {
+        error = "needs more than " + std::to_string(SCENE_MAX_CONSTANTS) + (itemRanges.empty() ? " constants" : " constants in an item");
+        code.clear();
+        return false;
+    }
+    if (constants.empty())
+        constants.push_back(glm::vec4(0.0f));   // Keeps the buffer bindable
+
+    boundSphere = program.boundSphere;
+    boundsMin.assign(SCENE_MAX_BOUNDED_NODES, glm::vec4(0.0f));
+    boundsMax.assign(SCENE_MAX_BOUNDED_NODES, glm::vec4(0.0f));
+    for (size_t i = 0; i < program.boundsMin.size() && i < (size_t)SCENE_MAX_BOUNDED_NODES; ++i)
+    {
+        boundsMin[i] = glm::vec4(program.boundsMin[i], 0.0f);
+        boundsMax[i] = glm::vec4(program.boundsMax[i], 0.0f);
+    }
+    boundedNodes = (GLuint)std::min(program.boundsMin.size(), (size_t)SCENE_MAX_BOUNDED_NODES);
+    cells = program.cells;
+    return true;
+}
+
+void SceneBytecode::Upload()
+{
+    if (!codeBuffer)
+    {
+        glGenBuffers(1, &codeBuffer);
+        glGenBuffers(1, &constantBuffer);
+    }
+
+    // Header, std430 layout of SceneCode in computeShader.comp
+    std::vector<glm::uvec4> words;
+    words.push_back(glm::uvec4((GLuint)code.size(), boundedNodes, itemRanges.empty() ? 0u : 1u, (GLuint)cells.size()));
+    words.push_back(glm::uvec4(FloatBits(boundSphere.x), FloatBits(boundSphere.y), FloatBits(boundSphere.z), FloatBits(boundSphere.w)));
+    for (const std::vector<glm::vec4>* bounds : { &boundsMin, &boundsMax })
+        for (const glm::vec4& b : *bounds)
+            words.push_back(glm::uvec4(FloatBits(b.x), FloatBits(b.y), FloatBits(b.z), 0u));
+    std::vector<SceneCell> cellSlots = cells;
+    cellSlots.resize(SCENE_MAX_CELLS, SceneCell());
+    for (const SceneCell& cell : cellSlots)
+        for (const glm::vec4& row : { cell.toLocal[0], cell.toLocal[1], cell.toLocal[2], cell.period, cell.freeMin, cell.freeMax, cell.boundsMin, cell.boundsMax })
+            words.push_back(glm::uvec4(FloatBits(row.x), FloatBits(row.y), FloatBits(row.z), FloatBits(row.w)));
+    words.insert(words.end(), code.begin(), code.end());
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, codeBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, words.size() * sizeof(glm::uvec4), words.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, constantBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, constants.size() * sizeof(glm::vec4), constants.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SCENE_CODE_BINDING, codeBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SCENE_CONSTANT_BINDING, constantBuffer);
+}
+
+void SceneBytecode::Destroy()
+{
+    glDeleteBuffers(1, &codeBuffer);
+    glDeleteBuffers(1, &constantBuffer);
+    codeBuffer = constantBuffer = 0;
+}
+
+std::string SceneBytecode::ShaderDefines()
+{
+    std::stringstream out;
+    out << "#define SCENE_INTERPRETED\n";
+    out << "#define SCENE_REGISTERS " << SCENE_REGISTERS << "\n";
+    out << "#define SCENE_MAX_BOUNDED_NODES " << SCENE_MAX_BOUNDED_NODES << "\n";
+    out << "#define SCENE_MAX_CELLS " << SCENE_MAX_CELLS << "\n";
+    out << "#define SCENE_NO_LOD 0x" << std::hex << SCENE_NO_LOD << std::dec << "u\n";
+    out << "#define SCENE_LOAD_PARAMS(r)";
+    for (int k = 0; k < SCENE_PARAM_COUNT; ++k)
+        out << " r[" << 2 + k << "] = vec4(u_" << SCENE_PARAM_NAMES[k] << ", 0.0);";
+    out << "\n";
+    for (int op = 0; op < SOP_COUNT; ++op)
+        out << "#define " << sceneOpNames[op] << " " << op << "u\n";
+    return out.str();
+}
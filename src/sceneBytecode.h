@@ -0,0 +1,59 @@
+#ifndef SCENE_BYTECODE_CLASS_H
+#define SCENE_BYTECODE_CLASS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+#include "sceneCompiler.h"
+
+// Register file of the shader's scene interpreter. r0 holds the point, r1 the
+// footprint, the next SCENE_PARAM_COUNT registers the SceneParams uniforms;
+// the rest are allocated to instruction results.
+const int SCENE_REGISTERS     = 16;
+const int SCENE_MAX_CONSTANTS = 256 - SCENE_REGISTERS;     // Operand slots are 8 bits
+
+const GLuint SCENE_CODE_BINDING     = 1;   // SSBO bindings, 0 is the hit list
+const GLuint SCENE_CONSTANT_BINDING = 2;
+
+// A SceneProgram assembled into the bytecode the SCENE_INTERPRETED shader
+// variant runs, so a scene edit is a buffer upload instead of a shader build.
+// Instructions are uvec4:
+//   x  opcode | destination register << 8 | plane axes << 16 and << 24, for
+//      distances their SceneInstr::stretch as a half float << 16 instead
+//   y  four 8-bit operand slots, a register below SCENE_REGISTERS, else a constant
+//      of the current window (the whole table, or the item's with a BVH)
+//   z  material of a primitive (float bits)
+//   w  constant slot of the LOD proxy sphere, the detail size in the next one; ~0u without LOD
+// The code buffer starts with the instruction count, whether the scene has a
+// BVH, the cell count, the clipping bounds and the cells. With a BVH every item is a range of the code
+// with a constant window of its own, so only single items are size limited.
+class SceneBytecode
+{
+    public:
+        std::vector<glm::uvec4> code;
+        std::vector<glm::vec4>  constants;      // Floats are broadcast to xyzw
+        std::vector<glm::uvec3> itemRanges;     // [begin, end) and constant window per SceneProgram item
+        int                     registersUsed = 0;
+        std::string             error;
+
+        bool Empty() const { return code.empty(); }
+
+        // False (and empty) when the program needs more registers or constants
+        // than the encoding has; the compiled variant still runs it
+        bool Assemble(const SceneProgram& program);
+        void Upload();                          // Creates the buffers on first use and binds them
+        void Destroy();
+
+        // SCENE_INTERPRETED, the opcodes and the register layout for the shader
+        static std::string ShaderDefines();
+
+    private:
+        glm::vec4              boundSphere = glm::vec4(0.0f);
+        std::vector<glm::vec4> boundsMin, boundsMax;
+        GLuint                 boundedNodes = 0;
+        std::vector<SceneCell> cells;
+        GLuint codeBuffer = 0, constantBuffer = 0;
+};
+
+#endif
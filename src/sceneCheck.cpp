@@ -0,0 +1,229 @@
+// CPU check of a scene file against what the renderer assumes of it:
+//
+//   sceneCheck <scene> [--builtin] [--samples n]
+//
+// Over n³ points around the scene and pairs of scene times it checks that
+// every point whose side of the surface changed between the two lies in
+// SceneProgram::ChangedRegion, with and without clipping, so partial
+// redraws never leave stale pixels. Rays marched into the scene check the
+// Lipschitz bounds its steps take: the distance may not fall faster than
+// the bound along a step. With --builtin the scene must be the one the
+// shader's built-in sdfScene hard-codes (Scenes/julia.scene): its distance
+// and material are compared to that formula at every point, and its
+// changed region to the cut box the built-in scene would redraw.
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <glm/glm.hpp>
+
+#include "sceneParams.h"
+#include "sceneParams.cpp"
+#include "sceneCompiler.h"
+#include "sceneCompiler.cpp"
+
+const int   SCENE_CHECK_SAMPLES = 48;       // Along each side of the sampled box, without --samples
+const int   SCENE_CHECK_TIMES   = 64;       // Pairs of scene times
+const float SCENE_CHECK_STEP    = 0.3f;     // Between the first times of two pairs
+const float SCENE_CHECK_DELTA   = 2.0f;     // Between the two times of a pair, far enough apart to move the surface past samples
+const float SCENE_CHECK_MARGIN  = 0.25f;    // Sampled box reaches this fraction of its widest side past the bounds
+const float SCENE_CHECK_REACH   = 8.0f;     // Half side of the sampled box of unbounded scenes
+const float SCENE_CHECK_EPSILON = 1e-5f;    // Relative distance error the built-in comparison allows
+const int   SCENE_CHECK_RAYS    = 4096;     // Marches checking the Lipschitz bounds
+const float SCENE_CHECK_HIT     = 1e-3f;    // Distance those marches stop at
+const int   SCENE_CHECK_SUBSTEPS = 8;       // Points along each step the bound is checked at
+
+// Distance and material of the shader's built-in sdfSceneSegment
+static glm::vec2 BuiltinScene(const glm::vec3& p, const SceneParams& sceneParams)
+{
+    float dJulia = SceneJulia(p);
+    float dCut = -SceneBox(p - sceneParams.cutCenter, sceneParams.cutHalfSize);
+    return dJulia > dCut ? glm::vec2(dJulia, 1.0f) : glm::vec2(dCut, 2.0f);
+}
+
+// Region the built-in scene's only moving node, the cut, changes between two
+// parameter sets: its old and new box, within the Julia bounds when clipped
+static bool BuiltinChangedRegion(const SceneParams& previous, const SceneParams& current, bool clipped,
+                                 glm::vec3& bmin, glm::vec3& bmax)
+{
+    if (previous == current)
+        return false;
+    bmin = glm::min(previous.cutCenter - previous.cutHalfSize, current.cutCenter - current.cutHalfSize);
+    bmax = glm::max(previous.cutCenter + previous.cutHalfSize, current.cutCenter + current.cutHalfSize);
+    if (clipped)
+    {
+        bmin = glm::max(bmin, SCENE_JULIA_BOUNDS_MIN);
+        bmax = glm::min(bmax, SCENE_JULIA_BOUNDS_MAX);
+    }
+    return bmin.x <= bmax.x && bmin.y <= bmax.y && bmin.z <= bmax.z;
+}
+
+static bool InsideBox(const glm::vec3& p, const glm::vec3& bmin, const glm::vec3& bmax)
+{
+    return glm::all(glm::greaterThanEqual(p, bmin)) && glm::all(glm::lessThanEqual(p, bmax));
+}
+
+int main(int argc, char** argv)
+{
+    std::string scene;
+    bool builtin = false;
+    int samples = SCENE_CHECK_SAMPLES;
+    bool ok = true;
+    for (int i = 1; i < argc && ok; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--builtin")
+            builtin = true;
+        else if (arg == "--samples" && i + 1 < argc)
+            ok = (samples = std::atoi(argv[++i])) >= 2;
+        else if (arg.compare(0, 2, "--") == 0 || !scene.empty())
+            ok = false;
+        else
+            scene = arg;
+    }
+    if (!ok || scene.empty())
+    {
+        std::cerr << "Usage: sceneCheck <scene> [--builtin] [--samples n]" << std::endl;
+        return 1;
+    }
+
+    SceneCompiler compiler;
+    SceneProgram program;
+    if (!compiler.CompileFile(scene, program))
+    {
+        std::cerr << "Scene compile FAILED: " << compiler.error << std::endl;
+        return 1;
+    }
+
+    // The clipping boxes, what the march sees with per-node clipping
+    glm::vec3 boundsMin(SCENE_UNBOUNDED), boundsMax(-SCENE_UNBOUNDED);
+    for (size_t i = 0; i < program.boundsMin.size(); ++i)
+    {
+        boundsMin = glm::min(boundsMin, program.boundsMin[i]);
+        boundsMax = glm::max(boundsMax, program.boundsMax[i]);
+    }
+    boundsMin = glm::max(boundsMin, glm::vec3(-SCENE_CHECK_REACH));
+    boundsMax = glm::min(boundsMax, glm::vec3(SCENE_CHECK_REACH));
+    glm::vec3 margin = glm::vec3(SCENE_CHECK_MARGIN * SceneVMax(boundsMax - boundsMin));
+    glm::vec3 sampleMin = boundsMin - margin, sampleMax = boundsMax + margin;
+    auto clippedIn = [&](const glm::vec3& p)
+    {
+        for (size_t i = 0; i < program.boundsMin.size(); ++i)
+            if (InsideBox(p, program.boundsMin[i], program.boundsMax[i]))
+                return true;
+        return program.boundsMin.empty();
+    };
+
+    std::vector<glm::vec3> points;
+    for (int k = 0; k < samples; ++k)
+        for (int j = 0; j < samples; ++j)
+            for (int i = 0; i < samples; ++i)
+                points.push_back(glm::mix(sampleMin, sampleMax, (glm::vec3(i, j, k) + 0.5f) / (float)samples));
+
+    int distanceErrors = 0, regionErrors = 0, builtinRegionErrors = 0, flips = 0;
+    float worstError = 0.0f;
+    for (int t = 0; t < SCENE_CHECK_TIMES; ++t)
+    {
+        SceneParams previous, current;
+        previous.Evaluate(t * SCENE_CHECK_STEP);
+        current.Evaluate(t * SCENE_CHECK_STEP + SCENE_CHECK_DELTA);
+
+        glm::vec3 regionMin[2], regionMax[2];
+        bool visible[2];
+        for (int clipped = 0; clipped < 2; ++clipped)
+        {
+            visible[clipped] = program.ChangedRegion(previous, current, clipped != 0, regionMin[clipped], regionMax[clipped]);
+            if (!builtin)
+                continue;
+            glm::vec3 expectedMin, expectedMax;
+            bool expected = BuiltinChangedRegion(previous, current, clipped != 0, expectedMin, expectedMax);
+            if (expected != visible[clipped] || (expected && (glm::any(glm::greaterThan(glm::abs(expectedMin - regionMin[clipped]), glm::vec3(SCENE_CHECK_EPSILON)))
+                                                           || glm::any(glm::greaterThan(glm::abs(expectedMax - regionMax[clipped]), glm::vec3(SCENE_CHECK_EPSILON))))))
+                ++builtinRegionErrors;
+        }
+
+        for (size_t i = 0; i < points.size(); ++i)
+        {
+            const glm::vec3& p = points[i];
+            glm::vec3 now = program.Evaluate(p, 0.0f, current);
+            if (builtin)
+            {
+                glm::vec2 expected = BuiltinScene(p, current);
+                float error = std::abs(now.x - expected.x) / (1.0f + std::abs(expected.x));
+                worstError = std::max(worstError, error);
+                // Materials only differ by rounding where both sides are as close
+                bool tie = std::abs(SceneJulia(p) + SceneBox(p - current.cutCenter, current.cutHalfSize)) <= SCENE_CHECK_EPSILON;
+                if (error > SCENE_CHECK_EPSILON || (now.y != expected.y && !tie))
+                    ++distanceErrors;
+            }
+
+            // A point that crossed the surface lies in the region, and in the
+            // clipped one when the march sees it
+            float then = program.Evaluate(p, 0.0f, previous).x;
+            if ((then < 0.0f) == (now.x < 0.0f))
+                continue;
+            ++flips;
+            if (!visible[0] || !InsideBox(p, regionMin[0], regionMax[0]))
+                ++regionErrors;
+            else if (clippedIn(p) && (!visible[1] || !InsideBox(p, regionMin[1], regionMax[1])))
+                ++regionErrors;
+        }
+    }
+
+    // Marches from a sphere around the scene towards its centre, each step
+    // as long as the Lipschitz bound over the segment allows: the distance
+    // along the step may not fall by more than the bound lets it, or the step
+    // could have passed the surface. Repetition cells each see their own copy,
+    // so the distance jumps between them and CellStep keeps those steps safe
+    // instead; scenes with cells skip this.
+    SceneParams sceneParams;
+    sceneParams.Evaluate(0.0f);
+    glm::vec3 centre = 0.5f * (boundsMin + boundsMax);
+    int steps = 0, lipschitzErrors = 0;
+    float worstSlope = 0.0f;
+    for (int r = 0; r < SCENE_CHECK_RAYS && program.cells.empty(); ++r)
+    {
+        // Fibonacci sphere
+        float y = 1.0f - 2.0f * (r + 0.5f) / SCENE_CHECK_RAYS;
+        float angle = r * 2.3999632f;
+        glm::vec3 dir = -glm::vec3(std::cos(angle) * std::sqrt(1.0f - y * y), y, std::sin(angle) * std::sqrt(1.0f - y * y));
+        glm::vec3 p = centre - SCENE_CHECK_REACH * dir;
+        for (float t = 0.0f; t < 2.0f * SCENE_CHECK_REACH; ++steps)
+        {
+            float d = program.Evaluate(p, 0.0f, sceneParams).x;
+            if (d < SCENE_CHECK_HIT)
+                break;
+            float lipschitz = program.Evaluate(p, 0.0f, sceneParams, d).z;
+            float step = d / lipschitz;
+            for (int k = 1; k <= SCENE_CHECK_SUBSTEPS; ++k)
+            {
+                float along = step * k / SCENE_CHECK_SUBSTEPS;
+                float slope = (d - program.Evaluate(p + along * dir, 0.0f, sceneParams).x) / along;
+                worstSlope = std::max(worstSlope, slope / lipschitz);
+                if (slope > lipschitz + SCENE_CHECK_HIT / along)    // Landing within the hit distance is a hit
+                {
+                    ++lipschitzErrors;
+                    break;
+                }
+            }
+            p += step * dir;
+            t += step;
+        }
+    }
+
+    std::cout << "Scene " << program.name << ": " << points.size() << " points at " << SCENE_CHECK_TIMES << " time pairs, "
+              << flips << " crossed the surface, " << regionErrors << " outside the changed region" << std::endl;
+    if (!program.cells.empty())
+        std::cout << "Marches: skipped, the scene repeats in cells" << std::endl;
+    else
+        std::cout << "Marches: " << steps << " steps, steepest descent " << worstSlope << " of the Lipschitz bound, "
+                  << lipschitzErrors << " steps falling faster" << std::endl;
+    if (builtin)
+        std::cout << "Built-in sdfScene: largest relative distance error " << worstError << ", " << distanceErrors
+                  << " points differ, " << builtinRegionErrors << " changed regions differ" << std::endl;
+    bool passed = regionErrors == 0 && lipschitzErrors == 0 && distanceErrors == 0 && builtinRegionErrors == 0;
+    std::cout << (passed ? "Check passed" : "Check FAILED") << std::endl;
+    return passed ? 0 : 1;
+}
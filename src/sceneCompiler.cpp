@@ -0,0 +1,2901 @@
+#include "sceneCompiler.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <map>
+#include <algorithm>
+
+const float SCENE_PI        = 3.14159265f;  // hg_sdf's PI
+const float SCENE_UNBOUNDED = 1e5f;         // Bounds coordinate standing in for infinity
+
+// JULIA_LIPSCHITZ, JULIA_RADIUS and JULIA_FAR_LIPSCHITZ in the shader
+const float SCENE_JULIA_LIPSCHITZ     = 1.5f;
+const float SCENE_JULIA_RADIUS        = 1.2f;
+const float SCENE_JULIA_FAR_LIPSCHITZ = 0.7f;
+const int   SCENE_JULIA_INTERVAL_ITERATIONS = 12;   // JULIA_INTERVAL_ITERATIONS
+
+const float SCENE_BAKE_MARGIN = 0.25f;      // Baked volumes reach this fraction of their widest side past the geometry
+
+// ──────────────────────────────────────────────────────────────────────── //
+//                             hg_sdf ON THE CPU                            //
+// ──────────────────────────────────────────────────────────────────────── //
+
+// GLSL mod, unlike fmod it follows the sign of y
+static float SceneMod(float x, float y)
+{
+    return x - y * std::floor(x / y);
+}
+
+static float SceneVMax(const glm::vec3& v)
+{
+    return std::max(std::max(v.x, v.y), v.z);
+}
+
+static float SceneVMin(const glm::vec3& v)
+{
+    return std::min(std::min(v.x, v.y), v.z);
+}
+
+static float SceneBox(const glm::vec3& p, const glm::vec3& b)
+{
+    glm::vec3 d = glm::abs(p) - b;
+    return glm::length(glm::max(d, glm::vec3(0.0f))) + SceneVMax(glm::min(d, glm::vec3(0.0f)));
+}
+
+static float SceneCone(const glm::vec3& p, float radius, float height)
+{
+    glm::vec2 q(glm::length(glm::vec2(p.x, p.z)), p.y);
+    glm::vec2 tip = q - glm::vec2(0.0f, height);
+    glm::vec2 mantleDir = glm::normalize(glm::vec2(height, radius));
+    float mantle = glm::dot(tip, mantleDir);
+    float d = std::max(mantle, -q.y);
+    float projected = glm::dot(tip, glm::vec2(mantleDir.y, -mantleDir.x));
+
+    if (q.y > height && projected < 0.0f)
+        d = std::max(d, glm::length(tip));
+    if (q.x > radius && projected > glm::length(glm::vec2(height, radius)))
+        d = std::max(d, glm::length(q - glm::vec2(radius, 0.0f)));
+    return d;
+}
+
+// fGDF without exponent over GDFVectors[begin..end]
+static float SceneGDF(const glm::vec3& p, float r, int begin, int end)
+{
+    const float phi = std::sqrt(5.0f) * 0.5f + 0.5f;
+    static const glm::vec3 vectors[19] = {
+        glm::normalize(glm::vec3(1, 0, 0)),  glm::normalize(glm::vec3(0, 1, 0)),   glm::normalize(glm::vec3(0, 0, 1)),
+        glm::normalize(glm::vec3(1, 1, 1)),  glm::normalize(glm::vec3(-1, 1, 1)),  glm::normalize(glm::vec3(1, -1, 1)),
+        glm::normalize(glm::vec3(1, 1, -1)),
+        glm::normalize(glm::vec3(0, 1, phi + 1)),  glm::normalize(glm::vec3(0, -1, phi + 1)),
+        glm::normalize(glm::vec3(phi + 1, 0, 1)),  glm::normalize(glm::vec3(-phi - 1, 0, 1)),
+        glm::normalize(glm::vec3(1, phi + 1, 0)),  glm::normalize(glm::vec3(-1, phi + 1, 0)),
+        glm::normalize(glm::vec3(0, phi, 1)),  glm::normalize(glm::vec3(0, -phi, 1)),
+        glm::normalize(glm::vec3(1, 0, phi)),  glm::normalize(glm::vec3(-1, 0, phi)),
+        glm::normalize(glm::vec3(phi, 1, 0)),  glm::normalize(glm::vec3(-phi, 1, 0))
+    };
+    float d = 0.0f;
+    for (int i = begin; i <= end; ++i)
+        d = std::max(d, std::abs(glm::dot(p, vectors[i])));
+    return d - r;
+}
+
+// Julia set distance estimator, JS(p).r in the shader
+static float SceneJulia(const glm::vec3& p)
+{
+    const glm::vec4 c = glm::vec4(-2.0f, 6.0f, 15.0f, -6.0f) / 22.0f;
+    glm::vec4 z(p, 0.0f);
+    float dz2 = 1.0f;
+    float m2  = 0.0f;
+    float linear2 = 1e30f;
+    for (int i = 0; i < 200; ++i)
+    {
+        // The estimate only holds while z³ stays near linear, see JS
+        if (glm::dot(z, z) < 1.0f)
+            linear2 = std::min(linear2, 0.25f * glm::dot(z, z) / dz2);
+
+        // |z'|² *= 9|z²|²
+        glm::vec3 v(z.y, z.z, z.w);
+        glm::vec4 z2(z.x * z.x - glm::dot(v, v), 2.0f * z.x * v);
+        dz2 *= 9.0f * glm::dot(z2, z2);
+
+        // z = z³ + c
+        glm::vec4 q2 = z * z;
+        glm::vec3 yzw = v * (3.0f * q2.x - q2.y - q2.z - q2.w);
+        z = glm::vec4(z.x * (q2.x - 3.0f * q2.y - 3.0f * q2.z - 3.0f * q2.w), yzw) + c;
+
+        m2 = glm::dot(z, z);
+        if (m2 > 256.0f)
+            break;
+    }
+    return std::min(0.25f * std::log(m2) * std::sqrt(m2 / dz2), std::sqrt(linear2));
+}
+
+static void SceneModPolar(float& u, float& v, float repetitions)
+{
+    float angle = 2.0f * SCENE_PI / repetitions;
+    float a = std::atan2(v, u) + angle / 2.0f;
+    float r = std::sqrt(u * u + v * v);
+    a = SceneMod(a, angle) - angle / 2.0f;
+    u = std::cos(a) * r;
+    v = std::sin(a) * r;
+}
+
+static void SceneModGrid2(float& u, float& v, float sizeU, float sizeV)
+{
+    float cu = std::floor((u + sizeU * 0.5f) / sizeU);
+    float cv = std::floor((v + sizeV * 0.5f) / sizeV);
+    u = SceneMod(u + sizeU * 0.5f, sizeU) - sizeU * 0.5f;
+    v = SceneMod(v + sizeV * 0.5f, sizeV) - sizeV * 0.5f;
+    u *= SceneMod(cu, 2.0f) * 2.0f - 1.0f;
+    v *= SceneMod(cv, 2.0f) * 2.0f - 1.0f;
+    u -= sizeU / 2.0f;
+    v -= sizeV / 2.0f;
+    if (u > v)
+        std::swap(u, v);
+}
+
+static float SceneUnionStairs(float a, float b, float r, float n)
+{
+    float s = r / n;
+    float u = b - r;
+    return std::min(std::min(a, b), 0.5f * (u + a + std::abs(SceneMod(u - a + s, 2.0f * s) - s)));
+}
+
+static float SceneIntersectionRound(float a, float b, float r)
+{
+    glm::vec2 u = glm::max(glm::vec2(r + a, r + b), glm::vec2(0.0f));
+    return std::min(-r, std::max(a, b)) + glm::length(u);
+}
+
+static float SceneIntersectionChamfer(float a, float b, float r)
+{
+    return std::max(std::max(a, b), (a + r + b) * std::sqrt(0.5f));
+}
+
+// ──────────────────────────────────────────────────────────────────────── //
+//                             LIPSCHITZ BOUNDS                             //
+// ──────────────────────────────────────────────────────────────────────── //
+
+// Bounds of a combinator within a ball of radius s from its operands' values
+// at the centre and their bounds, lipschitzUnion etc. in the shader. An
+// operand that stays above another one's upper bound is never the minimum.
+static float SceneLipschitzUnion(float a, float la, float b, float lb, float s)
+{
+    float upper = std::min(a + la * s, b + lb * s);
+    return std::max(a - la * s <= upper ? la : 0.0f, b - lb * s <= upper ? lb : 0.0f);
+}
+
+static float SceneLipschitzIntersection(float a, float la, float b, float lb, float s)
+{
+    float lower = std::max(a - la * s, b - lb * s);
+    return std::max(a + la * s >= lower ? la : 0.0f, b + lb * s >= lower ? lb : 0.0f);
+}
+
+static float SceneLipschitzUnionRound(float a, float la, float b, float lb, float r, float s)
+{
+    return a - la * s < r && b - lb * s < r ? glm::length(glm::vec2(la, lb)) : SceneLipschitzUnion(a, la, b, lb, s);
+}
+
+static float SceneLipschitzIntersectionRound(float a, float la, float b, float lb, float r, float s)
+{
+    return a + la * s > -r && b + lb * s > -r ? glm::length(glm::vec2(la, lb)) : SceneLipschitzIntersection(a, la, b, lb, s);
+}
+
+static float SceneLipschitzUnionChamfer(float a, float la, float b, float lb, float r, float s)
+{
+    float chamfer = (la + lb) * std::sqrt(0.5f);
+    float upper = std::min(a + la * s, b + lb * s);
+    return (a - r + b) * std::sqrt(0.5f) - chamfer * s <= upper ? std::max(std::max(la, lb), chamfer) : SceneLipschitzUnion(a, la, b, lb, s);
+}
+
+static float SceneLipschitzIntersectionChamfer(float a, float la, float b, float lb, float r, float s)
+{
+    float chamfer = (la + lb) * std::sqrt(0.5f);
+    float lower = std::max(a - la * s, b - lb * s);
+    return (a + r + b) * std::sqrt(0.5f) + chamfer * s >= lower ? std::max(std::max(la, lb), chamfer) : SceneLipschitzIntersection(a, la, b, lb, s);
+}
+
+static float SceneLipschitzJulia(const glm::vec3& p, float s)
+{
+    float r = glm::length(p);
+    return std::max(r - s > SCENE_JULIA_RADIUS ? 1.0f : SCENE_JULIA_LIPSCHITZ, 0.5f * std::log(std::max(r + s, 1.0f)) + SCENE_JULIA_FAR_LIPSCHITZ);
+}
+
+// ──────────────────────────────────────────────────────────────────────── //
+//                                EVALUATION                                //
+// ──────────────────────────────────────────────────────────────────────── //
+
+// Register layout on the CPU: floats are broadcast to xyz, so they combine
+// with vec3 values componentwise; distances keep (distance, material) in xy
+// and their Lipschitz bound within the segment in z.
+static bool SceneIsUnionOp(SceneOp op)
+{
+    return op == SOP_UNION || op == SOP_UNION_ROUND || op == SOP_UNION_CHAMFER || op == SOP_UNION_STAIRS || op == SOP_UNION_SOFT;
+}
+
+static bool SceneIsDifferenceOp(SceneOp op)
+{
+    return op == SOP_DIFFERENCE || op == SOP_DIFFERENCE_ROUND || op == SOP_DIFFERENCE_CHAMFER || op == SOP_DIFFERENCE_STAIRS;
+}
+
+static bool SceneIsCombinator(SceneOp op)
+{
+    return op >= SOP_UNION && op <= SOP_UNION_SOFT;
+}
+
+static bool SceneIsPrimitive(SceneOp op)
+{
+    return op >= SOP_SPHERE && op <= SOP_JULIA;
+}
+
+// Instructions distance `root` is computed from, itself included
+static std::vector<bool> SceneSubtree(const SceneProgram& program, int root)
+{
+    std::vector<bool> inside(program.code.size(), false);
+    inside[root] = true;
+    for (int i = root; i >= 0; --i)
+        if (inside[i])
+            for (int k = 0; k < 4; ++k)
+                if (program.code[i].args[k] >= 0)
+                    inside[program.code[i].args[k]] = true;
+    return inside;
+}
+
+// One instruction given the values of its operands. `footprint` is the
+// LOD-scaled query radius (footprint * u_lodScale in the shader), `segment`
+// the world-space radius distance bounds hold within.
+static glm::vec4 SceneEvalInstr(const SceneInstr& in, const glm::vec4* a, const glm::vec3& p, float footprint, float segment,
+                                const std::vector<glm::vec3>& paramValues)
+{
+    int u = (int)in.imm[0], v = (int)in.imm[1];
+    glm::vec4 q = a[0];
+
+    switch (in.op)
+    {
+        case SOP_POSITION:  return glm::vec4(p, 0.0f);
+        case SOP_FOOTPRINT: return glm::vec4(footprint);
+        case SOP_CONST:     return glm::vec4(in.imm[0], in.imm[1], in.imm[2], 0.0f);
+        case SOP_PARAM:     return glm::vec4(paramValues[u], 0.0f);
+
+        case SOP_ADD: return a[0] + a[1];
+        case SOP_SUB: return a[0] - a[1];
+        case SOP_MUL: return a[0] * a[1];
+        case SOP_DIV: return glm::vec4(glm::vec3(a[0]) / glm::vec3(a[1]), 0.0f);
+        case SOP_NEG: return -a[0];
+        case SOP_SIN: return glm::vec4(glm::sin(glm::vec3(a[0])), 0.0f);
+        case SOP_COS: return glm::vec4(glm::cos(glm::vec3(a[0])), 0.0f);
+
+        case SOP_TRANSLATE: return a[0] - a[1];
+        case SOP_ROTATE:
+            q[u] = a[1].x * a[0][u] + a[2].x * a[0][v];
+            q[v] = a[1].x * a[0][v] - a[2].x * a[0][u];
+            return q;
+        case SOP_MOD1:
+            q[u] = SceneMod(q[u] + a[1].x * 0.5f, a[1].x) - a[1].x * 0.5f;
+            return q;
+        case SOP_MOD2:
+            q[u] = SceneMod(q[u] + a[1][u] * 0.5f, a[1][u]) - a[1][u] * 0.5f;
+            q[v] = SceneMod(q[v] + a[1][v] * 0.5f, a[1][v]) - a[1][v] * 0.5f;
+            return q;
+        case SOP_MOD3:
+            for (int i = 0; i < 3; ++i)
+                q[i] = SceneMod(q[i] + a[1][i] * 0.5f, a[1][i]) - a[1][i] * 0.5f;
+            return q;
+        case SOP_MOD_POLAR:
+            SceneModPolar(q[u], q[v], a[1].x);
+            return q;
+        case SOP_MOD_GRID2:
+            SceneModGrid2(q[u], q[v], a[1][u], a[1][v]);
+            return q;
+        case SOP_MIRROR:
+            q[u] = std::abs(q[u]) - a[1].x;
+            return q;
+        default:
+            break;
+    }
+
+    if (SceneIsPrimitive(in.op))
+    {
+        glm::vec3 x(a[0]);
+        float d = 0.0f;
+        bool proxy = in.imm[5] > 0.0f && a[3].x > in.imm[5];
+        if (proxy)
+            d = glm::length(x - glm::vec3(in.imm[1], in.imm[2], in.imm[3])) - in.imm[4];
+        else switch (in.op)
+        {
+            case SOP_SPHERE:       d = glm::length(x) - a[1].x; break;
+            case SOP_BOX:          d = SceneBox(x, glm::vec3(a[1])); break;
+            case SOP_BOX_CHEAP:    d = SceneVMax(glm::abs(x) - glm::vec3(a[1])); break;
+            case SOP_PLANE:        d = glm::dot(x, glm::vec3(a[1])) + a[2].x; break;
+            case SOP_CYLINDER:     d = std::max(glm::length(glm::vec2(x.x, x.z)) - a[1].x, std::abs(x.y) - a[2].x); break;
+            case SOP_CAPSULE:      d = std::abs(x.y) >= a[2].x ? glm::length(glm::vec3(x.x, std::abs(x.y) - a[2].x, x.z)) - a[1].x
+                                                               : glm::length(glm::vec2(x.x, x.z)) - a[1].x; break;
+            case SOP_TORUS:        d = glm::length(glm::vec2(glm::length(glm::vec2(x.x, x.z)) - a[2].x, x.y)) - a[1].x; break;
+            case SOP_CONE:         d = SceneCone(x, a[1].x, a[2].x); break;
+            case SOP_OCTAHEDRON:   d = SceneGDF(x, a[1].x, 3, 6); break;
+            case SOP_DODECAHEDRON: d = SceneGDF(x, a[1].x, 13, 18); break;
+            case SOP_ICOSAHEDRON:  d = SceneGDF(x, a[1].x, 3, 12); break;
+            case SOP_JULIA:        d = SceneJulia(x); break;
+            default: break;
+        }
+
+        // hg_sdf's distances are exact or bounds, a plane's scales with its normal
+        float lipschitz = 1.0f;
+        if (!proxy && in.op == SOP_PLANE)
+            lipschitz = glm::length(glm::vec3(a[1]));
+        else if (!proxy && in.op == SOP_JULIA)
+            lipschitz = SceneLipschitzJulia(x, segment * in.stretch);
+        return glm::vec4(d, in.imm[0], lipschitz, 0.0f);
+    }
+
+    if (SceneIsCombinator(in.op))
+    {
+        float da = a[0].x, db = a[1].x, r = a[2].x, n = a[3].x;
+        float la = a[0].z, lb = a[1].z, s = segment * in.stretch;
+        float material = SceneIsUnionOp(in.op)      ? (da < db ? a[0].y : a[1].y)
+                       : SceneIsDifferenceOp(in.op) ? (da > -db ? a[0].y : a[1].y)
+                                                    : (da > db ? a[0].y : a[1].y);
+        float d = 0.0f;
+        float lipschitz = std::max(la, lb);     // Stairs and the soft union never steepen
+        switch (in.op)
+        {
+            case SOP_UNION:
+                d = std::min(da, db);
+                lipschitz = SceneLipschitzUnion(da, la, db, lb, s);
+                break;
+            case SOP_INTERSECTION:
+                d = std::max(da, db);
+                lipschitz = SceneLipschitzIntersection(da, la, db, lb, s);
+                break;
+            case SOP_DIFFERENCE:
+                d = std::max(da, -db);
+                lipschitz = SceneLipschitzIntersection(da, la, -db, lb, s);
+                break;
+            case SOP_UNION_ROUND:
+                d = std::max(r, std::min(da, db)) - glm::length(glm::max(glm::vec2(r - da, r - db), glm::vec2(0.0f)));
+                lipschitz = SceneLipschitzUnionRound(da, la, db, lb, r, s);
+                break;
+            case SOP_INTERSECTION_ROUND:
+                d = SceneIntersectionRound(da, db, r);
+                lipschitz = SceneLipschitzIntersectionRound(da, la, db, lb, r, s);
+                break;
+            case SOP_DIFFERENCE_ROUND:
+                d = SceneIntersectionRound(da, -db, r);
+                lipschitz = SceneLipschitzIntersectionRound(da, la, -db, lb, r, s);
+                break;
+            case SOP_UNION_CHAMFER:
+                d = std::min(std::min(da, db), (da - r + db) * std::sqrt(0.5f));
+                lipschitz = SceneLipschitzUnionChamfer(da, la, db, lb, r, s);
+                break;
+            case SOP_INTERSECTION_CHAMFER:
+                d = SceneIntersectionChamfer(da, db, r);
+                lipschitz = SceneLipschitzIntersectionChamfer(da, la, db, lb, r, s);
+                break;
+            case SOP_DIFFERENCE_CHAMFER:
+                d = SceneIntersectionChamfer(da, -db, r);
+                lipschitz = SceneLipschitzIntersectionChamfer(da, la, -db, lb, r, s);
+                break;
+            case SOP_UNION_STAIRS:          d = SceneUnionStairs(da, db, r, n); break;
+            case SOP_INTERSECTION_STAIRS:   d = -SceneUnionStairs(-da, -db, r, n); break;
+            case SOP_DIFFERENCE_STAIRS:     d = -SceneUnionStairs(-da, db, r, n); break;
+            case SOP_UNION_SOFT:
+            {
+                float e = std::max(r - std::abs(da - db), 0.0f);
+                d = std::min(da, db) - e * e * 0.25f / r;
+                break;
+            }
+            default: break;
+        }
+        return glm::vec4(d, material, lipschitz, 0.0f);
+    }
+
+    if (in.op == SOP_SCALE_DIST)
+        return glm::vec4(a[0].x * a[1].x, a[0].y, a[0].z, 0.0f);
+    return glm::vec4(a[0].x - a[1].x, a[0].y, a[0].z, 0.0f);  // SOP_OFFSET_DIST
+}
+
+glm::vec3 SceneProgram::Evaluate(const glm::vec3& p, float footprint, const SceneParams& sceneParams, float segment) const
+{
+    std::vector<glm::vec3> paramValues(params.size(), glm::vec3(0.0f));
+    for (size_t i = 0; i < params.size(); ++i)
+        sceneParams.Parameter(params[i], paramValues[i]);
+
+    std::vector<glm::vec4> values(code.size());
+    for (size_t i = 0; i < code.size(); ++i)
+    {
+        glm::vec4 operands[4];
+        for (int k = 0; k < 4; ++k)
+            operands[k] = code[i].args[k] >= 0 ? values[code[i].args[k]] : glm::vec4(0.0f);
+        values[i] = SceneEvalInstr(code[i], operands, p, footprint, segment, paramValues);
+    }
+    if (items.empty())
+        return code.empty() ? glm::vec3(1e30f, 0.0f, 1.0f) : glm::vec3(values.back());
+
+    // Same as sceneUnionItem in the shader
+    glm::vec3 result(1e30f, 0.0f, 1.0f);
+    float upper = 1e30f;
+    for (const SceneItem& item : items)
+    {
+        glm::vec3 d(values[item.root]);
+        upper = std::min(upper, d.x + d.z * segment);
+        if (d.x - d.z * segment <= upper)
+            result.z = std::max(result.z, d.z);
+        if (d.x < result.x)
+            result = glm::vec3(d.x, d.y, result.z);
+    }
+    return result;
+}
+
+glm::vec2 SceneProgram::EvaluateBaked(const glm::vec3& p) const
+{
+    if (baked < 0)
+        return glm::vec2(1e30f, 0.0f);
+    std::vector<bool> inside = SceneSubtree(*this, baked);
+    std::vector<glm::vec3> paramValues(params.size(), glm::vec3(0.0f));     // The subtree reads none
+    std::vector<glm::vec4> values(baked + 1);
+    for (int i = 0; i <= baked; ++i)
+    {
+        if (!inside[i])
+            continue;
+        glm::vec4 operands[4];
+        for (int k = 0; k < 4; ++k)
+            operands[k] = code[i].args[k] >= 0 ? values[code[i].args[k]] : glm::vec4(0.0f);
+        values[i] = SceneEvalInstr(code[i], operands, p, 0.0f, 0.0f, paramValues);
+    }
+    return glm::vec2(values[baked]);
+}
+
+static uint64_t SceneHash(uint64_t hash, const void* data, size_t size)
+{
+    // FNV-1a
+    for (size_t i = 0; i < size; ++i)
+        hash = (hash ^ ((const unsigned char*)data)[i]) * 1099511628211ull;
+    return hash;
+}
+
+// Of an instruction and, through the hashes of its operands, all it reads; the
+// same for the same subtree wherever a compile placed it
+static uint64_t SceneInstrHash(const SceneInstr& in, const std::vector<uint64_t>& operands)
+{
+    uint64_t hash = SceneHash(14695981039346656037ull, &in.op, sizeof(in.op));
+    hash = SceneHash(hash, &in.type, sizeof(in.type));
+    hash = SceneHash(hash, in.imm, sizeof(in.imm));
+    for (int k = 0; k < 4; ++k)
+    {
+        uint64_t operand = in.args[k] >= 0 ? operands[in.args[k]] : 0;
+        hash = SceneHash(hash, &operand, sizeof(operand));
+    }
+    return hash;
+}
+
+uint64_t SceneProgram::BakedHash() const
+{
+    if (baked < 0)
+        return 0;
+    std::vector<uint64_t> hashes(baked + 1, 0);
+    for (int i = 0; i <= baked; ++i)
+        hashes[i] = SceneInstrHash(code[i], hashes);
+    return SceneHash(hashes[baked], &bakedLipschitz, sizeof(bakedLipschitz));
+}
+
+// ──────────────────────────────────────────────────────────────────────── //
+//                             INTERVAL BOUNDS                              //
+// ──────────────────────────────────────────────────────────────────────── //
+
+// A value over a box of points, componentwise [lo, hi]; intervalMul etc. in the shader
+struct SceneInterval
+{
+    glm::vec4 lo, hi;
+};
+
+static glm::vec2 SceneIntervalSquare(float lo, float hi)
+{
+    if (lo >= 0.0f)
+        return glm::vec2(lo * lo, hi * hi);
+    if (hi <= 0.0f)
+        return glm::vec2(hi * hi, lo * lo);
+    return glm::vec2(0.0f, std::max(lo * lo, hi * hi));
+}
+
+static glm::vec2 SceneIntervalMul(float alo, float ahi, float blo, float bhi)
+{
+    float p[4] = { alo * blo, alo * bhi, ahi * blo, ahi * bhi };
+    return glm::vec2(std::min(std::min(p[0], p[1]), std::min(p[2], p[3])), std::max(std::max(p[0], p[1]), std::max(p[2], p[3])));
+}
+
+static void SceneIntervalMod1(float& lo, float& hi, float size)
+{
+    float cell = std::floor((lo + size * 0.5f) / size);
+    bool within = std::floor((hi + size * 0.5f) / size) == cell;
+    lo = within ? lo - cell * size : -0.5f * size;
+    hi = within ? hi - cell * size : 0.5f * size;
+}
+
+static glm::vec2 SceneIntervalLipschitz(float centre, const glm::vec3& lo, const glm::vec3& hi, float lipschitz)
+{
+    float r = 0.5f * glm::length(hi - lo) * lipschitz;
+    return glm::vec2(centre - r, centre + r);
+}
+
+// intervalJulia: the estimate at the centre within its Lipschitz bound, raised
+// to the escape bound once the orbit of the whole box has escaped
+static glm::vec2 SceneIntervalJulia(const glm::vec3& boxMin, const glm::vec3& boxMax)
+{
+    const glm::vec4 c = glm::vec4(-2.0f, 6.0f, 15.0f, -6.0f) / 22.0f;
+    glm::vec3 centre = 0.5f * (boxMin + boxMax);
+    glm::vec2 bound = SceneIntervalLipschitz(SceneJulia(centre), boxMin, boxMax, SceneLipschitzJulia(centre, 0.5f * glm::length(boxMax - boxMin)));
+    glm::vec4 lo(boxMin, 0.0f), hi(boxMax, 0.0f);
+    glm::vec2 radius(glm::length(glm::max(glm::max(lo, -hi), glm::vec4(0.0f))), glm::length(glm::max(glm::abs(lo), glm::abs(hi))));
+    float dz = 1.0f, dzMax = 1.0f;
+
+    for (int i = 0; i < SCENE_JULIA_INTERVAL_ITERATIONS; ++i)
+    {
+        dz *= 3.0f * radius.y * radius.y;
+        dzMax = std::max(dzMax, dz);
+
+        // z³ = (x (x² - 3 s), yzw (3 x² - s)) with s = y² + z² + w²
+        glm::vec2 x2 = SceneIntervalSquare(lo.x, hi.x);
+        glm::vec2 s = SceneIntervalSquare(lo.y, hi.y) + SceneIntervalSquare(lo.z, hi.z) + SceneIntervalSquare(lo.w, hi.w);
+        glm::vec2 fx(x2.x - 3.0f * s.y, x2.y - 3.0f * s.x);
+        glm::vec2 fv(3.0f * x2.x - s.y, 3.0f * x2.y - s.x);
+        glm::vec2 z[4] = { SceneIntervalMul(lo.x, hi.x, fx.x, fx.y), SceneIntervalMul(lo.y, hi.y, fv.x, fv.y),
+                           SceneIntervalMul(lo.z, hi.z, fv.x, fv.y), SceneIntervalMul(lo.w, hi.w, fv.x, fv.y) };
+        for (int k = 0; k < 4; ++k)
+        {
+            lo[k] = z[k].x + c[k];
+            hi[k] = z[k].y + c[k];
+        }
+
+        glm::vec2 cubed = radius * radius * radius;
+        radius = glm::vec2(std::max(glm::length(glm::max(glm::max(lo, -hi), glm::vec4(0.0f))), cubed.x - glm::length(c)),
+                           std::min(glm::length(glm::max(glm::abs(lo), glm::abs(hi))), cubed.y + glm::length(c)));
+        if (radius.x * radius.x > 256.0f)
+            return glm::vec2(std::max(bound.x, 0.25f * std::log(256.0f) * 16.0f / dzMax), bound.y);
+    }
+    return bound;
+}
+
+// One instruction over a box, `values` the intervals of the earlier ones.
+// Values that don't vary with the position are evaluated once, exactly.
+static SceneInterval SceneIntervalInstr(const SceneInstr& in, const SceneInterval* a, const glm::vec3& boxMin, const glm::vec3& boxMax,
+                                        float footprint, const std::vector<glm::vec3>& paramValues)
+{
+    int u = (int)in.imm[0], v = (int)in.imm[1];
+    SceneInterval x = a[0];
+
+    switch (in.op)
+    {
+        case SOP_POSITION: return { glm::vec4(boxMin, 0.0f), glm::vec4(boxMax, 0.0f) };
+        case SOP_ADD:      return { a[0].lo + a[1].lo, a[0].hi + a[1].hi };
+        case SOP_SUB:
+        case SOP_TRANSLATE: return { a[0].lo - a[1].hi, a[0].hi - a[1].lo };
+        case SOP_NEG:      return { -a[0].hi, -a[0].lo };
+        case SOP_MUL:
+        case SOP_DIV:
+            for (int i = 0; i < 3; ++i)
+            {
+                glm::vec2 b(a[1].lo[i], a[1].hi[i]);
+                bool straddles = in.op == SOP_DIV && b.x * b.y <= 0.0f;
+                if (in.op == SOP_DIV)
+                    b = glm::vec2(1.0f / b.y, 1.0f / b.x);
+                glm::vec2 r = straddles ? glm::vec2(-SCENE_UNBOUNDED, SCENE_UNBOUNDED) : SceneIntervalMul(a[0].lo[i], a[0].hi[i], b.x, b.y);
+                x.lo[i] = r.x;
+                x.hi[i] = r.y;
+            }
+            return x;
+        case SOP_SIN:
+        case SOP_COS:
+            if (a[0].lo == a[0].hi)
+                break;
+            return { glm::vec4(-1.0f), glm::vec4(1.0f) };
+        case SOP_ROTATE:
+        {
+            // On the centre and the extents of the box
+            float c = a[1].lo.x, s = a[2].lo.x;
+            glm::vec2 centre = 0.5f * glm::vec2(x.lo[u] + x.hi[u], x.lo[v] + x.hi[v]);
+            glm::vec2 extent = 0.5f * glm::vec2(x.hi[u] - x.lo[u], x.hi[v] - x.lo[v]);
+            centre = glm::vec2(c * centre.x + s * centre.y, c * centre.y - s * centre.x);
+            extent = std::abs(c) * extent + std::abs(s) * glm::vec2(extent.y, extent.x);
+            x.lo[u] = centre.x - extent.x; x.hi[u] = centre.x + extent.x;
+            x.lo[v] = centre.y - extent.y; x.hi[v] = centre.y + extent.y;
+            return x;
+        }
+        case SOP_MOD1:
+            SceneIntervalMod1(x.lo[u], x.hi[u], a[1].lo.x);
+            return x;
+        case SOP_MOD2:
+            SceneIntervalMod1(x.lo[u], x.hi[u], a[1].lo[u]);
+            SceneIntervalMod1(x.lo[v], x.hi[v], a[1].lo[v]);
+            return x;
+        case SOP_MOD3:
+            for (int i = 0; i < 3; ++i)
+                SceneIntervalMod1(x.lo[i], x.hi[i], a[1].lo[i]);
+            return x;
+        case SOP_MOD_POLAR:
+        {
+            // Every point folds into the wedge around +u, its radius kept
+            float halfAngle = SCENE_PI / a[1].lo.x;
+            glm::vec2 nearest = glm::max(glm::max(glm::vec2(x.lo[u], x.lo[v]), -glm::vec2(x.hi[u], x.hi[v])), glm::vec2(0.0f));
+            glm::vec2 farthest = glm::max(glm::abs(glm::vec2(x.lo[u], x.lo[v])), glm::abs(glm::vec2(x.hi[u], x.hi[v])));
+            float rMin = glm::length(nearest), rMax = glm::length(farthest);
+            float side = rMax * (halfAngle < 0.5f * SCENE_PI ? std::sin(halfAngle) : 1.0f);
+            x.lo[u] = std::min(rMin * std::cos(halfAngle), rMax * std::cos(halfAngle)); x.hi[u] = rMax;
+            x.lo[v] = -side; x.hi[v] = side;
+            return x;
+        }
+        case SOP_MOD_GRID2:
+        {
+            float size = std::max(a[1].lo[u], a[1].lo[v]);
+            x.lo[u] = x.lo[v] = -size;
+            x.hi[u] = x.hi[v] = 0.0f;
+            return x;
+        }
+        case SOP_MIRROR:
+        {
+            float lo = x.lo[u] >= 0.0f ? x.lo[u] : (x.hi[u] <= 0.0f ? -x.hi[u] : 0.0f);
+            x.hi[u] = std::max(std::abs(x.lo[u]), std::abs(x.hi[u])) - a[1].lo.x;
+            x.lo[u] = lo - a[1].lo.x;
+            return x;
+        }
+        default:
+            break;
+    }
+
+    glm::vec4 lo[4], hi[4];
+    for (int k = 0; k < 4; ++k)
+    {
+        lo[k] = a[k].lo;
+        hi[k] = a[k].hi;
+    }
+    if (SceneIsPrimitive(in.op))
+    {
+        glm::vec3 bmin(a[0].lo), bmax(a[0].hi), centre = 0.5f * (bmin + bmax);
+        bool proxy = in.imm[5] > 0.0f && a[3].lo.x > in.imm[5];
+        glm::vec2 d;
+        if (!proxy && in.op == SOP_JULIA)
+            d = SceneIntervalJulia(bmin, bmax);
+        else
+        {
+            lo[0] = glm::vec4(centre, 0.0f);
+            float lipschitz = !proxy && in.op == SOP_PLANE ? glm::length(glm::vec3(a[1].lo)) : 1.0f;
+            d = SceneIntervalLipschitz(SceneEvalInstr(in, lo, centre, footprint, 0.0f, paramValues).x, bmin, bmax, lipschitz);
+        }
+        return { glm::vec4(d.x), glm::vec4(d.y) };
+    }
+    if (SceneIsCombinator(in.op) || in.op == SOP_SCALE_DIST || in.op == SOP_OFFSET_DIST)
+    {
+        // Monotone in both operands, falling in the subtrahend of a difference
+        if (SceneIsDifferenceOp(in.op) || in.op == SOP_OFFSET_DIST)
+            std::swap(lo[1], hi[1]);
+        float d0 = SceneEvalInstr(in, lo, boxMin, footprint, 0.0f, paramValues).x;
+        float d1 = SceneEvalInstr(in, hi, boxMin, footprint, 0.0f, paramValues).x;
+        return { glm::vec4(std::min(d0, d1)), glm::vec4(std::max(d0, d1)) };
+    }
+
+    glm::vec4 exact = SceneEvalInstr(in, lo, boxMin, footprint, 0.0f, paramValues);
+    return { exact, exact };
+}
+
+glm::vec2 SceneProgram::Interval(const glm::vec3& boxMin, const glm::vec3& boxMax, float footprint, const SceneParams& sceneParams) const
+{
+    std::vector<glm::vec3> paramValues(params.size(), glm::vec3(0.0f));
+    for (size_t i = 0; i < params.size(); ++i)
+        sceneParams.Parameter(params[i], paramValues[i]);
+
+    std::vector<SceneInterval> values(code.size());
+    for (size_t i = 0; i < code.size(); ++i)
+    {
+        SceneInterval operands[4];
+        for (int k = 0; k < 4; ++k)
+            operands[k] = code[i].args[k] >= 0 ? values[code[i].args[k]] : SceneInterval{ glm::vec4(0.0f), glm::vec4(0.0f) };
+        values[i] = SceneIntervalInstr(code[i], operands, boxMin, boxMax, footprint, paramValues);
+    }
+    if (items.empty())
+        return code.empty() ? glm::vec2(1e30f) : glm::vec2(values.back().lo.x, values.back().hi.x);
+
+    glm::vec2 result(1e30f);
+    for (const SceneItem& item : items)
+        result = glm::min(result, glm::vec2(values[item.root].lo.x, values[item.root].hi.x));
+    return result;
+}
+
+float SceneProgram::CellStep(const glm::vec3& p, const glm::vec3& dir, float radius) const
+{
+    float step = 1e5f;
+    for (const SceneCell& cell : cells)
+    {
+        glm::vec3 q, d;
+        for (int i = 0; i < 3; ++i)
+        {
+            q[i] = glm::dot(glm::vec3(cell.toLocal[i]), p) + cell.toLocal[i].w;
+            d[i] = glm::dot(glm::vec3(cell.toLocal[i]), dir);
+        }
+        float r = radius * glm::length(glm::vec3(cell.toLocal[0]));
+
+        // Nothing to clamp before the ray reaches the copies, or if it never does
+        glm::vec3 t0 = (glm::vec3(cell.boundsMin) - r - q) / d;
+        glm::vec3 t1 = (glm::vec3(cell.boundsMax) + r - q) / d;
+        float enter = SceneVMax(glm::min(t0, t1)), leave = SceneVMin(glm::max(t0, t1));
+        if (enter > leave || leave < 0.0f)
+            continue;
+
+        float exit = 1e5f;
+        if (cell.period.w == 0.0f)
+        {
+            glm::vec3 period(cell.period);
+            glm::vec3 centre = glm::floor(q / glm::max(period, glm::vec3(1e-6f)) + 0.5f) * period;
+            glm::vec3 lo = centre + glm::vec3(cell.freeMin) + r, hi = centre + glm::vec3(cell.freeMax) - r;
+            bool inside = glm::all(glm::greaterThanEqual(q, lo)) && glm::all(glm::lessThanEqual(q, hi));
+            exit = inside ? SceneVMin(glm::max((lo - q) / d, (hi - q) / d)) : 0.0f;
+        }
+        else
+        {
+            // Into the frame of the sector, then out through either side of the wedge
+            float angle = 2.0f * SCENE_PI / cell.period.w;
+            float centre = std::floor(std::atan2(q.y, q.x) / angle + 0.5f) * angle;
+            glm::vec2 axis(std::cos(centre), std::sin(centre));
+            glm::vec2 qs(axis.x * q.x + axis.y * q.y, axis.x * q.y - axis.y * q.x);
+            glm::vec2 ds(axis.x * d.x + axis.y * d.y, axis.x * d.y - axis.y * d.x);
+            glm::vec2 normals[2] = { glm::vec2(-std::sin(cell.freeMin.x), std::cos(cell.freeMin.x)),
+                                     glm::vec2(std::sin(cell.freeMax.x), -std::cos(cell.freeMax.x)) };
+            for (const glm::vec2& n : normals)
+            {
+                float s = glm::dot(n, qs) - r, ns = glm::dot(n, ds);
+                if (s < 0.0f)
+                    exit = 0.0f;
+                else if (ns < 0.0f)
+                    exit = std::min(exit, -s / ns);
+            }
+        }
+        step = std::min(step, std::max(exit, enter));
+    }
+    return step;
+}
+
+// ──────────────────────────────────────────────────────────────────────── //
+//                                  GLSL                                    //
+// ──────────────────────────────────────────────────────────────────────── //
+
+// Shortest literal that reads back as the same float
+static std::string SceneFloatLiteral(float v)
+{
+    char buffer[32];
+    for (int precision = 6; precision <= 9; ++precision)
+    {
+        snprintf(buffer, sizeof(buffer), "%.*g", precision, v);
+        if (std::strtof(buffer, nullptr) == v)
+            break;
+    }
+    std::string s = buffer;
+    if (s.find_first_of(".e") == std::string::npos)
+        s += ".0";
+    return v < 0.0f ? "(" + s + ")" : s;
+}
+
+static std::string SceneVec3Literal(const glm::vec3& v)
+{
+    if (v.x == v.y && v.y == v.z)
+        return "vec3(" + SceneFloatLiteral(v.x) + ")";
+    return "vec3(" + SceneFloatLiteral(v.x) + ", " + SceneFloatLiteral(v.y) + ", " + SceneFloatLiteral(v.z) + ")";
+}
+
+static std::string SceneVec4Literal(const glm::vec4& v)
+{
+    return "vec4(" + SceneFloatLiteral(v.x) + ", " + SceneFloatLiteral(v.y) + ", " + SceneFloatLiteral(v.z) + ", " + SceneFloatLiteral(v.w) + ")";
+}
+
+bool SceneProgram::HasGradient() const
+{
+    if (!items.empty())
+        return false;
+    for (const SceneInstr& in : code)
+    {
+        switch (in.op)
+        {
+            case SOP_POSITION: case SOP_FOOTPRINT: case SOP_CONST: case SOP_PARAM:
+            case SOP_ADD: case SOP_SUB: case SOP_MUL: case SOP_DIV: case SOP_NEG: case SOP_SIN: case SOP_COS:
+            case SOP_TRANSLATE: case SOP_SPHERE: case SOP_BOX: case SOP_PLANE: case SOP_JULIA:
+            case SOP_UNION: case SOP_INTERSECTION: case SOP_DIFFERENCE: case SOP_OFFSET_DIST:
+                break;
+            default:
+                return false;
+        }
+    }
+    return !code.empty();
+}
+
+// Reference to a value: literals and leaves inline, everything else by name
+static std::string SceneOperand(const SceneProgram& program, int index)
+{
+    const SceneInstr& in = program.code[index];
+    switch (in.op)
+    {
+        case SOP_POSITION:  return "p";
+        case SOP_FOOTPRINT: return "footprint";
+        case SOP_PARAM:     return "u_" + program.params[(int)in.imm[0]];
+        case SOP_CONST:
+            return in.type == SVT_FLOAT ? SceneFloatLiteral(in.imm[0]) : SceneVec3Literal(glm::vec3(in.imm[0], in.imm[1], in.imm[2]));
+        default:
+            return "v" + std::to_string(index);
+    }
+}
+
+// Statement defining instruction `index`, empty for values that are inlined.
+// In the gradient function distances are vec4(distance, normal).
+static std::string SceneStatement(const SceneProgram& program, int index, bool gradient)
+{
+    static const char axisNames[] = "xyz";
+    const SceneInstr& in = program.code[index];
+    if (in.op == SOP_POSITION || in.op == SOP_FOOTPRINT || in.op == SOP_PARAM || in.op == SOP_CONST)
+        return "";
+
+    std::string name = "v" + std::to_string(index);
+    std::string a[4];
+    for (int k = 0; k < 4; ++k)
+        if (in.args[k] >= 0)
+            a[k] = SceneOperand(program, in.args[k]);
+    std::string axis(1, axisNames[(int)in.imm[0]]);
+    std::string plane = axis + axisNames[(int)in.imm[1]];
+    std::string u = name + "." + axis, uv = name + "." + plane;
+    bool sizeIsFloat = in.args[1] >= 0 && program.code[in.args[1]].type == SVT_FLOAT;
+    std::string size2 = sizeIsFloat ? "vec2(" + a[1] + ")" : a[1] + "." + plane;
+
+    switch (in.op)
+    {
+        case SOP_ADD: case SOP_SUB: case SOP_MUL: case SOP_DIV:
+        {
+            static const char* symbols[] = { " + ", " - ", " * ", " / " };
+            std::string type = in.type == SVT_FLOAT ? "float " : "vec3 ";
+            return type + name + " = " + a[0] + symbols[in.op - SOP_ADD] + a[1] + ";";
+        }
+        case SOP_NEG: return (in.type == SVT_FLOAT ? "float " : "vec3 ") + name + " = -" + a[0] + ";";
+        case SOP_SIN: return (in.type == SVT_FLOAT ? "float " : "vec3 ") + name + " = sin(" + a[0] + ");";
+        case SOP_COS: return (in.type == SVT_FLOAT ? "float " : "vec3 ") + name + " = cos(" + a[0] + ");";
+
+        case SOP_TRANSLATE: return "vec3 " + name + " = " + a[0] + " - " + a[1] + ";";
+        case SOP_ROTATE:
+            return "vec3 " + name + " = " + a[0] + "; " + uv + " = " + a[1] + " * " + uv + " + " + a[2]
+                 + " * vec2(" + name + "." + plane[1] + ", -" + name + "." + plane[0] + ");";
+        case SOP_MOD1:      return "vec3 " + name + " = " + a[0] + "; pMod1(" + u + ", " + a[1] + ");";
+        case SOP_MOD2:      return "vec3 " + name + " = " + a[0] + "; pMod2(" + uv + ", " + size2 + ");";
+        case SOP_MOD3:      return "vec3 " + name + " = " + a[0] + "; pMod3(" + name + ", " + (sizeIsFloat ? "vec3(" + a[1] + ")" : a[1]) + ");";
+        case SOP_MOD_POLAR: return "vec3 " + name + " = " + a[0] + "; pModPolar(" + uv + ", " + a[1] + ");";
+        case SOP_MOD_GRID2: return "vec3 " + name + " = " + a[0] + "; pModGrid2(" + uv + ", " + size2 + ");";
+        case SOP_MIRROR:    return "vec3 " + name + " = " + a[0] + "; pMirror(" + u + ", " + a[1] + ");";
+        default: break;
+    }
+
+    if (SceneIsPrimitive(in.op))
+    {
+        if (gradient)
+        {
+            switch (in.op)
+            {
+                case SOP_SPHERE: return "vec4 " + name + " = vec4(fSphere(" + a[0] + ", " + a[1] + "), normalize(" + a[0] + "));";
+                case SOP_BOX:    return "vec4 " + name + " = fBoxGrad(" + a[0] + ", " + a[1] + ");";
+                case SOP_PLANE:  return "vec4 " + name + " = vec4(fPlane(" + a[0] + ", " + a[1] + ", " + a[2] + "), " + a[1] + ");";
+                default:         return "vec4 " + name + " = JSGrad(" + a[0] + ");";
+            }
+        }
+
+        static const char* functions[] = { "fSphere", "fBox", "fBoxCheap", "fPlane", "fCylinder", "fCapsule", "fTorus", "fCone",
+                                           "fOctahedron", "fDodecahedron", "fIcosahedron" };
+        std::string d = in.op == SOP_JULIA ? "JS(" + a[0] + ").r"
+                      : std::string(functions[in.op - SOP_SPHERE]) + "(" + a[0] + ", " + a[1] + (a[2].empty() ? "" : ", " + a[2]) + ")";
+        if (in.imm[5] > 0.0f)
+        {
+            std::string lod = "kSceneNode" + std::to_string(index);
+            d = "nodeUsesProxy(" + lod + ", " + a[3] + ") ? nodeProxy(" + lod + ", " + a[0] + ") : " + d;
+        }
+        return "vec2 " + name + " = vec2(" + d + ", " + SceneFloatLiteral(in.imm[0]) + ");";
+    }
+
+    std::string type = gradient ? "vec4 " : "vec2 ";
+    switch (in.op)
+    {
+        case SOP_UNION:        return type + name + " = (" + a[0] + ".x < " + a[1] + ".x) ? " + a[0] + " : " + a[1] + ";";
+        case SOP_INTERSECTION: return type + name + " = (" + a[0] + ".x > " + a[1] + ".x) ? " + a[0] + " : " + a[1] + ";";
+        case SOP_DIFFERENCE:
+            return type + name + " = (" + a[0] + ".x > -" + a[1] + ".x) ? " + a[0] + " : "
+                 + (gradient ? "-" + a[1] : "vec2(-" + a[1] + ".x, " + a[1] + ".y)") + ";";
+        case SOP_SCALE_DIST:   return "vec2 " + name + " = vec2(" + a[0] + ".x * " + a[1] + ", " + a[0] + ".y);";
+        case SOP_OFFSET_DIST:
+            return type + name + " = " + (gradient ? "vec4(" : "vec2(") + a[0] + ".x - " + a[1] + ", " + a[0] + (gradient ? ".yzw);" : ".y);");
+        default: break;
+    }
+
+    // Smooth combinators; the material is taken from the operand a sharp one would pick
+    static const char* functions[] = { "fOpUnionRound", "fOpIntersectionRound", "fOpDifferenceRound",
+                                       "fOpUnionChamfer", "fOpIntersectionChamfer", "fOpDifferenceChamfer",
+                                       "fOpUnionStairs", "fOpIntersectionStairs", "fOpDifferenceStairs", "fOpUnionSoft" };
+    std::string select = SceneIsUnionOp(in.op)      ? a[0] + ".x < " + a[1] + ".x"
+                       : SceneIsDifferenceOp(in.op) ? a[0] + ".x > -" + a[1] + ".x"
+                                                    : a[0] + ".x > " + a[1] + ".x";
+    return "vec2 " + name + " = vec2(" + functions[in.op - SOP_UNION_ROUND] + "(" + a[0] + ".x, " + a[1] + ".x, " + a[2]
+         + (a[3].empty() ? "" : ", " + a[3]) + "), (" + select + ") ? " + a[0] + ".y : " + a[1] + ".y);";
+}
+
+// Definition of the Lipschitz bound lN of distance instruction `index`
+// within `segment` of p, empty for other values
+static std::string SceneLipschitzStatement(const SceneProgram& program, int index)
+{
+    const SceneInstr& in = program.code[index];
+    if (in.type != SVT_DIST)
+        return "";
+
+    std::string name = "l" + std::to_string(index);
+    std::string a[4], la[2];
+    for (int k = 0; k < 4; ++k)
+        if (in.args[k] >= 0)
+            a[k] = SceneOperand(program, in.args[k]);
+    for (int k = 0; k < 2; ++k)
+        la[k] = "l" + std::to_string(in.args[k]);
+    std::string s = in.stretch == 1.0f ? "segment" : "segment * " + SceneFloatLiteral(in.stretch);
+
+    std::string l;
+    if (SceneIsPrimitive(in.op))
+    {
+        if (in.op == SOP_PLANE)
+        {
+            const SceneInstr& normal = program.code[in.args[1]];
+            l = normal.op == SOP_CONST ? SceneFloatLiteral(glm::length(glm::vec3(normal.imm[0], normal.imm[1], normal.imm[2])))
+                                       : "length(" + a[1] + ")";
+        }
+        else if (in.op == SOP_JULIA)
+            l = "lipschitzJulia(" + a[0] + ", " + s + ")";
+        else
+            return "const float " + name + " = 1.0;";
+        if (in.imm[5] > 0.0f)
+            l = "nodeUsesProxy(kSceneNode" + std::to_string(index) + ", " + a[3] + ") ? 1.0 : " + l;
+        return "float " + name + " = " + l + ";";
+    }
+
+    std::string args = a[0] + ".x, " + la[0] + ", " + a[1] + ".x, " + la[1];
+    std::string negated = a[0] + ".x, " + la[0] + ", -" + a[1] + ".x, " + la[1];
+    switch (in.op)
+    {
+        case SOP_UNION:                 l = "lipschitzUnion(" + args + ", " + s + ")"; break;
+        case SOP_INTERSECTION:          l = "lipschitzIntersection(" + args + ", " + s + ")"; break;
+        case SOP_DIFFERENCE:            l = "lipschitzIntersection(" + negated + ", " + s + ")"; break;
+        case SOP_UNION_ROUND:           l = "lipschitzUnionRound(" + args + ", " + a[2] + ", " + s + ")"; break;
+        case SOP_INTERSECTION_ROUND:    l = "lipschitzIntersectionRound(" + args + ", " + a[2] + ", " + s + ")"; break;
+        case SOP_DIFFERENCE_ROUND:      l = "lipschitzIntersectionRound(" + negated + ", " + a[2] + ", " + s + ")"; break;
+        case SOP_UNION_CHAMFER:         l = "lipschitzUnionChamfer(" + args + ", " + a[2] + ", " + s + ")"; break;
+        case SOP_INTERSECTION_CHAMFER:  l = "lipschitzIntersectionChamfer(" + args + ", " + a[2] + ", " + s + ")"; break;
+        case SOP_DIFFERENCE_CHAMFER:    l = "lipschitzIntersectionChamfer(" + negated + ", " + a[2] + ", " + s + ")"; break;
+        case SOP_SCALE_DIST: case SOP_OFFSET_DIST: l = la[0]; break;
+        default:                        l = "max(" + la[0] + ", " + la[1] + ")"; break;  // Stairs and the soft union never steepen
+    }
+    return "float " + name + " = " + l + ";";
+}
+
+// Statements of instruction `index` in sdfSceneSegment / sceneItemSegment
+static void SceneEmitSegmentStatement(std::stringstream& out, const SceneProgram& program, int index, const std::string& indent)
+{
+    std::string statement = SceneStatement(program, index, false);
+    if (!statement.empty())
+        out << indent << statement << "\n";
+    statement = SceneLipschitzStatement(program, index);
+    if (!statement.empty())
+        out << indent << statement << "\n";
+}
+
+// Values that vary over the box of sdfSceneInterval: the position and
+// everything computed from it. Distances always do.
+static std::vector<bool> SceneVaryingValues(const SceneProgram& program)
+{
+    std::vector<bool> varying(program.code.size(), false);
+    for (size_t i = 0; i < program.code.size(); ++i)
+    {
+        const SceneInstr& in = program.code[i];
+        varying[i] = in.op == SOP_POSITION || in.type == SVT_DIST;
+        for (int k = 0; k < 4; ++k)
+            if (in.args[k] >= 0 && varying[in.args[k]])
+                varying[i] = true;
+    }
+    return varying;
+}
+
+// Lower or upper end of a value over the box, the value itself where it doesn't vary
+static std::string SceneIntervalOperand(const SceneProgram& program, const std::vector<bool>& varying, int index, bool upper)
+{
+    if (program.code[index].op == SOP_POSITION)
+        return upper ? "hi" : "lo";
+    if (!varying[index] || program.code[index].type == SVT_DIST)
+        return SceneOperand(program, index);
+    return "v" + std::to_string(index) + (upper ? "hi" : "lo");
+}
+
+// Statement of instruction `index` in sdfSceneInterval / sceneItemInterval.
+// Varying points are the boxes vNlo / vNhi, distances vec2(lower, upper).
+static std::string SceneIntervalStatement(const SceneProgram& program, const std::vector<bool>& varying, int index)
+{
+    static const char axisNames[] = "xyz";
+    const SceneInstr& in = program.code[index];
+    if (!varying[index] || in.op == SOP_POSITION)
+        return SceneStatement(program, index, false);
+
+    std::string name = "v" + std::to_string(index);
+    std::string lo = name + "lo", hi = name + "hi";
+    std::string a[4], alo[2], ahi[2];
+    for (int k = 0; k < 4; ++k)
+        if (in.args[k] >= 0)
+            a[k] = SceneOperand(program, in.args[k]);
+    for (int k = 0; k < 2; ++k)
+        if (in.args[k] >= 0)
+        {
+            alo[k] = SceneIntervalOperand(program, varying, in.args[k], false);
+            ahi[k] = SceneIntervalOperand(program, varying, in.args[k], true);
+        }
+    std::string axis(1, axisNames[(int)in.imm[0]]);
+    std::string plane = axis + axisNames[(int)in.imm[1]];
+    bool sizeIsFloat = in.args[1] >= 0 && program.code[in.args[1]].type == SVT_FLOAT;
+    auto size = [&](int i) { return sizeIsFloat ? a[1] : a[1] + "." + axisNames[i]; };
+    std::string copy = "vec3 " + lo + " = " + alo[0] + ", " + hi + " = " + ahi[0] + ";";
+
+    switch (in.op)
+    {
+        case SOP_ADD:       return "vec3 " + lo + " = " + alo[0] + " + " + alo[1] + ", " + hi + " = " + ahi[0] + " + " + ahi[1] + ";";
+        case SOP_SUB:
+        case SOP_TRANSLATE: return "vec3 " + lo + " = " + alo[0] + " - " + ahi[1] + ", " + hi + " = " + ahi[0] + " - " + alo[1] + ";";
+        case SOP_MUL:
+        case SOP_DIV:
+            return "vec3 " + lo + " = vec3(" + alo[0] + "), " + hi + " = vec3(" + ahi[0] + "); " + (in.op == SOP_MUL ? "intervalMul(" : "intervalDiv(")
+                 + lo + ", " + hi + ", vec3(" + alo[1] + "), vec3(" + ahi[1] + "));";
+        case SOP_NEG:       return "vec3 " + lo + " = -" + ahi[0] + ", " + hi + " = -" + alo[0] + ";";
+        case SOP_SIN:
+        case SOP_COS:       return "vec3 " + lo + " = vec3(-1.0), " + hi + " = vec3(1.0);";
+        case SOP_ROTATE:    return copy + " intervalRotate(" + lo + "." + plane + ", " + hi + "." + plane + ", " + a[1] + ", " + a[2] + ");";
+        case SOP_MOD1:      return copy + " intervalMod1(" + lo + "." + axis + ", " + hi + "." + axis + ", " + a[1] + ");";
+        case SOP_MOD2:
+        case SOP_MOD3:
+        {
+            std::string s = copy;
+            for (int i = 0; i < 3; ++i)
+                if (in.op == SOP_MOD3 || i == (int)in.imm[0] || i == (int)in.imm[1])
+                    s += std::string(" intervalMod1(") + lo + "." + axisNames[i] + ", " + hi + "." + axisNames[i] + ", " + size(i) + ");";
+            return s;
+        }
+        case SOP_MOD_POLAR: return copy + " intervalModPolar(" + lo + "." + plane + ", " + hi + "." + plane + ", " + a[1] + ");";
+        case SOP_MOD_GRID2:
+            return copy + " intervalModGrid2(" + lo + "." + plane + ", " + hi + "." + plane + ", "
+                 + (sizeIsFloat ? "vec2(" + a[1] + ")" : a[1] + "." + plane) + ");";
+        case SOP_MIRROR:    return copy + " intervalMirror(" + lo + "." + axis + ", " + hi + "." + axis + ", " + a[1] + ");";
+        default: break;
+    }
+
+    if (SceneIsPrimitive(in.op))
+    {
+        static const char* functions[] = { "fSphere", "fBox", "fBoxCheap", "fPlane", "fCylinder", "fCapsule", "fTorus", "fCone",
+                                           "fOctahedron", "fDodecahedron", "fIcosahedron" };
+        std::string centre = "c" + std::to_string(index);
+        std::string box = alo[0] + ", " + ahi[0];
+        std::string d;
+        if (in.op == SOP_JULIA)
+            d = "intervalJulia(" + box + ")";
+        else
+        {
+            std::string l = in.op != SOP_PLANE ? "1.0" : "length(" + a[1] + ")";
+            d = "intervalLipschitz(" + std::string(functions[in.op - SOP_SPHERE]) + "(" + centre + ", " + a[1] + (a[2].empty() ? "" : ", " + a[2]) + "), "
+              + box + ", " + l + ")";
+        }
+        if (in.imm[5] > 0.0f)
+        {
+            std::string lod = "kSceneNode" + std::to_string(index);
+            d = "nodeUsesProxy(" + lod + ", " + a[3] + ") ? intervalLipschitz(nodeProxy(" + lod + ", " + centre + "), " + box + ", 1.0) : " + d;
+        }
+        return "vec3 " + centre + " = 0.5 * (" + alo[0] + " + " + ahi[0] + "); vec2 " + name + " = " + d + ";";
+    }
+
+    // Combinators are monotone in both operands, falling in the subtrahend of a difference
+    switch (in.op)
+    {
+        case SOP_UNION:        return "vec2 " + name + " = min(" + a[0] + ", " + a[1] + ");";
+        case SOP_INTERSECTION: return "vec2 " + name + " = max(" + a[0] + ", " + a[1] + ");";
+        case SOP_DIFFERENCE:   return "vec2 " + name + " = max(" + a[0] + ", -" + a[1] + ".yx);";
+        case SOP_SCALE_DIST:   return "vec2 " + name + " = intervalScale(" + a[0] + ", " + a[1] + ");";
+        case SOP_OFFSET_DIST:  return "vec2 " + name + " = " + a[0] + " - " + a[1] + ";";
+        default: break;
+    }
+    static const char* functions[] = { "fOpUnionRound", "fOpIntersectionRound", "fOpDifferenceRound",
+                                       "fOpUnionChamfer", "fOpIntersectionChamfer", "fOpDifferenceChamfer",
+                                       "fOpUnionStairs", "fOpIntersectionStairs", "fOpDifferenceStairs", "fOpUnionSoft" };
+    std::string f = functions[in.op - SOP_UNION_ROUND];
+    std::string rest = ", " + a[2] + (a[3].empty() ? "" : ", " + a[3]) + ")";
+    bool falling = SceneIsDifferenceOp(in.op);
+    return "vec2 " + name + " = vec2(" + f + "(" + a[0] + ".x, " + a[1] + (falling ? ".y" : ".x") + rest + ", "
+         + f + "(" + a[0] + ".y, " + a[1] + (falling ? ".x" : ".y") + rest + ");";
+}
+
+// Selects item [begin, end) by halving the range, a switch over hundreds of
+// cases is slow to compile and some drivers get it wrong. Every item's
+// instructions run from the previous item's root. `varying` is given for
+// sceneItemInterval, else this emits sceneItemSegment.
+static void SceneEmitItems(std::stringstream& out, const SceneProgram& program, int begin, int end, int depth,
+                           const std::vector<bool>* varying = nullptr)
+{
+    std::string indent(4 * depth, ' ');
+    if (end - begin == 1)
+    {
+        int root = program.items[begin].root;
+        for (int i = begin ? program.items[begin - 1].root + 1 : 0; i <= root; ++i)
+        {
+            if (!varying)
+                SceneEmitSegmentStatement(out, program, i, indent);
+            else
+            {
+                std::string statement = SceneIntervalStatement(program, *varying, i);
+                if (!statement.empty())
+                    out << indent << statement << "\n";
+            }
+        }
+        if (varying)
+            out << indent << "return " << SceneOperand(program, root) << ";\n";
+        else
+            out << indent << "return vec3(" << SceneOperand(program, root) << ", l" << root << ");\n";
+        return;
+    }
+    int middle = (begin + end) / 2;
+    out << indent << "if (item.x < " << middle << "u) {\n";
+    SceneEmitItems(out, program, begin, middle, depth + 1, varying);
+    out << indent << "} else {\n";
+    SceneEmitItems(out, program, middle, end, depth + 1, varying);
+    out << indent << "}\n";
+}
+
+std::string SceneProgram::EmitGLSL() const
+{
+    std::stringstream out;
+    out << "// Generated from " << name << ": " << code.size() << " instructions, "
+        << folded << " folded, " << shared << " shared";
+    if (!items.empty())
+        out << ", " << items.size() << " items";
+    out << "\n";
+
+    out << "const vec4 kSceneBoundSphere = vec4(" << SceneFloatLiteral(boundSphere.x) << ", " << SceneFloatLiteral(boundSphere.y) << ", "
+        << SceneFloatLiteral(boundSphere.z) << ", " << SceneFloatLiteral(boundSphere.w) << ");\n";
+    out << "const int  kBoundedNodeCount = " << boundsMin.size() << ";\n";
+    for (int side = 0; side < 2; ++side)
+    {
+        const std::vector<glm::vec3>& bounds = side == 0 ? boundsMin : boundsMax;
+        out << (side == 0 ? "const vec3 kNodeBoundsMin" : "const vec3 kNodeBoundsMax") << "[kBoundedNodeCount] = vec3[](";
+        for (size_t i = 0; i < bounds.size(); ++i)
+            out << (i ? ", " : "") << SceneVec3Literal(bounds[i]);
+        out << ");\n";
+    }
+    if (!cells.empty())
+    {
+        out << "#define SCENE_CELLS\nconst int  kSceneCellCount = " << cells.size() << ";\n";
+        out << "const SceneCell kSceneCells[kSceneCellCount] = SceneCell[](";
+        for (size_t i = 0; i < cells.size(); ++i)
+        {
+            const SceneCell& cell = cells[i];
+            out << (i ? ",\n    " : "\n    ") << "SceneCell(vec4[3](" << SceneVec4Literal(cell.toLocal[0]) << ", " << SceneVec4Literal(cell.toLocal[1])
+                << ", " << SceneVec4Literal(cell.toLocal[2]) << "), " << SceneVec4Literal(cell.period) << ", " << SceneVec4Literal(cell.freeMin)
+                << ", " << SceneVec4Literal(cell.freeMax) << ", " << SceneVec4Literal(cell.boundsMin) << ", " << SceneVec4Literal(cell.boundsMax) << ")";
+        }
+        out << ");\n";
+    }
+
+    for (size_t i = 0; i < code.size(); ++i)
+    {
+        const SceneInstr& in = code[i];
+        if (SceneIsPrimitive(in.op) && in.imm[5] > 0.0f)
+            out << "const SdfNodeLOD kSceneNode" << i << " = SdfNodeLOD(vec4(" << SceneFloatLiteral(in.imm[1]) << ", " << SceneFloatLiteral(in.imm[2])
+                << ", " << SceneFloatLiteral(in.imm[3]) << ", " << SceneFloatLiteral(in.imm[4]) << "), " << SceneFloatLiteral(in.imm[5]) << ");\n";
+    }
+
+    std::vector<bool> varying = SceneVaryingValues(*this);
+    if (!items.empty())
+    {
+        out << "\nvec3 sceneItemSegment(uvec4 item, vec3 p, float footprint, float segment) {\n";
+        SceneEmitItems(out, *this, 0, (int)items.size(), 1);
+        out << "}\n";
+        out << "\nvec2 sceneItemInterval(uvec4 item, vec3 lo, vec3 hi, float footprint) {\n";
+        SceneEmitItems(out, *this, 0, (int)items.size(), 1, &varying);
+        out << "}\n";
+        return out.str();
+    }
+
+    if (baked >= 0)
+    {
+        std::vector<bool> inside = SceneSubtree(*this, baked);
+        out << "\nvec2 sceneBakedExact(vec3 p) {\n    const float footprint = 0.0;\n";
+        for (int i = 0; i <= baked; ++i)
+        {
+            std::string statement = inside[i] ? SceneStatement(*this, i, false) : "";
+            if (!statement.empty())
+                out << "    " << statement << "\n";
+        }
+        out << "    return " << SceneOperand(*this, baked) << ";\n}\n";
+    }
+
+    // Instructions of the baked subtree nothing else reads run only where the
+    // volume has no bound, the subtree's root is assigned in that branch
+    std::vector<bool> exclusive(code.size(), false);
+    if (baked >= 0)
+    {
+        std::vector<bool> outside(code.size(), false);
+        outside.back() = true;
+        for (int i = (int)code.size() - 1; i >= 0; --i)
+            if (outside[i] && i != baked)
+                for (int k = 0; k < 4; ++k)
+                    if (code[i].args[k] >= 0)
+                        outside[code[i].args[k]] = true;
+        std::vector<bool> inside = SceneSubtree(*this, baked);
+        for (size_t i = 0; i < code.size(); ++i)
+            exclusive[i] = inside[i] && !outside[i];
+    }
+
+    out << "\nvec3 sdfSceneSegment(vec3 p, float footprint, float segment) {\n";
+    for (size_t i = 0; i < code.size(); ++i)
+    {
+        if (exclusive[i] && (int)i != baked)
+            continue;
+        if ((int)i != baked)
+        {
+            SceneEmitSegmentStatement(out, *this, (int)i, "    ");
+            continue;
+        }
+
+        std::string v = "v" + std::to_string(i), l = "l" + std::to_string(i);
+        out << "    vec2 " << v << "; float " << l << ";\n";
+        out << "    if (sceneVolumeDistance(p, " << v << ".x)) {\n";
+        out << "        " << v << ".y = " << SceneFloatLiteral(bakedMaterial) << "; " << l << " = " << SceneFloatLiteral(bakedLipschitz) << ";\n";
+        out << "    } else {\n";
+        for (int k = 0; k < baked; ++k)
+            if (exclusive[k])
+                SceneEmitSegmentStatement(out, *this, k, "        ");
+        std::string statement = SceneStatement(*this, baked, false);
+        out << "        " << statement.substr(statement.find(v + " =")) << "\n";
+        statement = SceneLipschitzStatement(*this, baked);
+        out << "        " << statement.substr(statement.find(l + " =")) << "\n";
+        out << "    }\n";
+    }
+    out << "    return vec3(" << SceneOperand(*this, (int)code.size() - 1) << ", l" << code.size() - 1 << ");\n}\n";
+
+    out << "\nvec2 sdfSceneInterval(vec3 lo, vec3 hi, float footprint) {\n";
+    for (size_t i = 0; i < code.size(); ++i)
+    {
+        std::string statement = SceneIntervalStatement(*this, varying, (int)i);
+        if (!statement.empty())
+            out << "    " << statement << "\n";
+    }
+    out << "    return " << SceneOperand(*this, (int)code.size() - 1) << ";\n}\n";
+
+    if (HasGradient())
+    {
+        out << "\n#ifdef ANALYTIC_NORMALS\nvec4 sdfSceneGrad(vec3 p) {\n    const float footprint = 0.0;\n";
+        for (size_t i = 0; i < code.size(); ++i)
+        {
+            std::string statement = SceneStatement(*this, (int)i, true);
+            if (!statement.empty())
+                out << "    " << statement << "\n";
+        }
+        out << "    return " << SceneOperand(*this, (int)code.size() - 1) << ";\n}\n#endif\n";
+    }
+    return out.str();
+}
+
+// ──────────────────────────────────────────────────────────────────────── //
+//                                  PARSER                                  //
+// ──────────────────────────────────────────────────────────────────────── //
+
+struct SceneExpr
+{
+    enum Kind { NUMBER, VECTOR, PARAM, SYMBOL, KEYWORD, LIST };
+
+    Kind                   kind = LIST;
+    std::string            text;        // Symbol, parameter or keyword name
+    std::vector<float>     numbers;     // NUMBER, VECTOR
+    std::vector<SceneExpr> items;       // LIST, items[0] is the head symbol
+    int                    line = 0;
+};
+
+struct SceneParser
+{
+    const std::string& source;
+    size_t      pos = 0;
+    int         line = 1;
+    std::string error;
+
+    explicit SceneParser(const std::string& text) : source(text) {}
+
+    // Whitespace and ; comments
+    void SkipSpace()
+    {
+        while (pos < source.size())
+        {
+            char c = source[pos];
+            if (c == ';')
+            {
+                while (pos < source.size() && source[pos] != '\n')
+                    pos++;
+            }
+            else if (std::isspace((unsigned char)c))
+            {
+                if (c == '\n')
+                    line++;
+                pos++;
+            }
+            else
+                break;
+        }
+    }
+
+    bool AtEnd()
+    {
+        SkipSpace();
+        return pos >= source.size();
+    }
+
+    std::string Token()
+    {
+        size_t start = pos;
+        while (pos < source.size() && !std::isspace((unsigned char)source[pos]) && !std::strchr("()[];", source[pos]))
+            pos++;
+        return source.substr(start, pos - start);
+    }
+
+    static bool ParseNumber(const std::string& token, float& value)
+    {
+        char* end = nullptr;
+        value = std::strtof(token.c_str(), &end);
+        return !token.empty() && *end == '\0' && (std::isdigit((unsigned char)token[0]) || std::strchr("+-.", token[0]));
+    }
+
+    bool Fail(const std::string& message)
+    {
+        error = "line " + std::to_string(line) + ": " + message;
+        return false;
+    }
+
+    bool ParseItem(SceneExpr& out)
+    {
+        if (AtEnd())
+            return Fail("unexpected end of file");
+        out.line = line;
+
+        char c = source[pos];
+        if (c == '(')
+        {
+            pos++;
+            out.kind = SceneExpr::LIST;
+            while (true)
+            {
+                if (AtEnd())
+                    return Fail("missing ')'");
+                if (source[pos] == ')')
+                {
+                    pos++;
+                    break;
+                }
+                SceneExpr item;
+                if (!ParseItem(item))
+                    return false;
+                out.items.push_back(item);
+            }
+            if (out.items.empty() || out.items[0].kind != SceneExpr::SYMBOL)
+                return Fail("a list starts with a node or operator name");
+            return true;
+        }
+        if (c == '[')
+        {
+            pos++;
+            out.kind = SceneExpr::VECTOR;
+            while (true)
+            {
+                if (AtEnd())
+                    return Fail("missing ']'");
+                if (source[pos] == ']')
+                {
+                    pos++;
+                    break;
+                }
+                float value;
+                std::string token = Token();
+                if (!ParseNumber(token, value))
+                    return Fail("vectors hold numbers, got '" + token + "'");
+                out.numbers.push_back(value);
+            }
+            if (out.numbers.empty() || out.numbers.size() > 4)
+                return Fail("vectors have 1 to 4 components");
+            return true;
+        }
+        if (c == ')' || c == ']')
+            return Fail(std::string("unexpected '") + c + "'");
+
+        std::string token = Token();
+        float value;
+        if (token[0] == '$')
+        {
+            out.kind = SceneExpr::PARAM;
+            out.text = token.substr(1);
+        }
+        else if (token[0] == ':')
+        {
+            out.kind = SceneExpr::KEYWORD;
+            out.text = token.substr(1);
+        }
+        else if (ParseNumber(token, value))
+        {
+            out.kind = SceneExpr::NUMBER;
+            out.numbers.push_back(value);
+        }
+        else
+        {
+            out.kind = SceneExpr::SYMBOL;
+            out.text = token;
+        }
+        return true;
+    }
+};
+
+// ──────────────────────────────────────────────────────────────────────── //
+//                                 LOWERING                                 //
+// ──────────────────────────────────────────────────────────────────────── //
+
+enum SceneNodeClass
+{
+    SNC_PRIMITIVE, SNC_DOMAIN, SNC_COMBINATOR, SNC_MODIFIER
+};
+
+// Positional arguments: f float, v vec3 (floats broadcast), a float or vec3,
+// n constant float, P plane (two axes, e.g. xz), X axis
+struct SceneNodeInfo
+{
+    const char*    name;
+    SceneNodeClass nodeClass;
+    SceneOp        op;
+    const char*    args;
+};
+
+static const SceneNodeInfo sceneNodeInfos[] =
+{
+    { "fSphere",        SNC_PRIMITIVE, SOP_SPHERE,       "f"  },
+    { "fBox",           SNC_PRIMITIVE, SOP_BOX,          "v"  },
+    { "fBoxCheap",      SNC_PRIMITIVE, SOP_BOX_CHEAP,    "v"  },
+    { "fPlane",         SNC_PRIMITIVE, SOP_PLANE,        "vf" },
+    { "fCylinder",      SNC_PRIMITIVE, SOP_CYLINDER,     "ff" },
+    { "fCapsule",       SNC_PRIMITIVE, SOP_CAPSULE,      "ff" },
+    { "fTorus",         SNC_PRIMITIVE, SOP_TORUS,        "ff" },
+    { "fCone",          SNC_PRIMITIVE, SOP_CONE,         "ff" },
+    { "fOctahedron",    SNC_PRIMITIVE, SOP_OCTAHEDRON,   "f"  },
+    { "fDodecahedron",  SNC_PRIMITIVE, SOP_DODECAHEDRON, "f"  },
+    { "fIcosahedron",   SNC_PRIMITIVE, SOP_ICOSAHEDRON,  "f"  },
+    { "julia",          SNC_PRIMITIVE, SOP_JULIA,        ""   },
+
+    { "translate",      SNC_DOMAIN,    SOP_TRANSLATE,    "v"  },
+    { "pR",             SNC_DOMAIN,    SOP_ROTATE,       "Pf" },
+    { "pMod1",          SNC_DOMAIN,    SOP_MOD1,         "Xf" },
+    { "pMod2",          SNC_DOMAIN,    SOP_MOD2,         "Pa" },
+    { "pMod3",          SNC_DOMAIN,    SOP_MOD3,         "a"  },
+    { "pModPolar",      SNC_DOMAIN,    SOP_MOD_POLAR,    "Pn" },
+    { "pModGrid2",      SNC_DOMAIN,    SOP_MOD_GRID2,    "Pa" },
+    { "pMirror",        SNC_DOMAIN,    SOP_MIRROR,       "Xf" },
+    { "scale",          SNC_DOMAIN,    SOP_SCALE_DIST,   "f"  },
+
+    { "union",                  SNC_COMBINATOR, SOP_UNION,                 ""   },
+    { "intersection",           SNC_COMBINATOR, SOP_INTERSECTION,          ""   },
+    { "difference",             SNC_COMBINATOR, SOP_DIFFERENCE,            ""   },
+    { "fOpUnionRound",          SNC_COMBINATOR, SOP_UNION_ROUND,           "f"  },
+    { "fOpIntersectionRound",   SNC_COMBINATOR, SOP_INTERSECTION_ROUND,    "f"  },
+    { "fOpDifferenceRound",     SNC_COMBINATOR, SOP_DIFFERENCE_ROUND,      "f"  },
+    { "fOpUnionChamfer",        SNC_COMBINATOR, SOP_UNION_CHAMFER,         "f"  },
+    { "fOpIntersectionChamfer", SNC_COMBINATOR, SOP_INTERSECTION_CHAMFER,  "f"  },
+    { "fOpDifferenceChamfer",   SNC_COMBINATOR, SOP_DIFFERENCE_CHAMFER,    "f"  },
+    { "fOpUnionStairs",         SNC_COMBINATOR, SOP_UNION_STAIRS,          "fn" },
+    { "fOpIntersectionStairs",  SNC_COMBINATOR, SOP_INTERSECTION_STAIRS,   "fn" },
+    { "fOpDifferenceStairs",    SNC_COMBINATOR, SOP_DIFFERENCE_STAIRS,     "fn" },
+    { "fOpUnionSoft",           SNC_COMBINATOR, SOP_UNION_SOFT,            "f"  },
+
+    { "round",          SNC_MODIFIER,  SOP_OFFSET_DIST,  "f"  },
+};
+
+static const SceneNodeInfo* FindSceneNode(const SceneExpr& expr)
+{
+    if (expr.kind != SceneExpr::LIST)
+        return nullptr;
+    for (const SceneNodeInfo& info : sceneNodeInfos)
+        if (expr.items[0].text == info.name)
+            return &info;
+    return nullptr;
+}
+
+// World-space box of the geometry a node adds, sphere.w < 0 when there is no
+// bounding sphere tighter than the box
+struct SceneBounds
+{
+    glm::vec3 min, max;
+    glm::vec4 sphere;
+};
+
+static SceneBounds SceneUnboundedBox()
+{
+    return { glm::vec3(-SCENE_UNBOUNDED), glm::vec3(SCENE_UNBOUNDED), glm::vec4(0.0f, 0.0f, 0.0f, -1.0f) };
+}
+
+static SceneBounds SceneMergeBounds(const std::vector<SceneBounds>& parts)
+{
+    if (parts.size() == 1)
+        return parts[0];
+    SceneBounds merged = { glm::vec3(SCENE_UNBOUNDED), glm::vec3(-SCENE_UNBOUNDED), glm::vec4(0.0f, 0.0f, 0.0f, -1.0f) };
+    for (const SceneBounds& part : parts)
+    {
+        merged.min = glm::min(merged.min, part.min);
+        merged.max = glm::max(merged.max, part.max);
+    }
+    return merged;
+}
+
+// Cuts the parts down to `clip`, dropping those outside it
+static void SceneClipBounds(std::vector<SceneBounds>& parts, const SceneBounds& clip)
+{
+    std::vector<SceneBounds> inside;
+    for (SceneBounds part : parts)
+    {
+        part.min = glm::max(part.min, clip.min);
+        part.max = glm::min(part.max, clip.max);
+        part.sphere.w = -1.0f;
+        if (part.min.x <= part.max.x && part.min.y <= part.max.y && part.min.z <= part.max.z)
+            inside.push_back(part);
+    }
+    parts = inside;
+}
+
+static void SceneInflateBounds(std::vector<SceneBounds>& parts, float r)
+{
+    for (SceneBounds& part : parts)
+    {
+        part.min -= glm::vec3(r);
+        part.max += glm::vec3(r);
+        if (part.sphere.w >= 0.0f)
+            part.sphere.w += r;
+    }
+}
+
+// Box of a primitive around its local origin from its sizes, unbounded when
+// they aren't constant (null)
+static SceneBounds ScenePrimitiveBounds(SceneOp op, int count, const glm::vec3* const* sizes)
+{
+    std::vector<glm::vec3> v;
+    for (int i = 0; i < count; ++i)
+    {
+        if (!sizes[i])
+            return SceneUnboundedBox();
+        v.push_back(*sizes[i]);
+    }
+
+    glm::vec3 extent;
+    switch (op)
+    {
+        case SOP_SPHERE:
+            return { -v[0], v[0], glm::vec4(0.0f, 0.0f, 0.0f, v[0].x) };
+        case SOP_BOX: case SOP_BOX_CHEAP:
+            extent = v[0];
+            break;
+        case SOP_CYLINDER:
+            extent = glm::vec3(v[0].x, v[1].x, v[0].x);
+            break;
+        case SOP_CAPSULE:
+            extent = glm::vec3(v[0].x, v[1].x + v[0].x, v[0].x);
+            break;
+        case SOP_TORUS:
+            extent = glm::vec3(v[0].x + v[1].x, v[0].x, v[0].x + v[1].x);
+            break;
+        case SOP_CONE:
+            return { glm::vec3(-v[0].x, 0.0f, -v[0].x), glm::vec3(v[0].x, v[1].x, v[0].x), glm::vec4(0.0f, 0.0f, 0.0f, -1.0f) };
+        case SOP_OCTAHEDRON: case SOP_DODECAHEDRON: case SOP_ICOSAHEDRON:
+            extent = glm::vec3(v[0].x * std::sqrt(3.0f));     // Circumradius of all three is below r·√3
+            break;
+        case SOP_JULIA:
+            return { SCENE_JULIA_BOUNDS_MIN, SCENE_JULIA_BOUNDS_MAX, glm::vec4(0.0f, 0.0f, 0.0f, -1.0f) };
+        default:
+            return SceneUnboundedBox();
+    }
+    return { -extent, extent, glm::vec4(0.0f, 0.0f, 0.0f, glm::length(extent)) };
+}
+
+// Maps child bounds (in a domain operator's output space) back into its input
+// space. `operand` is the offset, angle or mirror distance, null when it isn't
+// constant.
+static void SceneDomainBounds(SceneOp op, int u, int v, const glm::vec3* operand, std::vector<SceneBounds>& parts)
+{
+    for (SceneBounds& part : parts)
+    {
+        switch (op)
+        {
+            case SOP_TRANSLATE:
+            {
+                if (!operand)
+                {
+                    part = SceneUnboundedBox();
+                    break;
+                }
+                glm::vec3 offset = *operand;
+                part.min += offset;
+                part.max += offset;
+                part.sphere += glm::vec4(offset, 0.0f);
+                break;
+            }
+            case SOP_ROTATE:
+            {
+                if (!operand)
+                {
+                    part = SceneUnboundedBox();
+                    break;
+                }
+                // Inverse rotation of the corners
+                float c = std::cos(operand->x), s = std::sin(operand->x);
+                auto unrotate = [&](glm::vec3 q) {
+                    glm::vec3 p = q;
+                    p[u] = c * q[u] - s * q[v];
+                    p[v] = s * q[u] + c * q[v];
+                    return p;
+                };
+                glm::vec3 lo(SCENE_UNBOUNDED), hi(-SCENE_UNBOUNDED);
+                for (int corner = 0; corner < 8; ++corner)
+                {
+                    glm::vec3 q((corner & 1) ? part.max.x : part.min.x, (corner & 2) ? part.max.y : part.min.y, (corner & 4) ? part.max.z : part.min.z);
+                    lo = glm::min(lo, unrotate(q));
+                    hi = glm::max(hi, unrotate(q));
+                }
+                part.min = lo;
+                part.max = hi;
+                if (part.sphere.w >= 0.0f)
+                    part.sphere = glm::vec4(unrotate(glm::vec3(part.sphere)), part.sphere.w);
+                break;
+            }
+            case SOP_MOD1:
+                part.min[u] = -SCENE_UNBOUNDED;
+                part.max[u] = SCENE_UNBOUNDED;
+                part.sphere.w = -1.0f;
+                break;
+            case SOP_MOD2: case SOP_MOD_GRID2:
+                part.min[u] = part.min[v] = -SCENE_UNBOUNDED;
+                part.max[u] = part.max[v] = SCENE_UNBOUNDED;
+                part.sphere.w = -1.0f;
+                break;
+            case SOP_MOD3:
+                part = SceneUnboundedBox();
+                break;
+            case SOP_MOD_POLAR:
+            {
+                // Every repetition stays within the farthest corner's radius
+                float radius = 0.0f;
+                for (int corner = 0; corner < 4; ++corner)
+                {
+                    float x = (corner & 1) ? part.max[u] : part.min[u];
+                    float y = (corner & 2) ? part.max[v] : part.min[v];
+                    radius = std::max(radius, std::sqrt(x * x + y * y));
+                }
+                part.min[u] = part.min[v] = -radius;
+                part.max[u] = part.max[v] = radius;
+                part.sphere.w = -1.0f;
+                break;
+            }
+            case SOP_MIRROR:
+            {
+                if (!operand)
+                {
+                    part = SceneUnboundedBox();
+                    break;
+                }
+                float reach = std::max(part.max[u] + operand->x, 0.0f);
+                part.min[u] = -reach;
+                part.max[u] = reach;
+                part.sphere.w = -1.0f;
+                break;
+            }
+            default:
+                break;
+        }
+        part.min = glm::max(part.min, glm::vec3(-SCENE_UNBOUNDED));
+        part.max = glm::min(part.max, glm::vec3(SCENE_UNBOUNDED));
+    }
+}
+
+// Bounds of a node from those of its children and its operands, null where
+// they aren't constant. The compiler derives them through here, and
+// SceneProgram::ItemBounds again with the parameters at other values.
+static void SceneNodeBoundsOf(const SceneBoundsNode& node, const glm::vec3* const* operands,
+                              const std::vector<std::vector<SceneBounds>>& children, std::vector<SceneBounds>& parts)
+{
+    if (SceneIsPrimitive(node.op))
+    {
+        // The proxy is a lower bound, so the surface lies inside it
+        SceneBounds bounds = ScenePrimitiveBounds(node.op, node.operands, operands);
+        if (node.proxy.w >= 0.0f)
+        {
+            bounds.min = glm::max(bounds.min, glm::vec3(node.proxy) - node.proxy.w);
+            bounds.max = glm::min(bounds.max, glm::vec3(node.proxy) + node.proxy.w);
+            if (bounds.sphere.w < 0.0f || node.proxy.w < bounds.sphere.w)
+                bounds.sphere = node.proxy;
+        }
+        parts.push_back(bounds);
+    }
+    else if (SceneIsCombinator(node.op))
+    {
+        std::vector<SceneBounds> firstParts = children[0];
+        SceneBounds common = SceneMergeBounds(firstParts);
+        for (size_t k = 1; k < children.size(); ++k)
+        {
+            SceneBounds child = SceneMergeBounds(children[k]);
+            if (SceneIsUnionOp(node.op))
+                firstParts.insert(firstParts.end(), children[k].begin(), children[k].end());
+            common.min = glm::max(common.min, child.min);
+            common.max = glm::min(common.max, child.max);
+            common.sphere.w = -1.0f;
+        }
+
+        // Intersections keep the overlap, differences their first child. Smooth
+        // variants reach up to r beyond the sharp result.
+        if (SceneIsUnionOp(node.op) || SceneIsDifferenceOp(node.op))
+            parts.insert(parts.end(), firstParts.begin(), firstParts.end());
+        else
+            parts.push_back(common);
+        if (node.operands > 0)
+        {
+            if (SceneIsUnionOp(node.op))
+            {
+                SceneBounds merged = SceneMergeBounds(parts);
+                parts.assign(1, merged);
+            }
+            if (operands[0])
+                SceneInflateBounds(parts, std::abs(operands[0]->x));
+            else
+                parts.assign(1, SceneUnboundedBox());
+        }
+    }
+    else
+    {
+        // Domain operators and modifiers see the union of their children
+        for (const std::vector<SceneBounds>& child : children)
+            parts.insert(parts.end(), child.begin(), child.end());
+        if (node.op == SOP_SCALE_DIST)
+        {
+            float s = operands[0] ? operands[0]->x : -1.0f;
+            for (SceneBounds& part : parts)
+            {
+                if (s > 0.0f)
+                {
+                    part.min = glm::max(part.min * s, glm::vec3(-SCENE_UNBOUNDED));
+                    part.max = glm::min(part.max * s, glm::vec3(SCENE_UNBOUNDED));
+                    part.sphere *= s;
+                }
+                else
+                    part = SceneUnboundedBox();
+            }
+        }
+        else if (node.op == SOP_OFFSET_DIST)
+        {
+            if (!operands[0])
+                parts.assign(1, SceneUnboundedBox());
+            else if (operands[0]->x > 0.0f)
+                SceneInflateBounds(parts, operands[0]->x);
+        }
+        else
+            SceneDomainBounds(node.op, node.axes[0], node.axes[1], operands[0], parts);
+    }
+
+    if (node.clip)
+    {
+        SceneBounds clip = { node.clipMin, node.clipMax, glm::vec4(0.0f, 0.0f, 0.0f, -1.0f) };
+        if (SceneIsPrimitive(node.op) && parts.size() == 1)
+            clip.sphere = parts[0].sphere;
+        parts.assign(1, clip);
+    }
+}
+
+// A value (no position or footprint below it) with the parameters at `paramValues`
+static glm::vec4 SceneEvalValue(const SceneProgram& program, int value, const std::vector<glm::vec3>& paramValues)
+{
+    const SceneInstr& in = program.code[value];
+    glm::vec4 operands[4];
+    for (int k = 0; k < 4; ++k)
+        operands[k] = in.args[k] >= 0 ? SceneEvalValue(program, in.args[k], paramValues) : glm::vec4(0.0f);
+    return SceneEvalInstr(in, operands, glm::vec3(0.0f), 0.0f, 0.0f, paramValues);
+}
+
+// Operands of a bounds node for SceneNodeBoundsOf: the constants, and with
+// `paramValues` the others evaluated into `values` too
+static void SceneBoundsOperands(const SceneProgram& program, const SceneBoundsNode& node, const std::vector<glm::vec3>* paramValues,
+                                glm::vec3* values, const glm::vec3** operands)
+{
+    for (int k = 0; k < 2; ++k)
+    {
+        operands[k] = nullptr;
+        if (k >= node.operands)
+            continue;
+        if (node.args[k] == -1)
+            operands[k] = &node.values[k];
+        else if (node.args[k] >= 0 && paramValues)
+        {
+            values[k] = glm::vec3(SceneEvalValue(program, node.args[k], *paramValues));
+            operands[k] = &values[k];
+        }
+    }
+}
+
+// Parts of the bounds node at `index` with the parameters at `paramValues`,
+// returns the index after its subtree
+static int SceneReplayBounds(const SceneProgram& program, int index, const std::vector<glm::vec3>& paramValues, std::vector<SceneBounds>& parts)
+{
+    const SceneBoundsNode& node = program.bounds[index++];
+    std::vector<std::vector<SceneBounds>> children(node.children);
+    for (std::vector<SceneBounds>& child : children)
+        index = SceneReplayBounds(program, index, paramValues, child);
+
+    glm::vec3 values[2];
+    const glm::vec3* operands[2];
+    SceneBoundsOperands(program, node, &paramValues, values, operands);
+    std::vector<SceneBounds> own;
+    SceneNodeBoundsOf(node, operands, children, own);
+    parts.insert(parts.end(), own.begin(), own.end());
+    return index;
+}
+
+// Index after the subtree of the bounds node at `index`
+static int SceneSkipBounds(const SceneProgram& program, int index)
+{
+    int pending = 1;
+    while (pending-- > 0)
+        pending += program.bounds[index++].children;
+    return index;
+}
+
+// Parts holding every change of the bounds node at `index` between the
+// parameter values in paramValues[0] and [1]; `changed` has a bit per
+// parameter that differs. Returns the index after its subtree.
+static int SceneChangedBounds(const SceneProgram& program, int index, const std::vector<glm::vec3>* paramValues, unsigned changed,
+                              bool clipped, std::vector<SceneBounds>& out)
+{
+    const SceneBoundsNode& node = program.bounds[index];
+    if (!(node.subtreeParams & changed))
+        return SceneSkipBounds(program, index);
+
+    // Its own operands changed: anywhere it was or is now
+    if (node.params & changed)
+    {
+        SceneReplayBounds(program, index, paramValues[0], out);
+        return SceneReplayBounds(program, index, paramValues[1], out);
+    }
+
+    std::vector<std::vector<SceneBounds>> children(node.children);
+    int next = index + 1;
+    for (std::vector<SceneBounds>& child : children)
+        next = SceneChangedBounds(program, next, paramValues, changed, clipped, child);
+
+    glm::vec3 values[2];
+    const glm::vec3* operands[2];
+    SceneBoundsOperands(program, node, &paramValues[1], values, operands);
+    std::vector<SceneBounds> parts;
+    if (SceneIsCombinator(node.op))
+    {
+        for (const std::vector<SceneBounds>& child : children)
+            parts.insert(parts.end(), child.begin(), child.end());
+        if (node.operands > 0)
+        {
+            if (operands[0])
+                SceneInflateBounds(parts, std::abs(operands[0]->x));
+            else
+                parts.assign(1, SceneUnboundedBox());
+        }
+
+        // Intersections and differences show their children only within their own result
+        if (clipped && !SceneIsUnionOp(node.op))
+        {
+            std::vector<SceneBounds> result;
+            SceneReplayBounds(program, index, paramValues[0], result);
+            SceneReplayBounds(program, index, paramValues[1], result);
+            SceneClipBounds(parts, SceneMergeBounds(result));
+        }
+    }
+    else
+    {
+        SceneBoundsNode unclipped = node;
+        unclipped.clip = false;
+        SceneNodeBoundsOf(unclipped, operands, children, parts);
+    }
+    if (clipped && node.clip)
+        SceneClipBounds(parts, { node.clipMin, node.clipMax, glm::vec4(0.0f, 0.0f, 0.0f, -1.0f) });
+    out.insert(out.end(), parts.begin(), parts.end());
+    return next;
+}
+
+// Lowers the parsed tree into a SceneProgram. Every instruction goes through
+// Emit, which folds constants and returns the existing instruction for
+// anything already emitted.
+struct SceneLowering
+{
+    SceneProgram& program;
+    std::string   error;
+    std::map<std::string, int> emitted;
+    const SceneParams* frozen = nullptr;    // Parameters become constants, for ItemBounds
+    bool          usesParams = false;
+    std::map<int, SceneBounds> nodeBounds;  // Geometry of every distance a node produced
+
+    explicit SceneLowering(SceneProgram& target) : program(target) {}
+
+    int Fail(const SceneExpr& at, const std::string& message)
+    {
+        if (error.empty())
+            error = "line " + std::to_string(at.line) + ": " + message;
+        return -1;
+    }
+
+    SceneValueType Type(int value) const { return program.code[value].type; }
+
+    bool IsConst(int value) const { return value >= 0 && program.code[value].op == SOP_CONST; }
+
+    bool ConstEquals(int value, float x) const
+    {
+        if (!IsConst(value))
+            return false;
+        const SceneInstr& in = program.code[value];
+        return in.imm[0] == x && in.imm[1] == x && in.imm[2] == x;
+    }
+
+    static SceneInstr Instr(SceneOp op, SceneValueType type, int a0 = -1, int a1 = -1, int a2 = -1, int a3 = -1)
+    {
+        SceneInstr in;
+        std::memset(&in, 0, sizeof(in));
+        in.op = op;
+        in.type = type;
+        in.args[0] = a0; in.args[1] = a1; in.args[2] = a2; in.args[3] = a3;
+        return in;
+    }
+
+    int Const(const glm::vec3& value, SceneValueType type)
+    {
+        SceneInstr in = Instr(SOP_CONST, type);
+        in.imm[0] = value.x; in.imm[1] = value.y; in.imm[2] = value.z;
+        return Emit(in);
+    }
+
+    int Const(float value) { return Const(glm::vec3(value), SVT_FLOAT); }
+
+    // Replacement for an instruction that constant folding or an algebraic
+    // identity makes redundant, -1 when it has to be emitted
+    int Fold(const SceneInstr& in)
+    {
+        int a = in.args[0], b = in.args[1], c = in.args[2];
+        switch (in.op)
+        {
+            case SOP_ADD: case SOP_SUB: case SOP_MUL: case SOP_DIV: case SOP_NEG: case SOP_SIN: case SOP_COS:
+            {
+                if (IsConst(a) && (b < 0 || IsConst(b)))
+                {
+                    glm::vec4 operands[4] = { glm::vec4(0.0f), glm::vec4(0.0f), glm::vec4(0.0f), glm::vec4(0.0f) };
+                    for (int k = 0; k < 2; ++k)
+                        if (in.args[k] >= 0)
+                            operands[k] = glm::vec4(program.code[in.args[k]].imm[0], program.code[in.args[k]].imm[1], program.code[in.args[k]].imm[2], 0.0f);
+                    glm::vec4 value = SceneEvalInstr(in, operands, glm::vec3(0.0f), 0.0f, 0.0f, std::vector<glm::vec3>());
+                    return Const(glm::vec3(value), in.type);
+                }
+                if (in.op == SOP_ADD && ConstEquals(a, 0.0f) && Type(b) == in.type) return b;
+                if ((in.op == SOP_ADD || in.op == SOP_SUB) && ConstEquals(b, 0.0f) && Type(a) == in.type) return a;
+                if (in.op == SOP_MUL && ConstEquals(a, 1.0f) && Type(b) == in.type) return b;
+                if ((in.op == SOP_MUL || in.op == SOP_DIV) && ConstEquals(b, 1.0f) && Type(a) == in.type) return a;
+                if (in.op == SOP_NEG && program.code[a].op == SOP_NEG) return program.code[a].args[0];
+                return -1;
+            }
+            case SOP_TRANSLATE:
+            {
+                if (ConstEquals(b, 0.0f))
+                    return a;
+                // Nested translations become one, constant offsets add up at compile time
+                SceneInstr inner = program.code[a];
+                if (inner.op == SOP_TRANSLATE)
+                    return Emit(Instr(SOP_TRANSLATE, SVT_VEC3, inner.args[0], Emit(Instr(SOP_ADD, SVT_VEC3, inner.args[1], b))));
+                return -1;
+            }
+            case SOP_ROTATE:
+            {
+                if (ConstEquals(b, 1.0f) && ConstEquals(c, 0.0f))
+                    return a;
+                // Constant rotations in the same plane combine into one
+                SceneInstr inner = program.code[a];
+                if (inner.op == SOP_ROTATE && inner.imm[0] == in.imm[0] && inner.imm[1] == in.imm[1]
+                    && IsConst(b) && IsConst(c) && IsConst(inner.args[1]) && IsConst(inner.args[2]))
+                {
+                    float c1 = program.code[inner.args[1]].imm[0], s1 = program.code[inner.args[2]].imm[0];
+                    float c2 = program.code[b].imm[0], s2 = program.code[c].imm[0];
+                    SceneInstr rotate = in;
+                    rotate.args[0] = inner.args[0];
+                    rotate.args[1] = Const(c1 * c2 - s1 * s2);
+                    rotate.args[2] = Const(s1 * c2 + c1 * s2);
+                    return Emit(rotate);
+                }
+                return -1;
+            }
+            case SOP_UNION: case SOP_INTERSECTION:
+                return a == b ? a : -1;
+            case SOP_SCALE_DIST:
+                return ConstEquals(b, 1.0f) ? a : -1;
+            case SOP_OFFSET_DIST:
+                return ConstEquals(b, 0.0f) ? a : -1;
+            default:
+                return -1;
+        }
+    }
+
+    // SceneInstr::stretch from the operands', the largest |k| of a constant
+    // scale; anything a parameter scales is unbounded
+    float Stretch(const SceneInstr& in) const
+    {
+        auto stretch = [&](int k) { return in.args[k] >= 0 ? program.code[in.args[k]].stretch : 0.0f; };
+        auto constScale = [&](int k, bool inverse)
+        {
+            const SceneInstr& c = program.code[in.args[k]];
+            float scale = 0.0f;
+            for (int i = 0; i < 3; ++i)
+                scale = std::max(scale, inverse ? 1.0f / std::max(std::abs(c.imm[i]), 1e-6f) : std::abs(c.imm[i]));
+            return scale;
+        };
+
+        float result = stretch(0);
+        switch (in.op)
+        {
+            case SOP_POSITION: result = 1.0f; break;
+            case SOP_FOOTPRINT: case SOP_CONST: case SOP_PARAM: result = 0.0f; break;
+            case SOP_ADD: case SOP_SUB: case SOP_TRANSLATE: result = stretch(0) + stretch(1); break;
+            case SOP_MUL:
+                if (stretch(0) == 0.0f && stretch(1) == 0.0f)
+                    result = 0.0f;
+                else if (IsConst(in.args[0]) || IsConst(in.args[1]))
+                    result = IsConst(in.args[0]) ? stretch(1) * constScale(0, false) : stretch(0) * constScale(1, false);
+                else
+                    result = SCENE_UNBOUNDED;
+                break;
+            case SOP_DIV:
+                if (stretch(0) == 0.0f && stretch(1) == 0.0f)
+                    result = 0.0f;
+                else
+                    result = IsConst(in.args[1]) ? stretch(0) * constScale(1, true) : SCENE_UNBOUNDED;
+                break;
+            case SOP_SCALE_DIST: result = IsConst(in.args[1]) ? stretch(0) * constScale(1, false) : SCENE_UNBOUNDED; break;
+            default:
+                if (SceneIsCombinator(in.op))
+                    result = std::max(stretch(0), stretch(1));
+                break;
+        }
+        return std::min(result, SCENE_UNBOUNDED);
+    }
+
+    int Emit(SceneInstr in)
+    {
+        program.requested++;
+        int folded = Fold(in);
+        if (folded >= 0)
+        {
+            program.folded++;
+            return folded;
+        }
+
+        if ((in.op == SOP_ADD || in.op == SOP_MUL) && in.args[0] > in.args[1])
+            std::swap(in.args[0], in.args[1]);
+        in.stretch = Stretch(in);
+
+        std::string key((const char*)&in, sizeof(in));
+        auto found = emitted.find(key);
+        if (found != emitted.end())
+        {
+            program.shared++;
+            return found->second;
+        }
+        program.code.push_back(in);
+        emitted[key] = (int)program.code.size() - 1;
+        return (int)program.code.size() - 1;
+    }
+
+    int AsVec3(int value)
+    {
+        if (value < 0 || Type(value) == SVT_VEC3)
+            return value;
+        if (IsConst(value))
+            return Const(glm::vec3(program.code[value].imm[0]), SVT_VEC3);
+        return Emit(Instr(SOP_MUL, SVT_VEC3, value, Const(glm::vec3(1.0f), SVT_VEC3)));
+    }
+
+    // Numbers, [vectors], $parameters, pi and (+ - * / sin cos radians) over them
+    int Value(const SceneExpr& expr)
+    {
+        switch (expr.kind)
+        {
+            case SceneExpr::NUMBER:
+                return Const(expr.numbers[0]);
+            case SceneExpr::VECTOR:
+                if (expr.numbers.size() == 1)
+                    return Const(expr.numbers[0]);
+                if (expr.numbers.size() != 3)
+                    return Fail(expr, "value vectors have 1 or 3 components");
+                return Const(glm::vec3(expr.numbers[0], expr.numbers[1], expr.numbers[2]), SVT_VEC3);
+            case SceneExpr::PARAM:
+            {
+                glm::vec3 unused;
+                if (!SceneParams().Parameter(expr.text, unused))
+                    return Fail(expr, "unknown parameter $" + expr.text);
+                usesParams = true;
+                glm::vec3 value;
+                if (frozen && frozen->Parameter(expr.text, value))
+                    return Const(value, SVT_VEC3);
+                size_t index = std::find(program.params.begin(), program.params.end(), expr.text) - program.params.begin();
+                if (index == program.params.size())
+                    program.params.push_back(expr.text);
+                SceneInstr in = Instr(SOP_PARAM, SVT_VEC3);
+                in.imm[0] = (float)index;
+                return Emit(in);
+            }
+            case SceneExpr::SYMBOL:
+                if (expr.text == "pi")
+                    return Const(SCENE_PI);
+                return Fail(expr, "expected a value, got '" + expr.text + "'");
+            case SceneExpr::KEYWORD:
+                return Fail(expr, "unexpected :" + expr.text);
+            case SceneExpr::LIST:
+                break;
+        }
+
+        const std::string& head = expr.items[0].text;
+        std::vector<int> operands;
+        for (size_t i = 1; i < expr.items.size(); ++i)
+        {
+            operands.push_back(Value(expr.items[i]));
+            if (operands.back() < 0)
+                return -1;
+        }
+
+        auto typeOf = [&](int x, int y) { return (Type(x) == SVT_VEC3 || Type(y) == SVT_VEC3) ? SVT_VEC3 : SVT_FLOAT; };
+        if (head == "-" && operands.size() == 1)
+            return Emit(Instr(SOP_NEG, Type(operands[0]), operands[0]));
+
+        static const char* binary[] = { "+", "-", "*", "/" };
+        for (int op = 0; op < 4; ++op)
+        {
+            if (head != binary[op])
+                continue;
+            if (operands.size() < 2)
+                return Fail(expr, "'" + head + "' needs two or more operands");
+            int result = operands[0];
+            for (size_t i = 1; i < operands.size(); ++i)
+                result = Emit(Instr((SceneOp)(SOP_ADD + op), typeOf(result, operands[i]), result, operands[i]));
+            return result;
+        }
+
+        if ((head == "sin" || head == "cos" || head == "radians") && operands.size() == 1)
+        {
+            if (head == "radians")
+                return Emit(Instr(SOP_MUL, Type(operands[0]), operands[0], Const(SCENE_PI / 180.0f)));
+            return Emit(Instr(head == "sin" ? SOP_SIN : SOP_COS, Type(operands[0]), operands[0]));
+        }
+        return Fail(expr, "'" + head + "' is not a value operator");
+    }
+
+    // Affine map from world space to the point `value`, false when it isn't
+    // one (another repetition, a mirror or a parameter lies on the way)
+    bool AffineFrame(int value, glm::mat3& m, glm::vec3& offset)
+    {
+        const SceneInstr& in = program.code[value];
+        switch (in.op)
+        {
+            case SOP_POSITION:
+                m = glm::mat3(1.0f);
+                offset = glm::vec3(0.0f);
+                return true;
+            case SOP_TRANSLATE:
+            {
+                if (!IsConst(in.args[1]) || !AffineFrame(in.args[0], m, offset))
+                    return false;
+                const SceneInstr& t = program.code[in.args[1]];
+                offset -= glm::vec3(t.imm[0], t.imm[1], t.imm[2]);
+                return true;
+            }
+            case SOP_ROTATE:
+            {
+                if (!IsConst(in.args[1]) || !IsConst(in.args[2]) || !AffineFrame(in.args[0], m, offset))
+                    return false;
+                int u = (int)in.imm[0], v = (int)in.imm[1];
+                float c = program.code[in.args[1]].imm[0], s = program.code[in.args[2]].imm[0];
+                glm::mat3 rotate(1.0f);     // [column][row]
+                rotate[u][u] = c;
+                rotate[v][u] = s;
+                rotate[u][v] = -s;
+                rotate[v][v] = c;
+                m = rotate * m;
+                offset = rotate * offset;
+                return true;
+            }
+            case SOP_DIV:   // scale
+            {
+                if (in.type != SVT_VEC3 || !IsConst(in.args[1]) || Type(in.args[1]) != SVT_FLOAT || !AffineFrame(in.args[0], m, offset))
+                    return false;
+                float k = program.code[in.args[1]].imm[0];
+                m /= k;
+                offset /= k;
+                return true;
+            }
+            default:
+                return false;
+        }
+    }
+
+    // Records a repetition as a SceneCell when its input is an affine function
+    // of the world position. Its copies (`parts`, in the output space) must
+    // stay inside their cells and the cells fit SCENE_MAX_CELLS, or the march
+    // could overshoot into the neighbours: false, with the error, otherwise.
+    bool RepetitionCell(const SceneExpr& expr, const SceneInstr& in, const std::vector<SceneBounds>& parts)
+    {
+        glm::mat3 m;
+        glm::vec3 offset;
+        if (frozen || !IsConst(in.args[1]) || !AffineFrame(in.args[0], m, offset))
+            return true;
+        const SceneInstr& size = program.code[in.args[1]];
+        SceneBounds content = SceneMergeBounds(parts);
+        std::vector<SceneBounds> copies(1, content);
+        SceneDomainBounds(in.op, (int)in.imm[0], (int)in.imm[1], nullptr, copies);
+
+        // pModPolar's plane becomes xy
+        int u = (int)in.imm[0], v = (int)in.imm[1];
+        int axes[3] = { 0, 1, 2 };
+        if (in.op == SOP_MOD_POLAR)
+        {
+            axes[0] = u;
+            axes[1] = v;
+            axes[2] = 3 - u - v;
+        }
+        SceneCell cell;
+        for (int i = 0; i < 3; ++i)
+        {
+            cell.toLocal[i] = glm::vec4(m[0][axes[i]], m[1][axes[i]], m[2][axes[i]], offset[axes[i]]);
+            cell.boundsMin[i] = copies[0].min[axes[i]];
+            cell.boundsMax[i] = copies[0].max[axes[i]];
+        }
+        cell.boundsMin.w = cell.boundsMax.w = 0.0f;
+        cell.period = glm::vec4(0.0f);
+        cell.freeMin = glm::vec4(glm::vec3(-SCENE_UNBOUNDED), 0.0f);
+        cell.freeMax = glm::vec4(glm::vec3(SCENE_UNBOUNDED), 0.0f);
+
+        bool bounded = true, fits = true;
+        if (in.op == SOP_MOD_POLAR)
+        {
+            // One or two sectors aren't convex wedges
+            float repetitions = size.imm[0];
+            if (repetitions < 3.0f)
+                return true;
+            float angle = 2.0f * SCENE_PI / repetitions;
+            float lo = SCENE_PI, hi = -SCENE_PI;
+            for (int corner = 0; corner < 4; ++corner)
+            {
+                float a = std::atan2((corner & 2) ? content.max[v] : content.min[v], (corner & 1) ? content.max[u] : content.min[u]);
+                lo = std::min(lo, a);
+                hi = std::max(hi, a);
+            }
+            bounded = content.max[u] < SCENE_UNBOUNDED && content.min[v] > -SCENE_UNBOUNDED && content.max[v] < SCENE_UNBOUNDED;
+            fits = content.min[u] > 0.0f && lo >= -angle * 0.5f && hi <= angle * 0.5f;
+
+            // Up to the neighbours' copies, or the sector itself if that wedge isn't convex
+            cell.period.w = repetitions;
+            cell.freeMin.x = hi - angle;
+            cell.freeMax.x = lo + angle;
+            if (cell.freeMax.x - cell.freeMin.x > SCENE_PI)
+            {
+                cell.freeMin.x = -angle * 0.5f;
+                cell.freeMax.x = angle * 0.5f;
+            }
+        }
+        else
+        {
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                bool repeated = in.op == SOP_MOD3 || axis == u || (in.op == SOP_MOD2 && axis == v);
+                float period = size.imm[axis];
+                if (!repeated)
+                    continue;
+                if (period <= 0.0f)
+                    return true;
+                bounded &= content.min[axis] > -SCENE_UNBOUNDED && content.max[axis] < SCENE_UNBOUNDED;
+                fits &= content.min[axis] >= -period * 0.5f && content.max[axis] <= period * 0.5f;
+                cell.period[axis] = period;
+                cell.freeMin[axis] = content.max[axis] - period;
+                cell.freeMax[axis] = content.min[axis] + period;
+            }
+        }
+
+        // Geometry unbounded along a repeated axis repeats onto itself
+        if (!bounded)
+            return true;
+        if (!fits)
+            return Fail(expr, "repeated geometry reaches past its cell") >= 0;
+        for (const SceneCell& other : program.cells)
+            if (std::memcmp(&other, &cell, sizeof(cell)) == 0)
+                return true;
+        if (program.cells.size() >= (size_t)SCENE_MAX_CELLS)
+            return Fail(expr, "more than " + std::to_string(SCENE_MAX_CELLS) + " distinct repetitions") >= 0;
+        program.cells.push_back(cell);
+        return true;
+    }
+
+    // Implicit union of a node's children
+    int Children(const std::vector<const SceneExpr*>& children, const SceneExpr& parent, int p, int footprint, bool negated,
+                 std::vector<std::vector<SceneBounds>>& parts)
+    {
+        if (children.empty())
+            return Fail(parent, "'" + parent.items[0].text + "' needs a child node");
+        int result = -1;
+        for (const SceneExpr* child : children)
+        {
+            std::vector<SceneBounds> childParts;
+            int d = Node(*child, p, footprint, negated, childParts);
+            if (d < 0)
+                return -1;
+            result = result < 0 ? d : Emit(Instr(SOP_UNION, SVT_DIST, result, d));
+            parts.push_back(childParts);
+        }
+        return result;
+    }
+
+    // Bit per SceneProgram::params the value reads
+    unsigned ParamMask(int value) const
+    {
+        const SceneInstr& in = program.code[value];
+        if (in.op == SOP_PARAM)
+            return 1u << (int)in.imm[0];
+        unsigned mask = 0;
+        for (int k = 0; k < 4; ++k)
+            if (in.args[k] >= 0)
+                mask |= ParamMask(in.args[k]);
+        return mask;
+    }
+
+    // `negated` is set below a difference's subtrahend, where a LOD proxy
+    // (a lower bound) would no longer bound the result from below
+    int Node(const SceneExpr& expr, int p, int footprint, bool negated, std::vector<SceneBounds>& out)
+    {
+        std::vector<SceneBounds> parts;
+        const SceneNodeInfo* info = FindSceneNode(expr);
+        if (!info)
+            return Fail(expr, expr.kind == SceneExpr::LIST ? "unknown node '" + expr.items[0].text + "'" : "expected a scene node");
+        const std::string& head = expr.items[0].text;
+
+        // Positional arguments
+        std::vector<int> values;
+        int axes[2] = { 0, 0 };
+        size_t i = 1;
+        for (const char* arg = info->args; *arg; ++arg, ++i)
+        {
+            if (i >= expr.items.size() || expr.items[i].kind == SceneExpr::KEYWORD || FindSceneNode(expr.items[i]))
+                return Fail(expr, "'" + head + "' takes " + std::to_string(std::strlen(info->args)) + " arguments");
+            const SceneExpr& item = expr.items[i];
+
+            if (*arg == 'P' || *arg == 'X')
+            {
+                const std::string& axisText = item.text;
+                size_t count = *arg == 'P' ? 2 : 1;
+                bool valid = item.kind == SceneExpr::SYMBOL && axisText.size() == count;
+                for (size_t k = 0; valid && k < count; ++k)
+                {
+                    const char* at = std::strchr("xyz", axisText[k]);
+                    valid = at && *at;
+                    if (valid)
+                        axes[k] = int(at - "xyz");
+                }
+                if (!valid || (count == 2 && axes[0] == axes[1]))
+                    return Fail(item, count == 2 ? "expected a plane such as xz" : "expected an axis x, y or z");
+                continue;
+            }
+
+            int value = Value(item);
+            if (value < 0)
+                return -1;
+            if ((*arg == 'f' || *arg == 'n') && Type(value) != SVT_FLOAT)
+                return Fail(item, "'" + head + "' expects a float here");
+            if (*arg == 'n' && !IsConst(value))
+                return Fail(item, "'" + head + "' expects a constant here");
+            values.push_back(*arg == 'v' ? AsVec3(value) : value);
+        }
+
+        // Keywords and children
+        float material = 1.0f, detail = 0.0f;
+        glm::vec4 proxy(0.0f, 0.0f, 0.0f, -1.0f);
+        bool hasMin = false, hasMax = false;
+        glm::vec3 boundsMin(0.0f), boundsMax(0.0f);
+        std::vector<const SceneExpr*> children;
+        for (; i < expr.items.size(); ++i)
+        {
+            const SceneExpr& item = expr.items[i];
+            if (FindSceneNode(item))
+            {
+                children.push_back(&item);
+                continue;
+            }
+            if (item.kind != SceneExpr::KEYWORD)
+                return Fail(item, "unexpected argument to '" + head + "'");
+            if (i + 1 >= expr.items.size())
+                return Fail(item, "missing value for :" + item.text);
+
+            const SceneExpr& value = expr.items[++i];
+            bool isNumber = value.kind == SceneExpr::NUMBER;
+            bool isVector3 = value.kind == SceneExpr::VECTOR && value.numbers.size() == 3;
+            bool primitiveOnly = item.text == "material" || item.text == "proxy" || item.text == "detail";
+            if (primitiveOnly && info->nodeClass != SNC_PRIMITIVE)
+                return Fail(item, ":" + item.text + " only applies to primitives");
+
+            if (item.text == "material" && isNumber)
+                material = value.numbers[0];
+            else if (item.text == "detail" && isNumber)
+                detail = value.numbers[0];
+            else if (item.text == "proxy" && value.kind == SceneExpr::VECTOR && value.numbers.size() == 4)
+                proxy = glm::vec4(value.numbers[0], value.numbers[1], value.numbers[2], value.numbers[3]);
+            else if (item.text == "min" && isVector3)
+            {
+                boundsMin = glm::vec3(value.numbers[0], value.numbers[1], value.numbers[2]);
+                hasMin = true;
+            }
+            else if (item.text == "max" && isVector3)
+            {
+                boundsMax = glm::vec3(value.numbers[0], value.numbers[1], value.numbers[2]);
+                hasMax = true;
+            }
+            else
+                return Fail(item, "invalid :" + item.text + " (expected :material n, :detail n, :proxy [x y z r], :min/:max [x y z])");
+        }
+        if (hasMin != hasMax)
+            return Fail(expr, ":min and :max go together");
+
+        // Its bounds node, the subtrees of its children follow
+        SceneBoundsNode bounds = {};
+        bounds.op = info->op;
+        bounds.axes[0] = axes[0];
+        bounds.axes[1] = axes[1];
+        bounds.children = (int)children.size();
+        bounds.operands = std::min((int)values.size(), info->nodeClass == SNC_COMBINATOR ? 1 : 2);
+        for (int k = 0; k < bounds.operands; ++k)
+        {
+            const SceneInstr& value = program.code[values[k]];
+            bounds.args[k] = IsConst(values[k]) ? -1 : values[k];
+            bounds.values[k] = glm::vec3(value.imm[0], value.imm[1], value.imm[2]);
+            bounds.params |= ParamMask(values[k]);
+        }
+        bounds.proxy = proxy;
+        bounds.clip = hasMin;
+        bounds.clipMin = boundsMin;
+        bounds.clipMax = boundsMax;
+        int record = (int)program.bounds.size();
+        program.bounds.push_back(bounds);
+
+        int d = -1;
+        std::vector<std::vector<SceneBounds>> childParts;
+        switch (info->nodeClass)
+        {
+            case SNC_PRIMITIVE:
+            {
+                if (!children.empty())
+                    return Fail(*children[0], "primitives have no children");
+                if ((proxy.w >= 0.0f) != (detail > 0.0f))
+                    return Fail(expr, ":proxy and :detail go together");
+
+                SceneInstr in = Instr(info->op, SVT_DIST, p, values.size() > 0 ? values[0] : -1, values.size() > 1 ? values[1] : -1);
+                in.imm[0] = material;
+                if (detail > 0.0f && negated)
+                    std::cerr << "Scene line " << expr.line << ": LOD proxy of a subtracted node ignored" << std::endl;
+                else if (detail > 0.0f)
+                {
+                    in.args[3] = footprint;
+                    in.imm[1] = proxy.x; in.imm[2] = proxy.y; in.imm[3] = proxy.z; in.imm[4] = proxy.w;
+                    in.imm[5] = detail;
+                }
+                d = Emit(in);
+                break;
+            }
+            case SNC_DOMAIN:
+            {
+                SceneInstr in = Instr(info->op, SVT_VEC3, p, values[0]);
+                in.imm[0] = (float)axes[0];
+                in.imm[1] = (float)axes[1];
+                int q = p, childFootprint = footprint;
+                if (info->op == SOP_ROTATE)
+                {
+                    in.args[1] = Emit(Instr(SOP_COS, SVT_FLOAT, values[0]));
+                    in.args[2] = Emit(Instr(SOP_SIN, SVT_FLOAT, values[0]));
+                    q = Emit(in);
+                }
+                else if (info->op == SOP_SCALE_DIST)
+                {
+                    q = Emit(Instr(SOP_DIV, SVT_VEC3, p, values[0]));
+                    childFootprint = Emit(Instr(SOP_DIV, SVT_FLOAT, footprint, values[0]));
+                }
+                else
+                    q = Emit(in);
+
+                d = Children(children, expr, q, childFootprint, negated, childParts);
+                if (d < 0)
+                    return -1;
+                if (info->op == SOP_SCALE_DIST)
+                    d = Emit(Instr(SOP_SCALE_DIST, SVT_DIST, d, values[0]));
+
+                // Subtracted, the copy of the point's cell is never nearer than the closest one,
+                // so the result already stays a lower bound
+                bool repetition = info->op == SOP_MOD1 || info->op == SOP_MOD2 || info->op == SOP_MOD3 || info->op == SOP_MOD_POLAR;
+                if (repetition && !negated)
+                {
+                    std::vector<SceneBounds> content;
+                    for (const std::vector<SceneBounds>& child : childParts)
+                        content.insert(content.end(), child.begin(), child.end());
+                    if (!RepetitionCell(expr, in, content))
+                        return -1;
+                }
+                break;
+            }
+            case SNC_COMBINATOR:
+            {
+                if (children.empty())
+                    return Fail(expr, "'" + head + "' needs a child node");
+                bool subtract = SceneIsDifferenceOp(info->op);
+                int r = values.size() > 0 ? values[0] : -1;
+                int n = values.size() > 1 ? values[1] : -1;
+
+                childParts.resize(children.size());
+                d = Node(*children[0], p, footprint, negated, childParts[0]);
+                if (d < 0)
+                    return -1;
+                for (size_t k = 1; k < children.size(); ++k)
+                {
+                    int e = Node(*children[k], p, footprint, negated != subtract, childParts[k]);
+                    if (e < 0)
+                        return -1;
+                    d = Emit(Instr(info->op, SVT_DIST, d, e, r, n));
+                }
+                break;
+            }
+            case SNC_MODIFIER:
+                d = Children(children, expr, p, footprint, negated, childParts);
+                if (d < 0)
+                    return -1;
+                d = Emit(Instr(info->op, SVT_DIST, d, values[0]));
+                break;
+        }
+
+        // Every bounds node after this one lies below it
+        for (size_t k = record; k < program.bounds.size(); ++k)
+            program.bounds[record].subtreeParams |= program.bounds[k].params;
+        const glm::vec3* operands[2];
+        glm::vec3 operandValues[2];
+        SceneBoundsOperands(program, program.bounds[record], nullptr, operandValues, operands);
+        SceneNodeBoundsOf(program.bounds[record], operands, childParts, parts);
+        SceneBounds merged = parts.empty() ? SceneUnboundedBox() : SceneMergeBounds(parts);
+        if (nodeBounds.count(d))
+            merged = SceneMergeBounds({ nodeBounds[d], merged });
+        nodeBounds[d] = merged;
+        out.insert(out.end(), parts.begin(), parts.end());
+        return d;
+    }
+
+    // Drops instructions folding left unreferenced, so the last root ends the
+    // program. Returns the roots renumbered.
+    std::vector<int> Finish(const std::vector<int>& roots, std::vector<SceneBounds> parts)
+    {
+        std::vector<int> remap(program.code.size(), -1);
+        std::vector<bool> used(program.code.size(), false);
+        int root = 0;
+        for (int r : roots)
+        {
+            used[r] = true;
+            root = std::max(root, r);
+        }
+        for (int i = root; i >= 0; --i)
+            if (used[i])
+                for (int k = 0; k < 4; ++k)
+                    if (program.code[i].args[k] >= 0)
+                        used[program.code[i].args[k]] = true;
+
+        std::vector<SceneInstr> code;
+        for (int i = 0; i <= root; ++i)
+        {
+            if (!used[i])
+                continue;
+            SceneInstr in = program.code[i];
+            for (int k = 0; k < 4; ++k)
+                if (in.args[k] >= 0)
+                    in.args[k] = remap[in.args[k]];
+            remap[i] = (int)code.size();
+            code.push_back(in);
+        }
+        program.code = code;
+
+        std::map<int, SceneBounds> renumberedBounds;
+        for (const auto& node : nodeBounds)
+            if (node.first < (int)remap.size() && remap[node.first] >= 0)
+                renumberedBounds[remap[node.first]] = node.second;
+        nodeBounds = renumberedBounds;
+        for (SceneBoundsNode& node : program.bounds)
+            for (int k = 0; k < node.operands; ++k)
+                if (node.args[k] >= 0)
+                    node.args[k] = node.args[k] < (int)remap.size() && remap[node.args[k]] >= 0 ? remap[node.args[k]] : -2;
+
+        if (parts.size() > (size_t)SCENE_MAX_BOUNDED_NODES)
+            parts.assign(1, SceneMergeBounds(parts));
+        for (SceneBounds& part : parts)
+        {
+            part.min = glm::max(part.min, glm::vec3(-SCENE_UNBOUNDED));
+            part.max = glm::min(part.max, glm::vec3(SCENE_UNBOUNDED));
+        }
+        for (const SceneBounds& part : parts)
+        {
+            program.boundsMin.push_back(part.min);
+            program.boundsMax.push_back(part.max);
+        }
+        SceneBounds all = SceneMergeBounds(parts);
+        float boxRadius = glm::length(all.max - all.min) * 0.5f;
+        program.boundSphere = glm::vec4((all.min + all.max) * 0.5f, boxRadius);
+        if (parts.size() == 1 && parts[0].sphere.w >= 0.0f && parts[0].sphere.w < boxRadius)
+            program.boundSphere = parts[0].sphere;
+
+        std::vector<int> renumbered;
+        for (int r : roots)
+            renumbered.push_back(remap[r]);
+        return renumbered;
+    }
+};
+
+// Picks the subtree SceneVolume bakes. Only its value at the LOD proxy's
+// footprint of 0 is baked: the exact evaluation it falls back to near the
+// surface still picks proxies. Subtracted distances and those scaled by a
+// parameter are left alone, a lower bound of them wouldn't bound the scene.
+static void SceneSelectBaked(SceneProgram& program, const std::map<int, SceneBounds>& nodeBounds)
+{
+    const std::vector<SceneInstr>& code = program.code;
+    int count = (int)code.size();
+    std::vector<bool> invariant(count, true), subtracted(count, false);
+    for (int i = 0; i < count; ++i)
+    {
+        const SceneInstr& in = code[i];
+        invariant[i] = in.op != SOP_PARAM && in.op != SOP_FOOTPRINT;
+        for (int k = 0; k < 4; ++k)
+            if (in.args[k] >= 0 && !invariant[in.args[k]] && !(SceneIsPrimitive(in.op) && k == 3))
+                invariant[i] = false;
+    }
+    for (int i = count - 1; i >= 0; --i)
+    {
+        const SceneInstr& in = code[i];
+        if (in.type != SVT_DIST)
+            continue;
+        for (int k = 0; k < 2; ++k)
+        {
+            int a = in.args[k];
+            if (a < 0 || code[a].type != SVT_DIST)
+                continue;
+            bool flips = (SceneIsDifferenceOp(in.op) && k == 1)
+                      || (in.op == SOP_SCALE_DIST && !(code[in.args[1]].op == SOP_CONST && code[in.args[1]].imm[0] > 0.0f));
+            subtracted[a] = subtracted[a] || subtracted[i] || flips;
+        }
+    }
+
+    // Cost of every instruction of a subtree once, the Julia set dominates
+    int best = -1, bestCost = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        auto bounds = nodeBounds.find(i);
+        if (code[i].type != SVT_DIST || !invariant[i] || subtracted[i] || bounds == nodeBounds.end()
+            || SceneVMax(bounds->second.max - bounds->second.min) >= SCENE_UNBOUNDED || bounds->second.max.x < bounds->second.min.x)
+            continue;
+        std::vector<bool> inside = SceneSubtree(program, i);
+        int cost = 0;
+        for (int k = 0; k <= i; ++k)
+            if (inside[k])
+                cost += code[k].op == SOP_JULIA ? SCENE_BAKE_MIN_COST : 1;
+        if (cost >= SCENE_BAKE_MIN_COST && cost >= bestCost)
+        {
+            best = i;
+            bestCost = cost;
+        }
+    }
+    if (best < 0)
+        return;
+
+    const SceneBounds& bounds = nodeBounds.at(best);
+    glm::vec3 margin(SceneVMax(bounds.max - bounds.min) * SCENE_BAKE_MARGIN);
+    program.baked = best;
+    program.bakedMin = bounds.min - margin;
+    program.bakedMax = bounds.max + margin;
+
+    // Bound over a ball around the volume's centre that holds all of it
+    std::vector<bool> inside = SceneSubtree(program, best);
+    std::vector<glm::vec3> paramValues(program.params.size(), glm::vec3(0.0f));
+    std::vector<glm::vec4> values(best + 1, glm::vec4(0.0f));
+    glm::vec3 centre = 0.5f * (program.bakedMin + program.bakedMax);
+    float radius = glm::length(program.bakedMax - program.bakedMin);
+    program.bakedMaterial = 0.0f;
+    for (int i = best; i >= 0; --i)
+        if (inside[i] && SceneIsPrimitive(code[i].op))
+            program.bakedMaterial = code[i].imm[0];
+    for (int i = 0; i <= best; ++i)
+    {
+        if (!inside[i])
+            continue;
+        glm::vec4 operands[4];
+        for (int k = 0; k < 4; ++k)
+            operands[k] = code[i].args[k] >= 0 ? values[code[i].args[k]] : glm::vec4(0.0f);
+        values[i] = SceneEvalInstr(code[i], operands, centre, 0.0f, radius, paramValues);
+    }
+    program.bakedLipschitz = values[best].z;
+}
+
+bool SceneCompiler::Compile(const std::string& source, SceneProgram& program)
+{
+    SceneParser parser(source);
+    std::vector<SceneExpr> nodes;
+    while (!parser.AtEnd())
+    {
+        nodes.push_back(SceneExpr());
+        if (!parser.ParseItem(nodes.back()))
+        {
+            error = parser.error;
+            return false;
+        }
+    }
+    if (nodes.empty())
+    {
+        error = "line 1: the scene is empty";
+        return false;
+    }
+
+    // Several top level nodes form a union, and so do the children of top
+    // level unions without bounds of their own. With enough of them each one
+    // becomes an item of the BVH and is lowered on its own.
+    std::vector<const SceneExpr*> members;
+    std::vector<const SceneExpr*> pending;
+    for (size_t i = nodes.size(); i-- > 0;)
+        pending.push_back(&nodes[i]);
+    while (!pending.empty())
+    {
+        const SceneExpr* node = pending.back();
+        pending.pop_back();
+        bool plainUnion = node->kind == SceneExpr::LIST && node->items[0].text == "union" && node->items.size() > 1;
+        for (size_t i = 1; plainUnion && i < node->items.size(); ++i)
+            plainUnion = node->items[i].kind == SceneExpr::LIST;
+        if (!plainUnion)
+        {
+            members.push_back(node);
+            continue;
+        }
+        for (size_t i = node->items.size(); i-- > 1;)
+            pending.push_back(&node->items[i]);
+    }
+    bool useItems = members.size() >= (size_t)SCENE_BVH_MIN_ITEMS;
+
+    SceneProgram result;
+    result.name = program.name;
+    SceneLowering lowering(result);
+    int p = lowering.Emit(SceneLowering::Instr(SOP_POSITION, SVT_VEC3));
+    int footprint = lowering.Emit(SceneLowering::Instr(SOP_FOOTPRINT, SVT_FLOAT));
+    std::vector<SceneBounds> parts;
+    std::vector<int> roots;
+    if (useItems)
+    {
+        for (const SceneExpr* node : members)
+        {
+            lowering.emitted.clear();
+            lowering.usesParams = false;
+            int boundsNode = (int)result.bounds.size();
+            std::vector<SceneBounds> itemParts;
+            int d = lowering.Node(*node, p, footprint, false, itemParts);
+            if (d < 0)
+            {
+                error = lowering.error;
+                return false;
+            }
+            SceneBounds bounds = itemParts.empty() ? SceneUnboundedBox() : SceneMergeBounds(itemParts);
+            SceneItem item = { d, glm::max(bounds.min, glm::vec3(-SCENE_UNBOUNDED)), glm::min(bounds.max, glm::vec3(SCENE_UNBOUNDED)),
+                               lowering.usesParams, boundsNode };
+            result.items.push_back(item);
+            roots.push_back(d);
+            parts.insert(parts.end(), itemParts.begin(), itemParts.end());
+        }
+    }
+    else
+    {
+        int root = -1;
+        for (const SceneExpr& node : nodes)
+        {
+            int d = lowering.Node(node, p, footprint, false, parts);
+            if (d < 0)
+            {
+                error = lowering.error;
+                return false;
+            }
+            root = root < 0 ? d : lowering.Emit(SceneLowering::Instr(SOP_UNION, SVT_DIST, root, d));
+        }
+        roots.push_back(root);
+    }
+
+    roots = lowering.Finish(roots, parts);
+    for (size_t i = 0; i < result.items.size(); ++i)
+        result.items[i].root = roots[i];
+    for (const auto& node : lowering.nodeBounds)
+        result.nodes.push_back({ node.first, glm::max(node.second.min, glm::vec3(-SCENE_UNBOUNDED)),
+                                 glm::min(node.second.max, glm::vec3(SCENE_UNBOUNDED)) });
+    if (!useItems)
+        SceneSelectBaked(result, lowering.nodeBounds);
+    program = result;
+    return true;
+}
+
+void SceneProgram::ItemBounds(int item, const SceneParams& sceneParams, glm::vec3& bmin, glm::vec3& bmax) const
+{
+    std::vector<glm::vec3> paramValues(params.size(), glm::vec3(0.0f));
+    for (size_t i = 0; i < params.size(); ++i)
+        sceneParams.Parameter(params[i], paramValues[i]);
+
+    std::vector<SceneBounds> parts;
+    SceneReplayBounds(*this, items[item].bounds, paramValues, parts);
+    SceneBounds bounds = parts.empty() ? SceneUnboundedBox() : SceneMergeBounds(parts);
+    bmin = glm::max(bounds.min, glm::vec3(-SCENE_UNBOUNDED));
+    bmax = glm::min(bounds.max, glm::vec3(SCENE_UNBOUNDED));
+}
+
+bool SceneProgram::ChangedRegion(const SceneParams& previous, const SceneParams& current, bool clipped, glm::vec3& bmin, glm::vec3& bmax) const
+{
+    std::vector<glm::vec3> paramValues[2];
+    unsigned changed = 0;
+    for (size_t i = 0; i < params.size(); ++i)
+    {
+        paramValues[0].push_back(glm::vec3(0.0f));
+        paramValues[1].push_back(glm::vec3(0.0f));
+        previous.Parameter(params[i], paramValues[0][i]);
+        current.Parameter(params[i], paramValues[1][i]);
+        if (paramValues[0][i] != paramValues[1][i])
+            changed |= 1u << i;
+    }
+    if (!changed)
+        return false;
+
+    std::vector<SceneBounds> parts;
+    for (int index = 0; index < (int)bounds.size();)
+        index = SceneChangedBounds(*this, index, paramValues, changed, clipped, parts);
+
+    // A clipped march never leaves the clipping boxes
+    if (clipped && !boundsMin.empty())
+    {
+        SceneBounds clip = { boundsMin[0], boundsMax[0], glm::vec4(0.0f, 0.0f, 0.0f, -1.0f) };
+        for (size_t i = 1; i < boundsMin.size(); ++i)
+            clip = SceneMergeBounds({ clip, { boundsMin[i], boundsMax[i], glm::vec4(0.0f, 0.0f, 0.0f, -1.0f) } });
+        SceneClipBounds(parts, clip);
+    }
+    if (parts.empty())
+        return false;
+    SceneBounds region = SceneMergeBounds(parts);
+    bmin = glm::max(region.min, glm::vec3(-SCENE_UNBOUNDED));
+    bmax = glm::min(region.max, glm::vec3(SCENE_UNBOUNDED));
+    return true;
+}
+
+std::string SceneCompiler::ShaderDefines()
+{
+    return "#define JULIA_BOUNDS_MIN " + SceneVec3Literal(SCENE_JULIA_BOUNDS_MIN) + "\n"
+         + "#define JULIA_BOUNDS_MAX " + SceneVec3Literal(SCENE_JULIA_BOUNDS_MAX) + "\n";
+}
+
+bool SceneCompiler::CompileFile(const std::string& filename, SceneProgram& program)
+{
+    std::ifstream file(filename.c_str());
+    if (!file.is_open())
+    {
+        error = "could not open " + filename;
+        return false;
+    }
+    std::stringstream text;
+    text << file.rdbuf();
+
+    program.name = filename.substr(filename.find_last_of("/\\") + 1);
+    if (!Compile(text.str(), program))
+    {
+        error = program.name + " " + error;
+        return false;
+    }
+    return true;
+}
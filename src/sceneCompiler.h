@@ -0,0 +1,220 @@
+#ifndef SCENE_COMPILER_CLASS_H
+#define SCENE_COMPILER_CLASS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "sceneParams.h"
+
+const int SCENE_MAX_BOUNDED_NODES = 8;      // Clipping boxes the shader loops over, more are merged
+const int SCENE_MAX_CELLS         = 8;      // Repetitions the march clamps its steps to, more fail the compile
+const int SCENE_BVH_MIN_ITEMS     = 16;     // Top level union members before the scene gets a BVH
+const int SCENE_BAKE_MIN_COST     = 32;     // Cost of a time-invariant subtree before it is baked, a Julia set alone
+
+// Box around the Julia set, the bounds of (julia) nodes and the clipping box
+// of the built-in sdfScene (JULIA_BOUNDS_MIN/MAX, see SceneCompiler::ShaderDefines)
+const glm::vec3 SCENE_JULIA_BOUNDS_MIN(-1.2f, -1.0f, -0.9f);
+const glm::vec3 SCENE_JULIA_BOUNDS_MAX( 1.25f, 1.15f, 1.25f);
+
+// Operations of a compiled scene. Every instruction produces one value: a
+// float, a vec3 (points, vector parameters) or a distance together with its
+// material ID (vec2 in GLSL, with its Lipschitz bound a vec3 in the
+// segment functions).
+enum SceneOp
+{
+    // Leaves
+    SOP_POSITION, SOP_FOOTPRINT, SOP_CONST, SOP_PARAM,
+
+    // Arithmetic, a float operand broadcasts against a vec3 one
+    SOP_ADD, SOP_SUB, SOP_MUL, SOP_DIV, SOP_NEG, SOP_SIN, SOP_COS,
+
+    // Domain operators, point -> point
+    SOP_TRANSLATE, SOP_ROTATE, SOP_MOD1, SOP_MOD2, SOP_MOD3, SOP_MOD_POLAR, SOP_MOD_GRID2, SOP_MIRROR,
+
+    // hg_sdf primitives and the Julia set, point -> distance
+    SOP_SPHERE, SOP_BOX, SOP_BOX_CHEAP, SOP_PLANE, SOP_CYLINDER, SOP_CAPSULE, SOP_TORUS, SOP_CONE,
+    SOP_OCTAHEDRON, SOP_DODECAHEDRON, SOP_ICOSAHEDRON, SOP_JULIA,
+
+    // Combinators, distance x distance -> distance
+    SOP_UNION, SOP_INTERSECTION, SOP_DIFFERENCE,
+    SOP_UNION_ROUND, SOP_INTERSECTION_ROUND, SOP_DIFFERENCE_ROUND,
+    SOP_UNION_CHAMFER, SOP_INTERSECTION_CHAMFER, SOP_DIFFERENCE_CHAMFER,
+    SOP_UNION_STAIRS, SOP_INTERSECTION_STAIRS, SOP_DIFFERENCE_STAIRS,
+    SOP_UNION_SOFT,
+
+    // Distance modifiers
+    SOP_SCALE_DIST, SOP_OFFSET_DIST,
+
+    SOP_COUNT
+};
+
+enum SceneValueType
+{
+    SVT_FLOAT, SVT_VEC3, SVT_DIST
+};
+
+// Operands refer to earlier instructions. Immediates by op:
+//   CONST      imm[0..2] value
+//   PARAM      imm[0] index into SceneProgram::params
+//   ROTATE, MOD2, MOD_POLAR, MOD_GRID2   imm[0], imm[1] axes of the plane (0 = x)
+//   MOD1, MIRROR                         imm[0] axis
+//   primitives imm[0] material, imm[1..4] LOD proxy sphere, imm[5] LOD detail size (0 = no LOD)
+// `stretch` bounds how far a point value moves per unit the world position
+// does, for distances that of the space they are measured in: a ball of
+// radius s around p is one of radius s * stretch there. Huge (1e5) where a
+// parameter scales the space.
+struct SceneInstr
+{
+    SceneOp        op;
+    SceneValueType type;
+    int            args[4];     // -1 when unused
+    float          imm[6];
+    float          stretch;
+};
+
+// Member of the top level union of a scene with a BVH (see sceneBvh.h). Items
+// share no instructions, the ones of an item form a contiguous range ending at `root`.
+struct SceneItem
+{
+    int         root;
+    glm::vec3   boundsMin, boundsMax;
+    bool        animated;       // References scene parameters, the bounds are refit per frame
+    int         bounds;         // Its node in SceneProgram::bounds
+};
+
+// A scene file node as far as its bounds go, so they can be recomputed for
+// other parameter values without compiling the scene again. Stored depth
+// first, every node followed by the subtrees of its `children`; the top level
+// nodes (the items of a scene with a BVH) follow each other.
+struct SceneBoundsNode
+{
+    SceneOp   op;
+    int       axes[2];
+    int       children;
+    int       operands;         // Values the bounds depend on: primitive sizes, offset, angle, radius or scale
+    int       args[2];          // Their instructions, -1 when constant (in `values`), -2 when folding dropped them
+    glm::vec3 values[2];
+    glm::vec4 proxy;            // LOD proxy sphere, w < 0 without
+    bool      clip;             // :min and :max given
+    glm::vec3 clipMin, clipMax;
+    unsigned  params;           // Bit per SceneProgram::params its operands read
+    unsigned  subtreeParams;    // Also those of the nodes below it
+};
+
+// Box around the geometry of a scene file node, by the instruction of its
+// distance. Nodes that share that instruction (a translate and its child)
+// share the entry.
+struct SceneNodeBounds
+{
+    int         root;
+    glm::vec3   boundsMin, boundsMax;
+};
+
+// Domain repetition (pMod1/2/3, pModPolar) the march has to respect. The
+// scene distance only sees the copy in the cell of the point, so a step may
+// not pass the nearest copy of another cell: rays are clamped to where they
+// leave the region around their cell that no other copy reaches. Laid out
+// like SceneCell in computeShader.comp.
+struct SceneCell
+{
+    glm::vec4 toLocal[3];               // Rows of the affine map into the operator's input space, translation in w
+    glm::vec4 period;                   // Grid period per axis (0 where it doesn't repeat), w = pModPolar repetitions in xy
+    glm::vec4 freeMin, freeMax;         // Around a cell's centre; for pModPolar the angles of the wedge in x
+    glm::vec4 boundsMin, boundsMax;     // Of every copy, in the input space
+};
+
+// Result of compiling a scene file: a straight-line program in dependency
+// order whose last instruction is the scene distance. It is emitted as GLSL
+// for the shader and evaluated directly on the CPU, both compute the same
+// function.
+class SceneProgram
+{
+    public:
+        std::string              name;          // Scene file name, for logs
+        std::vector<SceneInstr>  code;
+        std::vector<std::string> params;        // SceneParams names, uniforms u_<name>
+        std::vector<SceneItem>   items;         // Empty unless the scene has a BVH
+
+        // Ray clipping bounds: a box per node that adds geometry, and a sphere around all of them
+        std::vector<glm::vec3>   boundsMin, boundsMax;
+        glm::vec4                boundSphere = glm::vec4(0.0f);
+        std::vector<SceneCell>   cells;         // At most SCENE_MAX_CELLS
+        std::vector<SceneNodeBounds> nodes;     // Every bounded node in code order, for sceneBaker
+        std::vector<SceneBoundsNode> bounds;    // The scene tree, for bounds under other parameter values
+
+        // Time-invariant subtree baked into a SceneVolume (see sceneVolume.h), -1
+        // when there is none: the costliest distance that depends on neither
+        // parameters nor (but for LOD) the footprint, isn't subtracted and has
+        // bounds. Its Lipschitz bound holds over the whole volume.
+        int                      baked = -1;
+        glm::vec3                bakedMin = glm::vec3(0.0f), bakedMax = glm::vec3(0.0f);
+        float                    bakedLipschitz = 1.0f;
+        float                    bakedMaterial = 0.0f;  // Of its first primitive, far lookups are never hits
+
+        // Compile statistics: instructions requested by the tree, removed by
+        // constant folding and shared by common subexpression elimination
+        int requested = 0, folded = 0, shared = 0;
+
+        bool Empty() const { return code.empty(); }
+
+        // Every node has an analytic gradient (translations, spheres, boxes,
+        // planes, the Julia set and sharp booleans), sdfSceneGrad is emitted
+        bool HasGradient() const;
+
+        // Definitions of sdfSceneSegment(p, footprint, segment), sdfSceneInterval(lo,
+        // hi, footprint), sdfSceneGrad(p) when HasGradient(), the clipping bounds
+        // and cells. With a BVH sceneItemSegment and sceneItemInterval evaluate one
+        // item instead and the shader traverses the BVH. A baked subtree gets
+        // sceneBakedExact(p) and sdfSceneSegment reads it from the volume where
+        // that is far from its surface.
+        std::string EmitGLSL() const;
+
+        // (distance, material, Lipschitz bound within `segment` of p), same as
+        // sdfSceneSegment in the shader. With a BVH this is the union of every
+        // item, the traversal only skips items farther than its result.
+        glm::vec3 Evaluate(const glm::vec3& p, float footprint, const SceneParams& sceneParams, float segment = 0.0f) const;
+
+        // (distance, material) of the baked subtree, same as sceneBakedExact
+        // in the shader
+        glm::vec2 EvaluateBaked(const glm::vec3& p) const;
+
+        // Identifies the baked subtree and its Lipschitz bound across compiles,
+        // 0 without one; brick files (see sceneBrickFile.h) record it
+        uint64_t BakedHash() const;
+
+        // (lower, upper) bound of the distance over the box, same as
+        // sdfSceneInterval in the shader
+        glm::vec2 Interval(const glm::vec3& boxMin, const glm::vec3& boxMax, float footprint, const SceneParams& sceneParams) const;
+
+        // Distance a ray from p along dir (a cone of the given radius) can
+        // advance before it could reach a copy of another repetition cell,
+        // same as sceneCellStep in the shader. 1e5 when nothing repeats.
+        float CellStep(const glm::vec3& p, const glm::vec3& dir, float radius) const;
+
+        // Box around an item with the parameters at the given values, the same
+        // the compiler derives for constants
+        void ItemBounds(int item, const SceneParams& sceneParams, glm::vec3& bmin, glm::vec3& bmax) const;
+
+        // World-space box holding every change to the geometry between two sets
+        // of parameter values: the old and new bounds of the nodes whose operands
+        // changed, through the nodes above them. With `clipped` (the march only
+        // sees the clipping boxes) it leaves out what intersections, differences
+        // and :min/:max bounds hide. False when nothing visible changed.
+        bool ChangedRegion(const SceneParams& previous, const SceneParams& current, bool clipped, glm::vec3& bmin, glm::vec3& bmax) const;
+};
+
+// Parses scene files, a CSG tree written as s-expressions (see Scenes/julia.scene)
+class SceneCompiler
+{
+    public:
+        std::string error;      // "line N: message" of the last failed compile
+
+        bool Compile(const std::string& source, SceneProgram& program);
+        bool CompileFile(const std::string& filename, SceneProgram& program);
+
+        // Constants the shader's built-in sdfScene shares with the compiler
+        static std::string ShaderDefines();
+};
+
+#endif
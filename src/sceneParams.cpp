@@ -0,0 +1,37 @@
+#include "sceneParams.h"
+#include <cmath>
+
+void SceneParams::Evaluate(float time)
+{
+    cutCenter = glm::vec3(0.0f, std::cos(time / 3.0f) * 0.5f + 1.25f, 0.15f);
+    cutHalfSize = glm::vec3(1.15f);
+}
+
+bool SceneParams::Parameter(const std::string& name, glm::vec3& value) const
+{
+    if (name == "cutCenter")
+        value = cutCenter;
+    else if (name == "cutHalfSize")
+        value = cutHalfSize;
+    else
+        return false;
+    return true;
+}
+
+SceneParams SceneParams::Only(const std::vector<std::string>& names) const
+{
+    SceneParams result;
+    for (const std::string& name : names)
+    {
+        if (name == "cutCenter")
+            result.cutCenter = cutCenter;
+        else if (name == "cutHalfSize")
+            result.cutHalfSize = cutHalfSize;
+    }
+    return result;
+}
+
+bool SceneParams::operator==(const SceneParams& other) const
+{
+    return cutCenter == other.cutCenter && cutHalfSize == other.cutHalfSize;
+}
@@ -0,0 +1,36 @@
+#ifndef SCENE_PARAMS_CLASS_H
+#define SCENE_PARAMS_CLASS_H
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+// Names Parameter() accepts, in the order the scene bytecode interpreter
+// preloads their uniforms into registers
+const int SCENE_PARAM_COUNT = 2;
+const char* const SCENE_PARAM_NAMES[SCENE_PARAM_COUNT] = { "cutCenter", "cutHalfSize" };
+
+// Animated scene parameters, evaluated on the CPU once per frame from the
+// scene time. The shader only sees the results, so frames whose parameters
+// didn't change render the same image no matter how far u_time moved.
+class SceneParams
+{
+    public:
+        glm::vec3 cutCenter = glm::vec3(0.0f);     // Box subtracted from the Julia set
+        glm::vec3 cutHalfSize = glm::vec3(1.15f);
+
+        void Evaluate(float time);
+
+        // Values scene files reference as $name, uploaded as u_name. All are
+        // vec3; false for unknown names.
+        bool Parameter(const std::string& name, glm::vec3& value) const;
+
+        // Copy keeping only the named values, the others at their defaults.
+        // Frames compare what the scene reads, not everything time moves.
+        SceneParams Only(const std::vector<std::string>& names) const;
+
+        bool operator==(const SceneParams& other) const;
+        bool operator!=(const SceneParams& other) const { return !(*this == other); }
+};
+
+#endif
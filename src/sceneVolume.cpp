@@ -0,0 +1,241 @@
+#include "sceneVolume.h"
+#include "sceneBrickFile.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// A whole file mapped read-only, unmapped when it goes out of scope
+struct SceneVolumeFile
+{
+    const char* data = nullptr;
+    size_t      size = 0;
+#ifdef _WIN32
+    HANDLE      file = INVALID_HANDLE_VALUE, mapping = NULL;
+#endif
+
+    bool Open(const std::string& filename)
+    {
+#ifdef _WIN32
+        file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        LARGE_INTEGER fileSize;
+        if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+            return false;
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        data = mapping ? (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        size = (size_t)fileSize.QuadPart;
+#else
+        int fd = open(filename.c_str(), O_RDONLY);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) != 0 || info.st_size == 0)
+        {
+            if (fd >= 0)
+                close(fd);
+            return false;
+        }
+        void* view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        data = view == MAP_FAILED ? nullptr : (const char*)view;
+        size = (size_t)info.st_size;
+#endif
+        return data != nullptr;
+    }
+
+    ~SceneVolumeFile()
+    {
+#ifdef _WIN32
+        if (data)
+            UnmapViewOfFile(data);
+        if (mapping)
+            CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+#else
+        if (data)
+            munmap((void*)data, size);
+#endif
+    }
+};
+
+void SceneVolume::Bake(GLuint bakeProgram, const SceneProgram& scene)
+{
+    Clear();
+    if (scene.baked < 0)
+        return;
+
+    glm::vec3 extent = scene.bakedMax - scene.bakedMin;
+    cellSize = std::max(std::max(extent.x, extent.y), extent.z) / SCENE_VOLUME_CELLS;
+    bricks = glm::max(glm::ivec3(glm::ceil(extent / (cellSize * SCENE_VOLUME_BRICK))), glm::ivec3(1));
+    boundsMin = scene.bakedMin;
+    glm::ivec3 samples = bricks * SCENE_VOLUME_BRICK + 1;
+    size_t sampleCount = (size_t)samples.x * samples.y * samples.z;
+
+    GLuint sampleBuffer = 0;
+    glGenBuffers(1, &sampleBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, sampleBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sampleCount * sizeof(float), nullptr, GL_STREAM_READ);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SCENE_VOLUME_SAMPLE_BINDING, sampleBuffer);
+
+    glUseProgram(bakeProgram);
+    Upload(bakeProgram);
+    glDispatchCompute((samples.x + 7) / 8, (samples.y * samples.z + 3) / 4, 1);    // local_size of computeShader.comp
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    std::vector<float> values(sampleCount);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sampleCount * sizeof(float), values.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glDeleteBuffers(1, &sampleBuffer);
+
+    error = scene.bakedLipschitz * cellSize * SCENE_VOLUME_ERROR;
+    float nearest = scene.bakedLipschitz * cellSize * SCENE_VOLUME_NEAREST;
+    auto sampleAt = [&](int x, int y, int z) { return values[((size_t)z * samples.y + y) * samples.x + x]; };
+
+    std::vector<SceneVolumeBrick> table((size_t)bricks.x * bricks.y * bricks.z);
+    std::vector<glm::ivec3> storedBricks;
+    for (int z = 0; z < bricks.z; ++z)
+        for (int y = 0; y < bricks.y; ++y)
+            for (int x = 0; x < bricks.x; ++x)
+            {
+                float lo = 1e30f, hi = -1e30f;
+                for (int k = 0; k <= SCENE_VOLUME_BRICK; ++k)
+                    for (int j = 0; j <= SCENE_VOLUME_BRICK; ++j)
+                        for (int i = 0; i <= SCENE_VOLUME_BRICK; ++i)
+                        {
+                            float v = sampleAt(x * SCENE_VOLUME_BRICK + i, y * SCENE_VOLUME_BRICK + j, z * SCENE_VOLUME_BRICK + k);
+                            lo = std::min(lo, v);
+                            hi = std::max(hi, v);
+                        }
+
+                // Written so NaN samples count as near
+                SceneVolumeBrick& entry = table[((size_t)z * bricks.y + y) * bricks.x + x];
+                entry.bound = lo - nearest;
+                if (!(hi - error >= SCENE_VOLUME_BAND * cellSize) || !std::isfinite(lo))
+                    entry.slot = SCENE_VOLUME_NEAR;
+                else if (entry.bound >= SCENE_VOLUME_FAR_BAND * SCENE_VOLUME_BRICK * cellSize)
+                {
+                    entry.slot = SCENE_VOLUME_FAR;
+                    ++distant;
+                }
+                else
+                    storedBricks.push_back(glm::ivec3(x, y, z));
+            }
+    stored = (int)storedBricks.size();
+
+    // Slots fill 16 x 16 layers of the atlas; it keeps one brick when none are stored
+    const int side = SCENE_VOLUME_BRICK + 1;
+    int slotCount = std::max(stored, 1);
+    atlasBricks = glm::ivec3(std::min(slotCount, 16), std::min((slotCount + 15) / 16, 16), (slotCount + 255) / 256);
+    glm::ivec3 texels = atlasBricks * side;
+    std::vector<float> atlasData((size_t)texels.x * texels.y * texels.z, 0.0f);
+    for (int s = 0; s < stored; ++s)
+    {
+        glm::ivec3 brick = storedBricks[s];
+        glm::ivec3 slot(s % 16, (s / 16) % 16, s / 256);
+        table[((size_t)brick.z * bricks.y + brick.y) * bricks.x + brick.x].slot = slot.x | slot.y << 8 | slot.z << 16;
+        glm::ivec3 source = brick * SCENE_VOLUME_BRICK, target = slot * side;
+        for (int k = 0; k < side; ++k)
+            for (int j = 0; j < side; ++j)
+                for (int i = 0; i < side; ++i)
+                    atlasData[((size_t)(target.z + k) * texels.y + target.y + j) * texels.x + target.x + i]
+                        = sampleAt(source.x + i, source.y + j, source.z + k);
+    }
+
+    Store(table.data(), atlasData.data(), GL_FLOAT);
+}
+
+bool SceneVolume::Load(const std::string& filename, const SceneProgram& scene)
+{
+    Clear();
+    SceneVolumeFile file;
+    if (scene.baked < 0 || !file.Open(filename) || file.size < sizeof(SceneBrickFileHeader))
+        return false;
+
+    const SceneBrickFileHeader& header = *(const SceneBrickFileHeader*)file.data;
+    glm::ivec3 fileBricks(header.bricks[0], header.bricks[1], header.bricks[2]);
+    glm::ivec3 fileAtlasBricks(header.atlasBricks[0], header.atlasBricks[1], header.atlasBricks[2]);
+    if (std::memcmp(header.magic, SCENE_BRICK_FILE_MAGIC, sizeof(header.magic)) != 0 || header.version != SCENE_BRICK_FILE_VERSION
+        || header.brickSize != (uint32_t)SCENE_VOLUME_BRICK || header.scene != scene.BakedHash() || header.fileSize != file.size
+        || glm::any(glm::lessThan(fileBricks, glm::ivec3(1))) || glm::any(glm::lessThan(fileAtlasBricks, glm::ivec3(1))))
+        return false;
+    const uint64_t side = SCENE_VOLUME_BRICK + 1;
+    uint64_t tableBytes = (uint64_t)fileBricks.x * fileBricks.y * fileBricks.z * sizeof(SceneVolumeBrick);
+    uint64_t atlasBytes = (uint64_t)fileAtlasBricks.x * fileAtlasBricks.y * fileAtlasBricks.z * side * side * side * sizeof(uint16_t);
+    if (header.tableOffset + tableBytes > header.atlasOffset || header.atlasOffset + atlasBytes > header.fileSize)
+        return false;
+
+    cellSize = header.cellSize;
+    boundsMin = glm::vec3(header.origin[0], header.origin[1], header.origin[2]) * (cellSize * SCENE_VOLUME_BRICK);
+    bricks = fileBricks;
+    atlasBricks = fileAtlasBricks;
+    error = header.error;
+    stored = (int)header.stored;
+    distant = (int)header.distant;
+    Store((const SceneVolumeBrick*)(file.data + header.tableOffset), file.data + header.atlasOffset, GL_HALF_FLOAT);
+    return true;
+}
+
+void SceneVolume::Store(const SceneVolumeBrick* table, const void* texels, GLenum texelType)
+{
+    glm::ivec3 size = atlasBricks * (SCENE_VOLUME_BRICK + 1);
+    if (!atlas)
+    {
+        glGenTextures(1, &atlas);
+        glGenBuffers(1, &brickBuffer);
+    }
+    glActiveTexture(GL_TEXTURE0 + SCENE_VOLUME_UNIT);
+    glBindTexture(GL_TEXTURE_3D, atlas);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 2);      // Rows of half floats needn't fill 4 bytes
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_R16F, size.x, size.y, size.z, 0, GL_RED, texelType, texels);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glActiveTexture(GL_TEXTURE0);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, brickBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (size_t)bricks.x * bricks.y * bricks.z * sizeof(SceneVolumeBrick), table, GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SCENE_VOLUME_BINDING, brickBuffer);
+}
+
+void SceneVolume::Clear()
+{
+    bricks = atlasBricks = glm::ivec3(0);
+    stored = distant = 0;
+}
+
+void SceneVolume::Upload(GLuint program) const
+{
+    glm::ivec3 samples = bricks * SCENE_VOLUME_BRICK + 1;
+    glUniform3f(glGetUniformLocation(program, "u_volumeMin"), boundsMin.x, boundsMin.y, boundsMin.z);
+    glUniform1f(glGetUniformLocation(program, "u_volumeCellSize"), cellSize);
+    glUniform3i(glGetUniformLocation(program, "u_volumeSamples"), samples.x, samples.y, samples.z);
+    glUniform3i(glGetUniformLocation(program, "u_volumeBricks"), bricks.x, bricks.y, bricks.z);
+    glUniform3i(glGetUniformLocation(program, "u_volumeAtlasBricks"), atlasBricks.x, atlasBricks.y, atlasBricks.z);
+    glUniform1f(glGetUniformLocation(program, "u_volumeError"), error);
+    glUniform1i(glGetUniformLocation(program, "u_volumeAtlas"), SCENE_VOLUME_UNIT);
+}
+
+void SceneVolume::Destroy()
+{
+    glDeleteTextures(1, &atlas);
+    glDeleteBuffers(1, &brickBuffer);
+    atlas = brickBuffer = 0;
+}
+
+std::string SceneVolume::ShaderDefines()
+{
+    return std::string("#define SCENE_VOLUME\n")
+         + "#define SCENE_VOLUME_BRICK " + std::to_string(SCENE_VOLUME_BRICK) + "\n"
+         + "#define SCENE_VOLUME_BAND " + std::to_string(SCENE_VOLUME_BAND) + "\n"
+         + "#define SCENE_VOLUME_NEAR 0xFFFFFFFFu\n"
+         + "#define SCENE_VOLUME_FAR 0xFFFFFFFEu\n";
+}
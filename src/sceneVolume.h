@@ -0,0 +1,78 @@
+#ifndef SCENE_VOLUME_CLASS_H
+#define SCENE_VOLUME_CLASS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+#include "sceneCompiler.h"
+
+const int    SCENE_VOLUME_BRICK          = 8;     // Cells per brick side, a brick stores one more sample per side
+const int    SCENE_VOLUME_CELLS          = 128;   // Along the widest side of the volume
+const float  SCENE_VOLUME_BAND           = 2.0f;  // Cells from the baked surface where lookups give way to the exact distance
+const float  SCENE_VOLUME_FAR_BAND       = 4.0f;  // Brick sides from it where one bound stands in for the whole brick
+const GLuint SCENE_VOLUME_BINDING        = 8;     // SSBO bindings, after the instance field
+const GLuint SCENE_VOLUME_SAMPLE_BINDING = 9;
+const GLuint SCENE_VOLUME_UNIT           = 2;     // Texture unit of the atlas, 0 and 1 are the history textures
+
+// Per cell and unit of the baked subtree's Lipschitz bound: the error of a
+// trilinear lookup (filtering weights have 8 bits, hence the extra 1/64),
+// and how far below its nearest sample the distance can be anywhere in a
+// brick (half a cell diagonal)
+const float  SCENE_VOLUME_ERROR          = 1.7320508f + 1.0f / 64.0f;
+const float  SCENE_VOLUME_NEAREST        = 0.8660254f;
+
+// Brick table entry, std430 layout of SceneVolumeBrick in computeShader.comp
+struct SceneVolumeBrick
+{
+    GLuint slot;            // Atlas brick x | y << 8 | z << 16, or one of the markers below
+    float  bound;           // Lower bound of the distance over the brick
+};
+
+const GLuint SCENE_VOLUME_NEAR = 0xFFFFFFFFu;   // Near the surface, evaluated exactly
+const GLuint SCENE_VOLUME_FAR  = 0xFFFFFFFEu;   // Far from it, `bound` is used
+
+// The time-invariant subtree of a compiled scene (SceneProgram::baked) as a
+// sparse distance volume, baked on the GPU when the scene loads or read from
+// a brick file sceneBaker wrote for it. Only bricks that are neither near the
+// surface nor far from it keep their samples, as half floats in a 3D atlas
+// the shader filters trilinearly; the others are a table entry. The samples
+// are exact (or saturated, in brick files), so an L-Lipschitz subtree is
+// within L * cell * sqrt(3) of a trilinear lookup anywhere in the volume and
+// the shader subtracts that.
+class SceneVolume
+{
+    public:
+        glm::vec3  boundsMin = glm::vec3(0.0f);
+        float      cellSize = 0.0f;
+        glm::ivec3 bricks = glm::ivec3(0);
+        glm::ivec3 atlasBricks = glm::ivec3(0);
+        float      error = 0.0f;            // Of a trilinear lookup
+        int        stored = 0, distant = 0; // Bricks with samples, with only a bound
+
+        bool Empty() const { return bricks.x == 0; }
+
+        // Runs the SCENE_VOLUME_BAKE_PASS program over the samples of the
+        // scene's baked subtree and packs the bricks; empty without one
+        void Bake(GLuint bakeProgram, const SceneProgram& scene);
+
+        // Maps a brick file (see sceneBrickFile.h) and uploads its table and
+        // atlas as they are; false, and empty, unless it holds this scene's
+        // baked subtree
+        bool Load(const std::string& filename, const SceneProgram& scene);
+        void Clear();
+        void Upload(GLuint program) const;     // Volume layout uniforms
+        void Destroy();
+
+        // SCENE_VOLUME and the brick constants for the shader
+        static std::string ShaderDefines();
+
+    private:
+        GLuint brickBuffer = 0, atlas = 0;
+
+        // Uploads the table and atlas texels (GL_FLOAT or GL_HALF_FLOAT) of the
+        // current layout
+        void Store(const SceneVolumeBrick* table, const void* texels, GLenum texelType);
+};
+
+#endif